@@ -1,51 +1,191 @@
 #include "Ds18B20.h"
 #include "OneWire.h"
+#include "OneWireCrc.h"
 
-void DS18B20_init(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision)
-{   
-    uint8_t i=0;
-    //fill with zeros
-    uint8_t *p = (uint8_t*)ds18B20;
-    for(;i<sizeof(Ds18B20_t);i++) {
+/* What DS18B20_configure changes */
+#define DS18B20_CFG_ALARM 0x01
+#define DS18B20_CFG_RES   0x02
+
+static uint8_t DS18B20_readConfig(Ds18B20_t *ds18B20, uint8_t sensor);
+static uint8_t DS18B20_configure(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t what,
+                                 int8_t high, int8_t low, uint8_t precision);
+static void DS18B20_updateTimeNeeded(Ds18B20_t *ds18B20);
+static uint16_t DS18B20_convTime(uint8_t cfg);
+static uint8_t DS18B20_findSensor(Ds18B20_t *ds18B20, uint8_t *rom);
+static void DS18B20_readPower(Ds18B20_t *ds18B20);
+static uint8_t DS18B20_isPowerBusy(Ds18B20_t *ds18B20);
+static void DS18B20_powerWait(Ds18B20_t *ds18B20);
+static uint8_t DS18B20_writeConfig(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *cfg);
+
+/**
+ * Fill with zeros
+ */
+static void DS18B20_clear(void *mem, uint32_t size)
+{
+    uint8_t *p = (uint8_t*)mem;
+    for(uint32_t i=0;i<size;i++) {
         p[i] = 0;
     }
-    //OneWire initialization
-    OW_init(&ds18B20->ow, huart);
+}
+
+void DS18B20_init(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision)
+{
+    DS18B20_initWithStore(ds18B20, huart, precision, NULL, NULL);
+}
+
+void DS18B20_initWithPool(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision, const DS18B20_Pool_t *pool)
+{
+    DS18B20_initWithStore(ds18B20, huart, precision, pool, NULL);
+}
 
-    uint8_t status = OW_first(&ds18B20->ow);
+/**
+ * Search the sensors, the new ones are added after the known
+ */
+static void DS18B20_search(Ds18B20_t *ds18B20)
+{
+    DS18B20_Pool_t *p = &ds18B20->pool;
+    uint8_t status = OW_targetFamily(&ds18B20->ow, DS18B20_FAMILY);
 
     //Looking for the sensors while there are avalable and their amount could be stored
-    while (status && ds18B20->sensors_found<MAX_DS18B20_SENSORS) {
-        //Save all ROMs
-        OW_getFullROM(&ds18B20->ow, ds18B20->ROMS[ds18B20->sensors_found]);
-        //Check the CRC
-        if (OW_CRC8(ds18B20->ROMS[ds18B20->sensors_found], 7) == ds18B20->ROMS[ds18B20->sensors_found][7]) {
+    while (status && ds18B20->sensors_found<p->size && ds18B20->sensors_found<DS18B20_MEASUREALL) {
+        uint8_t rom[8];
+        OW_getFullROM(&ds18B20->ow, rom);
+        //Check the CRC, it's zero for the valid ROM with its CRC. The known sensors keep their places
+        if (OW_CRC8(rom, 8) == 0 && DS18B20_findSensor(ds18B20, rom) == ds18B20->sensors_found) {
+            //Save all ROMs without CRC
+            for (uint8_t i=0;i<DS18B20_ROM_PACKED;i++) {
+                p->roms[ds18B20->sensors_found][i] = rom[i];
+            }
             ds18B20->sensors_found++;
         }
         //Looking for the next
-        status = OW_next(&ds18B20->ow);
+        status = OW_nextInFamily(&ds18B20->ow);
     }
+}
 
-    //Set the precition for all sensors at once
-    uint8_t data[] = {  OW_CMD_SKIPROM, 
-                        OW_CMD_WSCRATCHPAD, 
-                        0x7F, //0b0111 1111 //temp high
-                        0xFF, //0b1111 1111 //temp low 
-                        precision };
+/**
+ * Load the ROM table from the store, the CRC and the family of every ROM are checked
+ */
+static uint8_t DS18B20_loadTable(Ds18B20_t *ds18B20, const DS18B20_Store_t *store)
+{
+    DS18B20_Pool_t *p = &ds18B20->pool;
+    uint8_t head[2], crc;
 
-    if (OW_reset(&ds18B20->ow)) {
-        //Select all sensors. It's faster
-        OW_sendBytes(&ds18B20->ow, data, sizeof(data));
+    if (!store->read(store->ctx, 0, head, sizeof(head))) return 0;
+    uint8_t count = head[1];
+    if (head[0] != DS18B20_STORE_MAGIC || count == 0 || count > p->size || count == DS18B20_MEASUREALL) {
+        return 0;
     }
 
-    switch (precision) {
-        case DS18B20_11BITS : ds18B20->timeNeeded = 380; break;
-        case DS18B20_10BITS : ds18B20->timeNeeded = 195; break;
-        case DS18B20_9BITS  : ds18B20->timeNeeded = 100; break;
-        case DS18B20_12BITS : 
-        default:
-                              ds18B20->timeNeeded = 760; break;
+    //The pool arrays are contiguous
+    uint16_t size = (uint16_t)count * DS18B20_ROM_PACKED;
+    uint8_t *roms = p->roms[0];
+    uint8_t ok = store->read(store->ctx, sizeof(head), roms, size) &&
+                 store->read(store->ctx, sizeof(head) + size, &crc, 1);
+
+    uint8_t c = OW_CRC8_update(OW_CRC8_update(0, head[0]), head[1]);
+    for (uint16_t i=0;i<size;i++) {
+        c = OW_CRC8_update(c, roms[i]);
     }
+    ok = ok && OW_CRC8_update(c, crc) == 0;
+    for (uint8_t s=0;ok && s<count;s++) {
+        if (p->roms[s][0] != DS18B20_FAMILY) ok = 0;
+    }
+
+    if (!ok) {
+        DS18B20_clear(roms, size);
+        return 0;
+    }
+    ds18B20->sensors_found = count;
+    return 1;
+}
+
+/**
+ * Save the ROM table to the store
+ */
+static uint8_t DS18B20_saveTable(Ds18B20_t *ds18B20, const DS18B20_Store_t *store)
+{
+    uint16_t size = (uint16_t)ds18B20->sensors_found * DS18B20_ROM_PACKED;
+    uint8_t *roms = ds18B20->pool.roms[0];
+    uint8_t head[] = { DS18B20_STORE_MAGIC, ds18B20->sensors_found };
+
+    uint8_t crc = OW_CRC8_update(OW_CRC8_update(0, head[0]), head[1]);
+    for (uint16_t i=0;i<size;i++) {
+        crc = OW_CRC8_update(crc, roms[i]);
+    }
+    //The size of the table is even, the flash is written by half-words
+    uint8_t tail[] = { crc, 0xFF };
+    uint8_t tailLen = (size & 1) ? 1 : 2;
+
+    return store->write(store->ctx, 0, head, sizeof(head)) &&
+           store->write(store->ctx, sizeof(head), roms, size) &&
+           store->write(store->ctx, sizeof(head) + size, tail, tailLen);
+}
+
+uint8_t DS18B20_initWithStore(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision,
+                              const DS18B20_Pool_t *pool, const DS18B20_Store_t *store)
+{
+#if MAX_DS18B20_SENSORS > 0
+    DS18B20_Pool_t p = { MAX_DS18B20_SENSORS, ds18B20->roms, ds18B20->correction,
+                         ds18B20->lastRaw, ds18B20->sinceFull, ds18B20->cfg, ds18B20->flags, ds18B20->stats,
+                         ds18B20->fails, ds18B20->latest, ds18B20->latestTick };
+#else
+    DS18B20_Pool_t p = { 0 };
+#endif
+    if (pool) p = *pool;
+    //The lock is kept, the init takes it. So is the transport for a bus without UART
+    OW_Lock_t lock = ds18B20->ow.lock;
+    OW_Unlock_t unlock = ds18B20->ow.unlock;
+    void *lockCtx = ds18B20->ow.lockCtx;
+    const OW_Transport_t *transport = ds18B20->ow.transport;
+    void *transportCtx = ds18B20->ow.transportCtx;
+    DS18B20_clear(ds18B20, sizeof(Ds18B20_t));
+    DS18B20_clear(p.roms, (uint32_t)p.size * DS18B20_ROM_PACKED);
+    DS18B20_clear(p.correction, (uint32_t)p.size * sizeof(int16_t));
+    DS18B20_clear(p.lastRaw, (uint32_t)p.size * sizeof(int16_t));
+    DS18B20_clear(p.sinceFull, p.size);
+    DS18B20_clear(p.cfg, (uint32_t)p.size * DS18B20_CFG_BYTES);
+    DS18B20_clear(p.flags, p.size);
+    DS18B20_clear(p.stats, (uint32_t)p.size * sizeof(DS18B20_SensorStats_t));
+    DS18B20_clear(p.fails, p.size);
+    DS18B20_clear(p.latest, (uint32_t)p.size * sizeof(int16_t));
+    DS18B20_clear(p.latestTick, (uint32_t)p.size * sizeof(uint32_t));
+    ds18B20->pool = p;
+
+    //OneWire initialization
+    OW_setLock(&ds18B20->ow, lock, unlock, lockCtx);
+    OW_setTransport(&ds18B20->ow, transport, transportCtx);
+    OW_init(&ds18B20->ow, huart);
+    if (!OW_lock(&ds18B20->ow)) return 0;
+
+    uint8_t known = store ? DS18B20_loadTable(ds18B20, store) : 0;
+
+    //What the sensors have now, from their EEPROM or set before the restart.
+    //The known sensors are checked by this read, it's shorter than the search
+    for (uint8_t s=0;s<ds18B20->sensors_found;s++) {
+        if (!DS18B20_readConfig(ds18B20, s)) known = 0;
+    }
+
+    if (!known) {
+        uint8_t loaded = ds18B20->sensors_found;
+        DS18B20_search(ds18B20);
+        for (uint8_t s=loaded;s<ds18B20->sensors_found;s++) {
+            DS18B20_readConfig(ds18B20, s);
+        }
+        if (store && ds18B20->sensors_found != loaded) {
+            DS18B20_saveTable(ds18B20, store);
+        }
+    }
+    DS18B20_readPower(ds18B20);
+
+    if (precision != DS18B20_KEEP_CONFIG) {
+        //Only the sensors with another configuration are written
+        DS18B20_configure(ds18B20, DS18B20_MEASUREALL, DS18B20_CFG_ALARM | DS18B20_CFG_RES,
+                          DS18B20_ALARM_HIGH_OFF, DS18B20_ALARM_LOW_OFF, precision);
+    }
+    DS18B20_updateTimeNeeded(ds18B20);
+    OW_unlock(&ds18B20->ow);
+    return known;
 }
 
 uint8_t DS18B20_getSensorsAvailable(Ds18B20_t *ds18B20)
@@ -53,84 +193,1113 @@ uint8_t DS18B20_getSensorsAvailable(Ds18B20_t *ds18B20)
     return ds18B20->sensors_found;
 }
 
+uint8_t DS18B20_getROM(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *rom)
+{
+    if (sensor>=ds18B20->sensors_found) return 0;
+
+    for (uint8_t i=0;i<DS18B20_ROM_PACKED;i++) {
+        rom[i] = ds18B20->pool.roms[sensor][i];
+    }
+    rom[7] = OW_CRC8(rom, 7);
+    return 1;
+}
+
+/**
+ * Find the parasite powered sensors. If nobody answers the broadcast Read Power Supply
+ * all of them have external power and they are not asked one by one.
+ */
+static void DS18B20_readPower(Ds18B20_t *ds18B20)
+{
+    ds18B20->parasites = 0;
+    if (ds18B20->sensors_found == 0 || !OW_reset(&ds18B20->ow)) return;
+
+    OW_sendByte(&ds18B20->ow, OW_CMD_SKIPROM);
+    OW_sendByte(&ds18B20->ow, DS18B20_CMD_RPWRSUPPLY);
+    //A parasite powered sensor pulls the read slot low
+    if (OW_receiveBit(&ds18B20->ow)) return;
+
+    for (uint8_t s=0;s<ds18B20->sensors_found;s++) {
+        uint8_t rom[8];
+        DS18B20_getROM(ds18B20, s, rom);
+        if (!OW_reset(&ds18B20->ow)) return;
+        OW_select(&ds18B20->ow, rom);
+        OW_sendByte(&ds18B20->ow, DS18B20_CMD_RPWRSUPPLY);
+        if (!OW_receiveBit(&ds18B20->ow)) {
+            ds18B20->pool.flags[s] |= DS18B20_FLAG_PARASITE;
+            ds18B20->parasites++;
+        }
+    }
+}
+
+uint8_t DS18B20_isParasite(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (sensor>=ds18B20->sensors_found) return 0;
+    return (ds18B20->pool.flags[sensor] & DS18B20_FLAG_PARASITE) != 0;
+}
+
+void DS18B20_setStrongPullup(Ds18B20_t *ds18B20, DS18B20_Pullup_t pullup)
+{
+    ds18B20->pullup = pullup;
+}
+
+void DS18B20_setLock(Ds18B20_t *ds18B20, OW_Lock_t lock, OW_Unlock_t unlock, void *ctx)
+{
+    OW_setLock(&ds18B20->ow, lock, unlock, ctx);
+}
+
+void DS18B20_setTransport(Ds18B20_t *ds18B20, const OW_Transport_t *transport, void *ctx)
+{
+    OW_setTransport(&ds18B20->ow, transport, ctx);
+}
+
+/**
+ * Parasite sensors convert: the bus is quiet until they are done, then the strong pull-up is off
+ */
+static uint8_t DS18B20_isPowerBusy(Ds18B20_t *ds18B20)
+{
+    if (!ds18B20->powerBusy) return 0;
+    if ((HAL_GetTick() - ds18B20->powerStart) < ds18B20->powerTime) return 1;
+
+    ds18B20->powerBusy = 0;
+    if (ds18B20->pullup) ds18B20->pullup(ds18B20, 0);
+    return 0;
+}
+
+static void DS18B20_powerWait(Ds18B20_t *ds18B20)
+{
+    while (DS18B20_isPowerBusy(ds18B20)) {
+        HAL_Delay(1);
+    }
+}
+
+/**
+ * All the sensors could get Convert T at once: the strong pull-up powers the parasite
+ * ones or there is no more than one of them
+ */
+static uint8_t DS18B20_canConvertAll(Ds18B20_t *ds18B20)
+{
+    return ds18B20->parasites <= 1 || ds18B20->pullup != NULL;
+}
+
+/**
+ * Convert T is sent at the time now: a parasite sensor gets the power for its conversion
+ */
+static void DS18B20_converted(Ds18B20_t *ds18B20, uint8_t sensor, uint32_t now)
+{
+    uint8_t parasite = sensor == DS18B20_MEASUREALL ? ds18B20->parasites :
+                       (ds18B20->pool.flags[sensor] & DS18B20_FLAG_PARASITE);
+    if (parasite) {
+        if (ds18B20->pullup) ds18B20->pullup(ds18B20, 1);
+        ds18B20->powerBusy = 1;
+        ds18B20->powerStart = now;
+        ds18B20->powerTime = sensor == DS18B20_MEASUREALL ? ds18B20->timeNeeded :
+                             DS18B20_convTime(ds18B20->pool.cfg[sensor][2]);
+    }
+    ds18B20->lastTimeMeasured = now;
+    //The sensors answer the read slots from now on, but a parasite one can't and must not be disturbed
+    ds18B20->convPoll = !parasite;
+    ds18B20->convDone = 0;
+    ds18B20->convSensor = sensor;
+    ds18B20->lastPoll = now;
+}
+
+/**
+ * Select the sensor after reset, all of them with DS18B20_MEASUREALL
+ */
+static void DS18B20_select(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (sensor == DS18B20_MEASUREALL) {
+        OW_sendByte(&ds18B20->ow, OW_CMD_SKIPROM);
+    } else {
+        uint8_t rom[8];
+        DS18B20_getROM(ds18B20, sensor, rom);
+        OW_select(&ds18B20->ow, rom);
+    }
+}
+
+/**
+ * Send Convert T to the sensor or all of them, the bus is locked
+ */
+static void DS18B20_convertLocked(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    DS18B20_powerWait(ds18B20);
+    uint32_t now = HAL_GetTick();
+    if (OW_reset(&ds18B20->ow)) {
+        //Select all sensors with DS18B20_MEASUREALL. It's faster
+        DS18B20_select(ds18B20, sensor);
+        OW_sendByte(&ds18B20->ow, DS18B20_COVERTTEMP);
+        DS18B20_converted(ds18B20, sensor, now);
+    }
+}
+
+static void DS18B20_convert(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (!OW_lock(&ds18B20->ow)) return;
+    DS18B20_convertLocked(ds18B20, sensor);
+    OW_unlock(&ds18B20->ow);
+}
+
+/**
+ * DS18B20_MEASUREALL without the strong pull-up: the next parasite sensor is started
+ * when the one before is done. wait - start all of them, waiting for every one but the last
+ */
+static void DS18B20_stagger(Ds18B20_t *ds18B20, uint8_t wait)
+{
+    while (ds18B20->staggering) {
+        if (!wait && DS18B20_isPowerBusy(ds18B20)) return;
+
+        uint8_t s = ds18B20->staggerNext;
+        while (s < ds18B20->sensors_found && !(ds18B20->pool.flags[s] & DS18B20_FLAG_PARASITE)) s++;
+        if (s >= ds18B20->sensors_found) {
+            ds18B20->staggering = 0;
+            return;
+        }
+
+        if (!(wait ? OW_lock(&ds18B20->ow) : OW_tryLock(&ds18B20->ow))) return;
+        ds18B20->staggerNext = s + 1;
+        DS18B20_convertLocked(ds18B20, s);
+        OW_unlock(&ds18B20->ow);
+    }
+}
+
 void DS18B20_startMeasure(Ds18B20_t *ds18B20, uint8_t sensor)
 {
-    if (sensor<ds18B20->sensors_found || sensor==DS18B20_MEASUREALL) {
-        uint32_t now = HAL_GetTick();
-        if (sensor == DS18B20_MEASUREALL) {
-            if (OW_reset(&ds18B20->ow)) {
-                //Select all sensors. It's faster
-                OW_sendByte(&ds18B20->ow, OW_CMD_SKIPROM);
-                OW_sendByte(&ds18B20->ow, DS18B20_COVERTTEMP);
-                for(uint8_t i=0;i<ds18B20->sensors_found;i++) {
-                    ds18B20->lastTimeMeasured[i] = now;
-                }
-            }
-        } else {
-            if (OW_reset(&ds18B20->ow)) {
-                OW_select(&ds18B20->ow, ds18B20->ROMS[sensor]);
-                OW_sendByte(&ds18B20->ow, DS18B20_COVERTTEMP);
-                ds18B20->lastTimeMeasured[sensor] = now;
-            }
+    if (sensor<ds18B20->sensors_found || (sensor==DS18B20_MEASUREALL && DS18B20_canConvertAll(ds18B20))) {
+        DS18B20_convert(ds18B20, sensor);
+    } else if (sensor==DS18B20_MEASUREALL) {
+        //The resistor powers one conversion: the external powered sensors go first,
+        //they convert while the parasite ones are done one by one
+        for (uint8_t s=0;s<ds18B20->sensors_found;s++) {
+            if (!(ds18B20->pool.flags[s] & DS18B20_FLAG_PARASITE)) DS18B20_convert(ds18B20, s);
         }
+        ds18B20->staggering = 1;
+        ds18B20->staggerNext = 0;
+        DS18B20_stagger(ds18B20, 0);
+    }
+}
+
+/**
+ * Conversion time of the configuration register, ms. The worst one if it's unknown
+ */
+static uint16_t DS18B20_convTime(uint8_t cfg)
+{
+    //The low 5 bits always read 1
+    if ((cfg & 0x1F) != 0x1F) return 760;
+
+    switch (cfg & 0x60) {
+        case 0x00: return 100;
+        case 0x20: return 195;
+        case 0x40: return 380;
+        default:   return 760;
+    }
+}
+
+/**
+ * The longest conversion of the sensors, it's waited for DS18B20_MEASUREALL
+ */
+static void DS18B20_updateTimeNeeded(Ds18B20_t *ds18B20)
+{
+    uint16_t time = 0;
+    for (uint8_t s=0;s<ds18B20->sensors_found;s++) {
+        uint16_t t = DS18B20_convTime(ds18B20->pool.cfg[s][2]);
+        if (t > time) time = t;
     }
+    ds18B20->timeNeeded = time;
 }
 
 uint8_t DS18B20_isTempReady(Ds18B20_t *ds18B20, uint8_t sensor)
 {
     if (sensor != DS18B20_MEASUREALL && sensor>=ds18B20->sensors_found) return 0;
 
-    if (sensor == DS18B20_MEASUREALL) sensor = 0;
-    return ((HAL_GetTick() - ds18B20->lastTimeMeasured[sensor])>=ds18B20->timeNeeded);
+    //The parasite sensors of DS18B20_MEASUREALL are still started one by one
+    DS18B20_stagger(ds18B20, 0);
+    if (ds18B20->staggering) return 0;
+
+    uint32_t now = HAL_GetTick();
+    uint16_t timeNeeded = sensor == DS18B20_MEASUREALL ? ds18B20->timeNeeded :
+                          DS18B20_convTime(ds18B20->pool.cfg[sensor][2]);
+    if ((now - ds18B20->lastTimeMeasured)>=timeNeeded) return 1;
+
+    if (ds18B20->readyMode != DS18B20_READY_POLL) return 0;
+    //Only the sensors of the last Convert T answer the read slot, the others have the timer
+    if (ds18B20->convSensor != sensor && ds18B20->convSensor != DS18B20_MEASUREALL) return 0;
+    if (ds18B20->convDone) return 1;
+    //After any other command the read slot says nothing about the conversion
+    if (!ds18B20->convPoll || (now - ds18B20->lastPoll) < ds18B20->pollInterval) return 0;
+
+    //Another task has the bus, the timer will tell
+    if (!OW_tryLock(&ds18B20->ow)) return 0;
+    ds18B20->lastPoll = now;
+    if (ds18B20->convPoll && OW_receiveBit(&ds18B20->ow) && ds18B20->ow.status == HAL_OK) {
+        ds18B20->convDone = 1;
+    }
+    OW_unlock(&ds18B20->ow);
+    return ds18B20->convDone;
 }
 
-int16_t DS18B20_getTempRaw(Ds18B20_t *ds18B20, uint8_t sensor)
+void DS18B20_setReadyMode(Ds18B20_t *ds18B20, uint8_t mode, uint8_t pollInterval)
 {
-    if (sensor != DS18B20_MEASUREALL && sensor>=ds18B20->sensors_found) 
-        return DS18B20_TEMP_NOT_READ;
-    
+    ds18B20->readyMode = mode;
+    ds18B20->pollInterval = pollInterval;
+}
+
+static int16_t DS18B20_decode(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *data, uint8_t crc);
+
+/**
+ * Counters of the sensor, the first one for DS18B20_MEASUREALL
+ */
+static DS18B20_SensorStats_t *DS18B20_stats(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    return &ds18B20->pool.stats[sensor==DS18B20_MEASUREALL ? 0 : sensor];
+}
+
+/**
+ * Zero the undefined low bits at lower resolution
+ */
+static int16_t DS18B20_mask(int16_t raw, uint8_t cfg)
+{
+    cfg &= 0x60;
+    if (cfg == 0x00) raw = raw & ~7;  // 9 bit resolution, 93.75 ms
+    else if (cfg == 0x20) raw = raw & ~3; // 10 bit res, 187.5 ms
+    else if (cfg == 0x40) raw = raw & ~1; // 11 bit res, 375 ms
+    //// default is 12 bit resolution, 750 ms conversion time
+    return raw;
+}
+
+/**
+ * Reset and select the sensor for reading the scratchpad
+ */
+static uint8_t DS18B20_selectRead(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    DS18B20_powerWait(ds18B20);
+    ds18B20->convPoll = 0;
     if (!OW_reset(&ds18B20->ow)){
+        return 0;
+    }
+    
+    DS18B20_select(ds18B20, sensor);
+    OW_sendByte(&ds18B20->ow, OW_CMD_RSCRATCHPAD);
+    return 1;
+}
+
+/**
+ * Read the whole scratchpad with CRC check
+ */
+static int16_t DS18B20_readFull(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (!DS18B20_selectRead(ds18B20, sensor)) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
         return DS18B20_TEMP_NOT_READ;
     }
+
+    uint8_t data[12];
     
+    // we need 9 bytes, CRC is calculated while they come
+    uint8_t crc = OW_receiveBytesCRC8(&ds18B20->ow, data, 9, 0);
+    return DS18B20_decode(ds18B20, sensor, data, crc);
+}
+
+/**
+ * Read only the temperature and stop the sensor with reset
+ */
+static int16_t DS18B20_readTemp(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (!DS18B20_selectRead(ds18B20, sensor)) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
+        return DS18B20_TEMP_NOT_READ;
+    }
+
+    uint8_t data[5];
+    OW_receiveBytes(&ds18B20->ow, data, 2);
+    uint8_t lost = ds18B20->ow.status != HAL_OK;
+    //0xFFFF is -0.0625 degrees or the bus left high by nobody. The configuration
+    //register has fixed bits (bit 7 is 0), read on to it to tell them apart
+    if (!lost && data[0] == 0xFF && data[1] == 0xFF) {
+        OW_receiveBytes(&ds18B20->ow, &data[2], 3);
+        lost = ds18B20->ow.status != HAL_OK || (data[4] & 0x9F) != 0x1F;
+    }
+    OW_reset(&ds18B20->ow);
+    if (lost) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
+        return DS18B20_TEMP_NOT_READ;
+    }
+
+    int16_t raw = (data[1] << 8) | data[0];
+    //-55...125 degrees
+    if (raw < -880 || raw > 2000) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
+        return DS18B20_TEMP_ERROR;
+    }
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    raw = DS18B20_mask(raw, ds18B20->pool.cfg[s][2]);
+    return raw + ds18B20->pool.correction[s];
+}
+
+/**
+ * Read the temperature only, but fully every fullReadEvery samples and when it doesn't look right
+ */
+static int16_t DS18B20_readHybrid(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    int16_t cor = ds18B20->pool.correction[s];
+    uint8_t *sinceFull = &ds18B20->pool.sinceFull[s];
+    int16_t t = DS18B20_TEMP_ERROR;
+
+    //The first read and every fullReadEvery are full
+    if (*sinceFull && *sinceFull < ds18B20->fullReadEvery) {
+        t = DS18B20_readTemp(ds18B20, sensor);
+        if (t > DS18B20_TEMP_NOT_READ) {
+            int16_t step = t - cor - ds18B20->pool.lastRaw[s];
+            if (step > ds18B20->maxStep || step < -ds18B20->maxStep || t - cor == 0x0550) {
+                //Doesn't look right, check it
+                t = DS18B20_TEMP_ERROR;
+            } else {
+                (*sinceFull)++;
+            }
+        }
+    }
+
+    if (t <= DS18B20_TEMP_NOT_READ) {
+        t = DS18B20_readFull(ds18B20, sensor);
+        if (t > DS18B20_TEMP_NOT_READ) {
+            *sinceFull = 1;
+        }
+    }
+
+    if (t > DS18B20_TEMP_NOT_READ) {
+        ds18B20->pool.lastRaw[s] = t - cor;
+    }
+    return t;
+}
+
+/**
+ * Read in the mode set by @ref DS18B20_setReadMode
+ */
+static int16_t DS18B20_read(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (ds18B20->readMode == DS18B20_READ_TEMP_ONLY) {
+        return DS18B20_readTemp(ds18B20, sensor);
+    }
+    if (ds18B20->readMode != DS18B20_READ_HYBRID) {
+        return DS18B20_readFull(ds18B20, sensor);
+    }
+    return DS18B20_readHybrid(ds18B20, sensor);
+}
+
+/**
+ * Counts down the reads of a quarantined sensor and probes it when it's time.
+ * The probe reads up to the configuration register: its bit 7 is 0 and the low 5 bits are 1,
+ * so the line left high by a missing sensor doesn't pass.
+ */
+static void DS18B20_probe(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    uint8_t *fails = &ds18B20->pool.fails[s];
+    if (*fails > 1) {
+        (*fails)--;
+        return;
+    }
+    *fails = ds18B20->probeEvery;
+
+    uint8_t data[5];
+    if (!DS18B20_selectRead(ds18B20, sensor)) return;
+    OW_receiveBytes(&ds18B20->ow, data, sizeof(data));
+    OW_reset(&ds18B20->ow);
+    if (ds18B20->ow.status != HAL_OK || (data[4] & 0x9F) != 0x1F) return;
+
+    //After a power cycle it has the configuration from its EEPROM
+    uint8_t *cfg = ds18B20->pool.cfg[s];
+    if ((cfg[2] & 0x1F) == 0x1F && (data[2] != cfg[0] || data[3] != cfg[1] || data[4] != cfg[2])) {
+        DS18B20_writeConfig(ds18B20, sensor, cfg);
+    }
+    ds18B20->pool.flags[s] &= ~DS18B20_FLAG_QUARANTINE;
+    *fails = 0;
+}
+
+/**
+ * Counts the result, the failures in a row put the sensor to quarantine
+ */
+static void DS18B20_track(Ds18B20_t *ds18B20, uint8_t sensor, int16_t t)
+{
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    uint8_t *fails = &ds18B20->pool.fails[s];
+
+    if (t > DS18B20_TEMP_NOT_READ) {
+        ds18B20->pool.stats[s].reads++;
+        *fails = 0;
+        return;
+    }
+    if (*fails < 0xFF) (*fails)++;
+    if (ds18B20->quarantineAfter && *fails >= ds18B20->quarantineAfter) {
+        ds18B20->pool.flags[s] |= DS18B20_FLAG_QUARANTINE;
+        *fails = ds18B20->probeEvery;
+    }
+}
+
+/**
+ * Keeps the temperature as the latest and puts the reading to the ring.
+ * Called from the interrupt for the asynchronous reads.
+ */
+static void DS18B20_publish(Ds18B20_t *ds18B20, uint8_t sensor, int16_t t)
+{
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    uint32_t now = HAL_GetTick();
+
+    if (t > DS18B20_TEMP_NOT_READ) {
+        ds18B20->pool.latest[s] = t;
+        ds18B20->pool.latestTick[s] = now;
+        ds18B20->pool.flags[s] |= DS18B20_FLAG_READ;
+    }
+
+    DS18B20_Ring_t *ring = ds18B20->ring;
+    if (ring == NULL) return;
+    uint16_t head = ring->head;
+    uint16_t next = head + 1 == ring->size ? 0 : head + 1;
+    if (next == ring->tail) {
+        ring->dropped++;
+        return;
+    }
+    DS18B20_Reading_t *r = &ring->buf[head];
+    r->raw = t;
+    r->sensor = s;
+    r->status = t > DS18B20_TEMP_NOT_READ ? DS18B20_READING_OK :
+                t == DS18B20_TEMP_NOT_READ ? DS18B20_READING_NOT_READ : DS18B20_READING_BROKEN;
+    r->tick = now;
+    //The reading must be in memory before the consumer sees the new head
+    __DMB();
+    ring->head = next;
+}
+
+/**
+ * Read with the retries, counted and published. The bus is locked for all that,
+ * wait - 0 if another task has it
+ */
+static int16_t DS18B20_getTemp(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t wait)
+{
+    //Skip ROM is counted in the entry 0 of the pool, there is none without sensors
+    if (sensor>=ds18B20->sensors_found && (sensor != DS18B20_MEASUREALL || !ds18B20->sensors_found))
+        return DS18B20_TEMP_NOT_READ;
+    //Read before all the parasite sensors of DS18B20_MEASUREALL are started: start them first
+    DS18B20_stagger(ds18B20, wait);
+    if (ds18B20->staggering)
+        return DS18B20_TEMP_BUSY;
+    if (!(wait ? OW_lock(&ds18B20->ow) : OW_tryLock(&ds18B20->ow)))
+        return DS18B20_TEMP_BUSY;
+
+    //The sensor which passes the probe missed the conversion, it is read the next time
+    uint8_t s = sensor==DS18B20_MEASUREALL ? 0 : sensor;
+    if (ds18B20->pool.flags[s] & DS18B20_FLAG_QUARANTINE) {
+        DS18B20_probe(ds18B20, sensor);
+        OW_unlock(&ds18B20->ow);
+        return DS18B20_TEMP_QUARANTINE;
+    }
+
+    int16_t t = DS18B20_read(ds18B20, sensor);
+    //Below DS18B20_TEMP_NOT_READ the sensor answered with broken data, it's worth another try
+    for (uint8_t i=0;i<ds18B20->retries && t < DS18B20_TEMP_NOT_READ;i++) {
+        if (ds18B20->backoffMs) HAL_Delay((uint32_t)ds18B20->backoffMs << i);
+        t = DS18B20_read(ds18B20, sensor);
+    }
+    DS18B20_track(ds18B20, sensor, t);
+    DS18B20_publish(ds18B20, sensor, t);
+    OW_unlock(&ds18B20->ow);
+    return t;
+}
+
+int16_t DS18B20_getTempRaw(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    return DS18B20_getTemp(ds18B20, sensor, 1);
+}
+
+int16_t DS18B20_tryGetTempRaw(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    return DS18B20_getTemp(ds18B20, sensor, 0);
+}
+
+void DS18B20_setRetry(Ds18B20_t *ds18B20, uint8_t retries, uint8_t backoffMs, uint8_t quarantineAfter, uint8_t probeEvery)
+{
+    ds18B20->retries = retries;
+    ds18B20->backoffMs = backoffMs;
+    ds18B20->quarantineAfter = quarantineAfter;
+    ds18B20->probeEvery = probeEvery ? probeEvery : 1;
+}
+
+uint8_t DS18B20_isQuarantined(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (sensor>=ds18B20->sensors_found) return 0;
+    return (ds18B20->pool.flags[sensor] & DS18B20_FLAG_QUARANTINE) != 0;
+}
+
+void DS18B20_setRing(Ds18B20_t *ds18B20, DS18B20_Ring_t *ring)
+{
+    ds18B20->ring = ring;
+}
+
+uint16_t DS18B20_ringDrain(DS18B20_Ring_t *ring, DS18B20_Reading_t *readings, uint16_t max)
+{
+    uint16_t tail = ring->tail;
+    uint16_t head = ring->head;
+    //The readings before head are in memory once the head is seen
+    __DMB();
+
+    uint16_t n = 0;
+    while (tail != head && n < max) {
+        readings[n++] = ring->buf[tail];
+        tail = tail + 1 == ring->size ? 0 : tail + 1;
+    }
+
+    //They are copied before the producer can use the places again
+    __DMB();
+    ring->tail = tail;
+    return n;
+}
+
+uint16_t DS18B20_ringCount(DS18B20_Ring_t *ring)
+{
+    uint16_t head = ring->head;
+    uint16_t tail = ring->tail;
+    return head >= tail ? head - tail : ring->size - tail + head;
+}
+
+uint8_t DS18B20_getLatest(Ds18B20_t *ds18B20, uint8_t sensor, int16_t *raw, uint32_t *ageMs)
+{
+    if (sensor>=ds18B20->sensors_found) return 0;
+
+    //The asynchronous reads update them from the interrupt
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint8_t read = (ds18B20->pool.flags[sensor] & DS18B20_FLAG_READ) != 0;
+    int16_t t = ds18B20->pool.latest[sensor];
+    uint32_t tick = ds18B20->pool.latestTick[sensor];
+    __set_PRIMASK(primask);
+
+    if (!read) return 0;
+    *raw = t;
+    if (ageMs) *ageMs = HAL_GetTick() - tick;
+    return 1;
+}
+
+/**
+ * Read the scratchpad of the sensor into its copy of the configuration, zeros if it failed
+ */
+static uint8_t DS18B20_readConfig(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    uint8_t data[9];
+    uint8_t *cfg = ds18B20->pool.cfg[sensor];
+    uint8_t ok = DS18B20_selectRead(ds18B20, sensor) &&
+                 OW_receiveBytesCRC8(&ds18B20->ow, data, 9, 0) == 0 &&
+                 (data[4] & 0x1F) == 0x1F;
+
+    for (uint8_t i=0;i<DS18B20_CFG_BYTES;i++) {
+        cfg[i] = ok ? data[2 + i] : 0;
+    }
+    return ok;
+}
+
+/**
+ * The configuration the sensor should get, what isn't changed is kept.
+ * If the sensor's one is unknown the defaults of @ref DS18B20_init are used.
+ */
+static void DS18B20_newConfig(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t what,
+                              int8_t high, int8_t low, uint8_t precision, uint8_t *cfg)
+{
+    uint8_t *old = ds18B20->pool.cfg[sensor];
+    uint8_t known = (old[2] & 0x1F) == 0x1F;
+
+    cfg[0] = (what & DS18B20_CFG_ALARM) ? (uint8_t)high : known ? old[0] : (uint8_t)DS18B20_ALARM_HIGH_OFF;
+    cfg[1] = (what & DS18B20_CFG_ALARM) ? (uint8_t)low  : known ? old[1] : (uint8_t)DS18B20_ALARM_LOW_OFF;
+    cfg[2] = (what & DS18B20_CFG_RES)   ? precision     : known ? old[2] : DS18B20_12BITS;
+}
+
+/**
+ * Write TH, TL and the configuration register to the scratchpad
+ */
+static uint8_t DS18B20_writeConfig(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *cfg)
+{
+    DS18B20_powerWait(ds18B20);
+    ds18B20->convPoll = 0;
+    if (!OW_reset(&ds18B20->ow)) return 0;
+
+    DS18B20_select(ds18B20, sensor);
+    //The configuration register is written together with TH and TL
+    uint8_t data[] = { OW_CMD_WSCRATCHPAD, cfg[0], cfg[1], cfg[2] };
+    OW_sendBytes(&ds18B20->ow, data, sizeof(data));
+    return 1;
+}
+
+/**
+ * Change the configuration of the sensors where it differs from the copy and check it.
+ * If all of them need the same bytes they are written at once.
+ */
+static uint8_t DS18B20_configure(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t what,
+                                 int8_t high, int8_t low, uint8_t precision)
+{
+    uint8_t first = sensor, last = sensor + 1;
     if (sensor == DS18B20_MEASUREALL) {
-        OW_sendByte(&ds18B20->ow, DS18B20_CMD_SKIPROM);
+        first = 0;
+        last = ds18B20->sensors_found;
+    } else if (sensor >= ds18B20->sensors_found) {
+        return 0;
+    }
+    //The low 5 bits read 1 whatever is written
+    precision = (precision & 0x60) | 0x1F;
+
+    uint8_t cfg[DS18B20_CFG_BYTES], all[DS18B20_CFG_BYTES];
+    uint8_t differ = 0, same = 1;
+    for (uint8_t s=first;s<last;s++) {
+        DS18B20_newConfig(ds18B20, s, what, high, low, precision, cfg);
+        for (uint8_t i=0;i<DS18B20_CFG_BYTES;i++) {
+            if (s == first) all[i] = cfg[i];
+            if (cfg[i] != all[i]) same = 0;
+        }
+        uint8_t *old = ds18B20->pool.cfg[s];
+        if (old[0] != cfg[0] || old[1] != cfg[1] || old[2] != cfg[2]) differ++;
+    }
+    if (differ == 0) return 1;
+
+    uint8_t ok = 1;
+    if (sensor == DS18B20_MEASUREALL && same && differ == last && last > 1) {
+        ok = DS18B20_writeConfig(ds18B20, DS18B20_MEASUREALL, all);
     } else {
-        OW_select(&ds18B20->ow, ds18B20->ROMS[sensor]);
+        for (uint8_t s=first;s<last;s++) {
+            DS18B20_newConfig(ds18B20, s, what, high, low, precision, cfg);
+            uint8_t *old = ds18B20->pool.cfg[s];
+            if (old[0] != cfg[0] || old[1] != cfg[1] || old[2] != cfg[2]) {
+                if (!DS18B20_writeConfig(ds18B20, s, cfg)) ok = 0;
+            }
+        }
     }
-    OW_sendByte(&ds18B20->ow, OW_CMD_RSCRATCHPAD);
-    
-    uint8_t data[12];
-    uint16_t s = 0;
-    
-    for (uint8_t j = 0; j < 9; j++) {           // we need 9 bytes
-        data[j] = OW_receiveByte(&ds18B20->ow);
-        s += data[j];
+
+    //Read back what was written
+    for (uint8_t s=first;s<last;s++) {
+        DS18B20_newConfig(ds18B20, s, what, high, low, precision, cfg);
+        uint8_t *old = ds18B20->pool.cfg[s];
+        if (old[0] == cfg[0] && old[1] == cfg[1] && old[2] == cfg[2]) continue;
+
+        DS18B20_readConfig(ds18B20, s);
+        if (old[0] != cfg[0] || old[1] != cfg[1] || old[2] != cfg[2]) ok = 0;
+    }
+
+    DS18B20_updateTimeNeeded(ds18B20);
+    return ok;
+}
+
+/**
+ * The change of the configuration is one transaction for the other tasks: written and read back
+ */
+static uint8_t DS18B20_configureLocked(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t what,
+                                       int8_t high, int8_t low, uint8_t precision)
+{
+    if (!OW_lock(&ds18B20->ow)) return 0;
+    uint8_t ok = DS18B20_configure(ds18B20, sensor, what, high, low, precision);
+    OW_unlock(&ds18B20->ow);
+    return ok;
+}
+
+uint8_t DS18B20_setAlarm(Ds18B20_t *ds18B20, uint8_t sensor, int8_t high, int8_t low)
+{
+    return DS18B20_configureLocked(ds18B20, sensor, DS18B20_CFG_ALARM, high, low, 0);
+}
+
+uint8_t DS18B20_setResolution(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t precision)
+{
+    return DS18B20_configureLocked(ds18B20, sensor, DS18B20_CFG_RES, 0, 0, precision);
+}
+
+uint8_t DS18B20_getConfig(Ds18B20_t *ds18B20, uint8_t sensor, int8_t *high, int8_t *low, uint8_t *precision)
+{
+    if (sensor>=ds18B20->sensors_found) return 0;
+
+    uint8_t *cfg = ds18B20->pool.cfg[sensor];
+    if ((cfg[2] & 0x1F) != 0x1F) return 0;
+
+    *high = (int8_t)cfg[0];
+    *low = (int8_t)cfg[1];
+    *precision = cfg[2];
+    return 1;
+}
+
+uint8_t DS18B20_saveConfig(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    if (sensor != DS18B20_MEASUREALL && sensor>=ds18B20->sensors_found) return 0;
+    if (!OW_lock(&ds18B20->ow)) return 0;
+
+    DS18B20_powerWait(ds18B20);
+    ds18B20->convPoll = 0;
+    if (!OW_reset(&ds18B20->ow)) {
+        OW_unlock(&ds18B20->ow);
+        return 0;
+    }
+
+    DS18B20_select(ds18B20, sensor);
+    OW_sendByte(&ds18B20->ow, DS18B20_CMD_CPYSCRATCHPAD);
+    //The EEPROM is written up to 10 ms, parasite sensors take the power from the line
+    uint8_t parasite = sensor == DS18B20_MEASUREALL ? ds18B20->parasites :
+                       (ds18B20->pool.flags[sensor] & DS18B20_FLAG_PARASITE);
+    if (parasite && ds18B20->pullup) ds18B20->pullup(ds18B20, 1);
+    HAL_Delay(10);
+    if (parasite && ds18B20->pullup) ds18B20->pullup(ds18B20, 0);
+    OW_unlock(&ds18B20->ow);
+    return 1;
+}
+
+/**
+ * Index of the sensor with the ROM, sensors_found if it's unknown
+ */
+static uint8_t DS18B20_findSensor(Ds18B20_t *ds18B20, uint8_t *rom)
+{
+    uint8_t s;
+    for (s=0;s<ds18B20->sensors_found;s++) {
+        uint8_t i = 0;
+        while (i < DS18B20_ROM_PACKED && ds18B20->pool.roms[s][i] == rom[i]) i++;
+        if (i == DS18B20_ROM_PACKED) break;
+    }
+    return s;
+}
+
+uint8_t DS18B20_getAlarmed(Ds18B20_t *ds18B20, uint8_t *sensors, uint8_t max)
+{
+    uint8_t rom[8];
+    uint8_t n = 0;
+
+    //The alarm flags are set by the conversion, all of them must be started
+    DS18B20_stagger(ds18B20, 1);
+    //The search is one transaction, its state is in the bus
+    if (!OW_lock(&ds18B20->ow)) return 0;
+    DS18B20_powerWait(ds18B20);
+    ds18B20->convPoll = 0;
+    uint8_t status = OW_firstAlarm(&ds18B20->ow);
+    while (status && n < max) {
+        OW_getFullROM(&ds18B20->ow, rom);
+        uint8_t s = DS18B20_findSensor(ds18B20, rom);
+        //Other devices could have the alarms too
+        if (s < ds18B20->sensors_found) {
+            sensors[n++] = s;
+        }
+        status = OW_nextAlarm(&ds18B20->ow);
+    }
+    OW_unlock(&ds18B20->ow);
+    return n;
+}
+
+uint8_t DS18B20_readAlarmed(Ds18B20_t *ds18B20, uint8_t *sensors, int16_t *temps, uint8_t max)
+{
+    uint8_t n = DS18B20_getAlarmed(ds18B20, sensors, max);
+    for (uint8_t i=0;i<n;i++) {
+        temps[i] = DS18B20_getTempRaw(ds18B20, sensors[i]);
+    }
+    return n;
+}
+
+/**
+ * The bus counts the CRC errors of all the drivers, it can't check the data itself
+ */
+static void DS18B20_countCRCError(Ds18B20_t *ds18B20, uint8_t sensor)
+{
+    DS18B20_stats(ds18B20, sensor)->crcErrors++;
+    ds18B20->ow.stats.crcErrors++;
+}
+
+/**
+ * Checks the scratchpad and calculates the temperature
+ * crc - CRC8 of all 9 bytes
+ */
+static int16_t DS18B20_decode(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *data, uint8_t crc)
+{
+    //Bit 7 of the configuration register always reads 0, 0xFF is the line left high:
+    //the sensor doesn't answer, it is not an error of the data
+    if (data[4] == 0xFF) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
+        return DS18B20_TEMP_NOT_READ;
     }
-    //The CRC algorithm has an error. If all bytes are zeros the CRC will be ok
-    //So this check is agains it
-    if (s==0) {
+
+    //If all bytes are zeros (bus is shorted) the CRC will be ok.
+    //The low 5 bits of the configuration register always read 1, so check them
+    if ((data[4] & 0x1F) != 0x1F) {
+        DS18B20_countCRCError(ds18B20, sensor);
         return DS18B20_TEMP_CRC_ERROR;
     }
 
-    if (OW_CRC8(data, 8) != data[8]) {
+    //CRC of the data with its CRC at the end is zero
+    if (crc != 0) {
+        DS18B20_countCRCError(ds18B20, sensor);
         return DS18B20_TEMP_ERROR;
     }
     
     //temp calculation
     int16_t raw = (data[1] << 8) | data[0];
-    uint8_t cfg = (data[4] & 0x60);
 
     // at lower res, the low bits are undefined, so let's zero them
-    if (cfg == 0x00) raw = raw & ~7;  // 9 bit resolution, 93.75 ms
-    else if (cfg == 0x20) raw = raw & ~3; // 10 bit res, 187.5 ms
-    else if (cfg == 0x40) raw = raw & ~1; // 11 bit res, 375 ms
-    //// default is 12 bit resolution, 750 ms conversion time
-    return raw + ds18B20->correction[sensor==DS18B20_MEASUREALL?0:sensor];
+    raw = DS18B20_mask(raw, data[4]);
+    return raw + ds18B20->pool.correction[sensor==DS18B20_MEASUREALL?0:sensor];
+}
+
+void DS18B20_setReadMode(Ds18B20_t *ds18B20, uint8_t mode, uint8_t fullReadEvery, int16_t maxStep)
+{
+    ds18B20->readMode = mode;
+    ds18B20->fullReadEvery = fullReadEvery ? fullReadEvery : 1;
+    ds18B20->maxStep = maxStep;
 }
 
 void DS18B20_setCorrection(Ds18B20_t *ds18B20, uint8_t sensor, int16_t cor)
 {
     if (sensor>=ds18B20->sensors_found) return;
-    ds18B20->correction[sensor] = cor;
-}
\ No newline at end of file
+    ds18B20->pool.correction[sensor] = cor;
+}
+
+void DS18B20_setCorrectionMilli(Ds18B20_t *ds18B20, uint8_t sensor, int32_t milli)
+{
+    DS18B20_setCorrection(ds18B20, sensor, DS18B20_fromMilli(milli));
+}
+
+uint8_t DS18B20_formatDec(char *buf, int32_t value, uint8_t decimals)
+{
+    char digits[10];
+    uint8_t n = 0, len = 0;
+    //the magnitude of INT32_MIN doesn't fit int32_t
+    uint32_t u = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    if (decimals > 9) decimals = 9;
+
+    do {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u || n <= decimals);
+
+    if (value < 0) buf[len++] = '-';
+    while (n) {
+        if (n == decimals) buf[len++] = '.';
+        buf[len++] = digits[--n];
+    }
+    buf[len] = 0;
+    return len;
+}
+
+uint8_t DS18B20_format(char *buf, int16_t raw, uint8_t decimals)
+{
+    static const uint16_t div[5] = { 10000, 1000, 100, 10, 1 };
+    if (decimals > 4) decimals = 4;
+
+    //steps of 0.0001, half of the divider rounds away from zero
+    int32_t value = (int32_t)raw * 625;
+    int32_t half = div[decimals] / 2;
+    value = (value + (value < 0 ? -half : half)) / div[decimals];
+    return DS18B20_formatDec(buf, value, decimals);
+}
+
+/* First sensor of the group of the scheduler, the group ends at the first of the next one */
+static uint8_t DS18B20_schedFirst(Ds18B20_t *ds18B20, uint8_t group)
+{
+    return (uint16_t)group * ds18B20->sensors_found / ds18B20->schedGroups;
+}
+
+void DS18B20_schedulerStart(Ds18B20_t *ds18B20, uint8_t groups, DS18B20_Callback_t done)
+{
+    if (groups > DS18B20_SCHED_MAX_GROUPS) groups = DS18B20_SCHED_MAX_GROUPS;
+    if (groups > ds18B20->sensors_found) groups = ds18B20->sensors_found;
+    if (groups == 0) groups = 1;
+    //The bus is quiet while parasite sensors convert, nothing to overlap
+    if (ds18B20->parasites) groups = 1;
+
+    for (uint8_t g=0;g<DS18B20_SCHED_MAX_GROUPS;g++) {
+        ds18B20->schedState[g] = DS18B20_SCHED_IDLE;
+    }
+    ds18B20->schedDone = done;
+    ds18B20->schedStarted = HAL_GetTick();
+    ds18B20->schedStats.samples = 0;
+    ds18B20->schedStats.failures = 0;
+    ds18B20->schedStats.busyPolls = 0;
+    ds18B20->schedStats.idlePolls = 0;
+    ds18B20->schedGroups = ds18B20->sensors_found ? groups : 0;
+}
+
+void DS18B20_schedulerStop(Ds18B20_t *ds18B20)
+{
+    ds18B20->schedGroups = 0;
+}
+
+/* Sends Convert T to the next sensor of the group, all of them if there is one group */
+static void DS18B20_schedConvert(Ds18B20_t *ds18B20, uint8_t g)
+{
+    uint8_t last = DS18B20_schedFirst(ds18B20, g + 1);
+
+    if (ds18B20->schedGroups == 1 && DS18B20_canConvertAll(ds18B20)) {
+        DS18B20_startMeasure(ds18B20, DS18B20_MEASUREALL);
+        ds18B20->schedNext[g] = last;
+    } else {
+        DS18B20_startMeasure(ds18B20, ds18B20->schedNext[g]++);
+    }
+
+    if (ds18B20->schedNext[g] >= last) {
+        //The group is ready when its last sensor is, after the longest conversion of the group
+        uint16_t time = 0;
+        for (uint8_t s=DS18B20_schedFirst(ds18B20, g);s<last;s++) {
+            uint16_t t = DS18B20_convTime(ds18B20->pool.cfg[s][2]);
+            if (t > time) time = t;
+        }
+        ds18B20->schedTime[g] = time;
+        ds18B20->schedMeasured[g] = HAL_GetTick();
+        ds18B20->schedState[g] = DS18B20_SCHED_WAIT;
+    }
+}
+
+/* Reads the next sensor of the group */
+static void DS18B20_schedRead(Ds18B20_t *ds18B20, uint8_t g)
+{
+    uint8_t sensor = ds18B20->schedNext[g]++;
+    int16_t t = DS18B20_getTempRaw(ds18B20, sensor);
+
+    //The rate is of the temperatures, the sensors which fail don't make it better
+    if (t > DS18B20_TEMP_NOT_READ) {
+        ds18B20->schedStats.samples++;
+    } else {
+        ds18B20->schedStats.failures++;
+    }
+    if (ds18B20->schedDone) ds18B20->schedDone(ds18B20, sensor, t);
+
+    if (ds18B20->schedNext[g] >= DS18B20_schedFirst(ds18B20, g + 1)) {
+        ds18B20->schedState[g] = DS18B20_SCHED_IDLE;
+    }
+}
+
+uint8_t DS18B20_schedulerPoll(Ds18B20_t *ds18B20)
+{
+    uint8_t groups = ds18B20->schedGroups;
+    if (groups == 0) return 0;
+    if (DS18B20_isPowerBusy(ds18B20)) {
+        ds18B20->schedStats.idlePolls++;
+        return 0;
+    }
+
+    //The conversions go first, they run while the others are read
+    for (uint8_t g=0;g<groups;g++) {
+        if (ds18B20->schedState[g] == DS18B20_SCHED_IDLE) {
+            ds18B20->schedState[g] = DS18B20_SCHED_CONVERT;
+            ds18B20->schedNext[g] = DS18B20_schedFirst(ds18B20, g);
+        }
+        if (ds18B20->schedState[g] == DS18B20_SCHED_CONVERT) {
+            DS18B20_schedConvert(ds18B20, g);
+            ds18B20->schedStats.busyPolls++;
+            return 1;
+        }
+    }
+
+    uint32_t now = HAL_GetTick();
+    for (uint8_t g=0;g<groups;g++) {
+        if (ds18B20->schedState[g] == DS18B20_SCHED_WAIT &&
+            (now - ds18B20->schedMeasured[g]) >= ds18B20->schedTime[g]) {
+            ds18B20->schedState[g] = DS18B20_SCHED_READ;
+            ds18B20->schedNext[g] = DS18B20_schedFirst(ds18B20, g);
+        }
+        if (ds18B20->schedState[g] == DS18B20_SCHED_READ) {
+            DS18B20_schedRead(ds18B20, g);
+            ds18B20->schedStats.busyPolls++;
+            return 1;
+        }
+    }
+
+    ds18B20->schedStats.idlePolls++;
+    return 0;
+}
+
+void DS18B20_getStats(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_SensorStats_t *stats, uint8_t reset)
+{
+    DS18B20_SensorStats_t zero = {0};
+    if (sensor >= ds18B20->sensors_found) {
+        *stats = zero;
+        return;
+    }
+
+    //The asynchronous reads count from the interrupt
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *stats = ds18B20->pool.stats[sensor];
+    if (reset) ds18B20->pool.stats[sensor] = zero;
+    __set_PRIMASK(primask);
+}
+
+void DS18B20_getSchedulerStats(Ds18B20_t *ds18B20, DS18B20_SchedulerStats_t *stats)
+{
+    *stats = ds18B20->schedStats;
+    stats->ms = HAL_GetTick() - ds18B20->schedStarted;
+    stats->rate = stats->ms ? (uint32_t)((uint64_t)stats->samples * 1000000 / stats->ms) : 0;
+}
+
+static void DS18B20_asyncDone(OW_Transaction_t *tr)
+{
+    Ds18B20_t *ds18B20 = (Ds18B20_t*)tr->ctx;
+    uint8_t sensor = ds18B20->trSensor;
+    int16_t result = DS18B20_TEMP_NOT_READ;
+
+    if (tr->state == OW_TR_DONE) {
+        if (tr->rxLen) {
+            result = DS18B20_decode(ds18B20, sensor, ds18B20->trData, tr->crc);
+            if (result > DS18B20_TEMP_NOT_READ) DS18B20_stats(ds18B20, sensor)->reads++;
+        } else {
+            DS18B20_converted(ds18B20, sensor, HAL_GetTick());
+            result = 0;
+        }
+    } else if (tr->rxLen) {
+        DS18B20_stats(ds18B20, sensor)->failures++;
+    }
+    if (tr->rxLen) DS18B20_publish(ds18B20, sensor, result);
+    ds18B20->trResult = result;
+    if (ds18B20->trDone) ds18B20->trDone(ds18B20, sensor, result);
+}
+
+/**
+ * Queues the transaction of ds18B20: reset, select the sensor, send the command
+ * and receive rxLen bytes
+ */
+static uint8_t DS18B20_async(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t cmd, uint8_t rxLen, DS18B20_Callback_t done)
+{
+    if (sensor>=ds18B20->sensors_found && (sensor!=DS18B20_MEASUREALL || !ds18B20->sensors_found)) return 0;
+    if (DS18B20_isAsyncBusy(ds18B20) || DS18B20_isPowerBusy(ds18B20) || ds18B20->staggering) return 0;
+    if (cmd == DS18B20_COVERTTEMP && sensor == DS18B20_MEASUREALL && !DS18B20_canConvertAll(ds18B20)) return 0;
+
+    OW_Transaction_t *tr = &ds18B20->tr;
+    ds18B20->convPoll = 0;
+    ds18B20->trData[0] = cmd;
+    ds18B20->trSensor = sensor;
+    ds18B20->trDone = done;
+    ds18B20->trResult = DS18B20_TEMP_NOT_READ;
+
+    if (sensor == DS18B20_MEASUREALL) {
+        tr->flags = OW_TR_RESET | OW_TR_SKIPROM;
+        tr->rom = NULL;
+    } else {
+        tr->flags = OW_TR_RESET | OW_TR_MATCHROM;
+        DS18B20_getROM(ds18B20, sensor, ds18B20->trRom);
+        tr->rom = ds18B20->trRom;
+    }
+    //The command goes out before the reply comes into the same buffer
+    tr->tx = ds18B20->trData;
+    tr->txLen = 1;
+    tr->rx = ds18B20->trData;
+    tr->rxLen = rxLen;
+    tr->done = DS18B20_asyncDone;
+    tr->ctx = ds18B20;
+
+    OW_asyncQueue(&ds18B20->ow, tr);
+    return 1;
+}
+
+uint8_t DS18B20_startMeasureAsync(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_Callback_t done)
+{
+    return DS18B20_async(ds18B20, sensor, DS18B20_COVERTTEMP, 0, done);
+}
+
+uint8_t DS18B20_getTempRawAsync(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_Callback_t done)
+{
+    return DS18B20_async(ds18B20, sensor, OW_CMD_RSCRATCHPAD, 9, done);
+}
+
+uint8_t DS18B20_isAsyncBusy(Ds18B20_t *ds18B20)
+{
+    uint8_t state = ds18B20->tr.state;
+    return state == OW_TR_QUEUED || state == OW_TR_BUSY;
+}
+
+int16_t DS18B20_getAsyncResult(Ds18B20_t *ds18B20)
+{
+    return ds18B20->trResult;
+}
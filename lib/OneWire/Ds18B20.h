@@ -43,12 +43,29 @@ extern "C" {
 #include "OneWire.h"
 
 /**
- * Maxumum devices that could be used. Define more before including this file
+ * Maxumum devices that could be used with @ref DS18B20_init. Define more before including this file
+ * or give a pool of any size to @ref DS18B20_initWithPool.
+ * Every @ref Ds18B20_t has these arrays, 29 bytes per sensor, even when its sensors are in a pool.
+ * Define it as 0 if all the buses are initialized with a pool, then @ref DS18B20_init finds nothing.
  */
 #ifndef MAX_DS18B20_SENSORS
 #define MAX_DS18B20_SENSORS 3
 #endif
 
+///Bytes of ROM kept per sensor: family and serial, the CRC is calculated when needed
+#define DS18B20_ROM_PACKED 7
+
+///Bytes of the configuration kept per sensor: TH, TL and the configuration register
+#define DS18B20_CFG_BYTES 3
+
+/* Flags of a sensor in the pool */
+#define DS18B20_FLAG_PARASITE 0x01 /*!< Powered from the data line, found by Read Power Supply */
+#define DS18B20_FLAG_QUARANTINE 0x02 /*!< Failed too often, only probed now and then, see @ref DS18B20_setRetry */
+#define DS18B20_FLAG_READ       0x04 /*!< Has a temperature for @ref DS18B20_getLatest */
+
+///Family code of DS18B20, the other devices on the bus are not searched
+#define DS18B20_FAMILY 0x28
+
 ///Use this to select all devices on the bus
 #define DS18B20_MEASUREALL 0xff
 
@@ -58,6 +75,8 @@ extern "C" {
 #define DS18B20_TEMP_NOT_READ -1000
 #define DS18B20_TEMP_ERROR -1500
 #define DS18B20_TEMP_CRC_ERROR -1550
+#define DS18B20_TEMP_QUARANTINE -1600 //the sensor is skipped, see @ref DS18B20_setRetry
+#define DS18B20_TEMP_BUSY -1650       //another task has the bus, see @ref DS18B20_tryGetTempRaw
 
 /**
  *  The precision of the sensor and therefor the time for converting the temperature
@@ -66,8 +85,29 @@ extern "C" {
 #define DS18B20_11BITS 0b01011111 //375ms
 #define DS18B20_10BITS 0b00111111 //187.5ms
 #define DS18B20_9BITS  0b00011111 //93.75ms
+///Give it to @ref DS18B20_init to keep the configuration the sensors have (from their EEPROM)
+#define DS18B20_KEEP_CONFIG 0
+
+/**
+ * Alarm thresholds which never trigger, set by @ref DS18B20_init
+ */
+#define DS18B20_ALARM_HIGH_OFF 127
+#define DS18B20_ALARM_LOW_OFF  -128
 
 
+/**
+ * How @ref DS18B20_getTempRaw reads the scratchpad, see @ref DS18B20_setReadMode
+ */
+#define DS18B20_READ_FULL      0 //All 9 bytes with CRC check (72 read slots)
+#define DS18B20_READ_TEMP_ONLY 1 //2 bytes of the temperature and reset (16 read slots), no CRC
+#define DS18B20_READ_HYBRID    2 //2 bytes, full read every N samples or if the value looks wrong
+
+/**
+ * How @ref DS18B20_isTempReady knows the conversion is done, see @ref DS18B20_setReadyMode
+ */
+#define DS18B20_READY_TIMER 0 //the worst case time of the precision of the sensor
+#define DS18B20_READY_POLL  1 //the read slot after Convert T, the timer is kept too
+
 /* OneWire commands */
 #define DS18B20_CMD_READSCRATCHPAD		0xBE
 #define DS18B20_CMD_WRITESCRATCHPAD		0x4E
@@ -75,33 +115,265 @@ extern "C" {
 #define DS18B20_CMD_RECEEPROM			0xB8
 #define DS18B20_CMD_RPWRSUPPLY			0xB4
 #define DS18B20_CMD_SEARCHROM			0xF0
+#define DS18B20_CMD_ALARMSEARCH			0xEC
 #define DS18B20_CMD_READROM				0x33
 #define DS18B20_CMD_MATCHROM			0x55
 #define DS18B20_CMD_SKIPROM				0xCC
 
 #define DS18B20_COVERTTEMP 0x44
 
+/**
+ * Maximum groups of @ref DS18B20_schedulerStart. Define more before including this file
+ */
+#ifndef DS18B20_SCHED_MAX_GROUPS
+#define DS18B20_SCHED_MAX_GROUPS 4
+#endif
+
+/* State of a group of the scheduler */
+#define DS18B20_SCHED_IDLE    0 /*!< Waits for the conversion */
+#define DS18B20_SCHED_CONVERT 1 /*!< Convert T is being sent to the sensors */
+#define DS18B20_SCHED_WAIT    2 /*!< Sensors are converting */
+#define DS18B20_SCHED_READ    3 /*!< Sensors are being read */
+
+/* Status of @ref DS18B20_Reading_t */
+#define DS18B20_READING_OK       0 /*!< raw is the temperature */
+#define DS18B20_READING_NOT_READ 1 /*!< The sensor didn't answer or the UART failed */
+#define DS18B20_READING_BROKEN   2 /*!< Bad CRC or a value out of the range */
+
+struct Ds18B20;
+
+/**
+ * @brief  A completed read of a sensor, see @ref DS18B20_setRing
+ */
+typedef struct {
+    int16_t raw;                                //as DS18B20_getTempRaw returned it
+    uint8_t sensor;
+    uint8_t status;                             //DS18B20_READING_...
+    uint32_t tick;                              //HAL_GetTick when the read was done
+} DS18B20_Reading_t;
+
+/**
+ * @brief  Single-producer single-consumer ring of readings. The driver of one bus is
+ * the producer, from the interrupt for the asynchronous reads. One task drains it.
+ * When it is full the new readings are dropped and counted, the producer never
+ * moves the tail. Define it with @ref DS18B20_RING_DEFINE.
+ */
+typedef struct {
+    DS18B20_Reading_t *buf;
+    uint16_t size;                              //holds size - 1 readings
+    volatile uint16_t head;                     //written by the producer only
+    volatile uint16_t tail;                     //written by the consumer only
+    volatile uint32_t dropped;                  //readings lost because the ring was full
+} DS18B20_Ring_t;
+
+/**
+ * Defines the buffer for size - 1 readings and the ring name using it
+\code
+DS18B20_RING_DEFINE(bus1Ring, 64);
+DS18B20_setRing(&bus1, &bus1Ring);
+\endcode
+ */
+#define DS18B20_RING_DEFINE(name, size) \
+    static DS18B20_Reading_t name##Buf[size]; \
+    static DS18B20_Ring_t name = { name##Buf, size, 0, 0, 0 }
+
+/**
+ * Called from the interrupt when an asynchronous operation is done.
+ * @param sensor: the sensor passed to the operation
+ * @param result: the temperature for @ref DS18B20_getTempRawAsync, 0 for
+ * @ref DS18B20_startMeasureAsync or DS18B20_TEMP_NOT_READ if it failed
+ */
+typedef void (*DS18B20_Callback_t)(struct Ds18B20 *ds18B20, uint8_t sensor, int16_t result);
+
+/**
+ * Switches the strong pull-up of the bus (a MOSFET from the data line to the supply),
+ * see @ref DS18B20_setStrongPullup. It must be on within 10 us after the call returns.
+ * @param on: 1 - the line is connected to the supply, 0 - released to the resistor
+ */
+typedef void (*DS18B20_Pullup_t)(struct Ds18B20 *ds18B20, uint8_t on);
+
+/**
+ * @brief  Health of a sensor since the initialization, see @ref DS18B20_getStats.
+ * The counters wrap around, read them with reset often enough.
+ */
+typedef struct {
+    uint16_t reads;                             //temperatures read
+    uint16_t crcErrors;                         //scratchpads with bad CRC, counted for the bus too
+    uint16_t failures;                          //no presence, UART error or a value out of range
+} DS18B20_SensorStats_t;
+
+/**
+ * @brief  Storage of the sensors, every member is an array of size elements.
+ * RAM per sensor: 7 (ROM) + 2 (correction) + 2 + 1 (read mode) + 3 (configuration) + 1 (flags)
+ * + 6 (statistics) + 1 (failures) + 6 (the latest temperature) = 29 bytes, so 200 sensors take 5800 bytes.
+ * Define it with @ref DS18B20_POOL_DEFINE. The built-in pool of @ref Ds18B20_t for MAX_DS18B20_SENSORS
+ * takes its RAM in every bus, used or not: 0 drops it.
+ */
+typedef struct {
+    uint8_t size;                               //up to 254 sensors, 0xFF is DS18B20_MEASUREALL
+    uint8_t (*roms)[DS18B20_ROM_PACKED];
+    int16_t *correction;
+    int16_t *lastRaw;                           //hybrid: last value read
+    uint8_t *sinceFull;                         //hybrid: samples since the last full read, 0 - never read
+    uint8_t (*cfg)[DS18B20_CFG_BYTES];          //TH, TL and configuration as the sensor has them, all 0 - unknown
+    uint8_t *flags;                             //DS18B20_FLAG_...
+    DS18B20_SensorStats_t *stats;
+    uint8_t *fails;                             //failed reads in a row, in quarantine: reads till the probe
+    int16_t *latest;                            //the last temperature read, see DS18B20_FLAG_READ
+    uint32_t *latestTick;                       //when it was read
+} DS18B20_Pool_t;
+
+/**
+ * Defines static arrays for count sensors and the pool name pointing to them
+\code
+DS18B20_POOL_DEFINE(bus1Pool, 60);
+DS18B20_initWithPool(&bus1, &huart2, DS18B20_12BITS, &bus1Pool);
+\endcode
+ */
+#define DS18B20_POOL_DEFINE(name, count) \
+    static uint8_t name##Roms[count][DS18B20_ROM_PACKED]; \
+    static int16_t name##Correction[count]; \
+    static int16_t name##LastRaw[count]; \
+    static uint8_t name##SinceFull[count]; \
+    static uint8_t name##Cfg[count][DS18B20_CFG_BYTES]; \
+    static uint8_t name##Flags[count]; \
+    static DS18B20_SensorStats_t name##Stats[count]; \
+    static uint8_t name##Fails[count]; \
+    static int16_t name##Latest[count]; \
+    static uint32_t name##LatestTick[count]; \
+    static DS18B20_Pool_t name = { count, name##Roms, name##Correction, name##LastRaw, name##SinceFull, name##Cfg, \
+                                   name##Flags, name##Stats, name##Fails, name##Latest, name##LatestTick }
+
+///First byte of the ROM table in the store, erased flash (0xFF) is not a table
+#define DS18B20_STORE_MAGIC 0xD5
+
+/**
+ * @brief  Persistent store of the ROM table, see @ref DS18B20_initWithStore.
+ * The table is: DS18B20_STORE_MAGIC, amount of sensors, their ROMs (DS18B20_ROM_PACKED bytes each),
+ * CRC8 of all that and 0xFF to make the size even. Its size is 3 + 7 * sensors (+1).
+ * Ds18B20Store.h has the store in the flash of STM32F1.
+ */
+typedef struct {
+    /// Read len bytes of the table from offset, returns 0 if they are not there
+    uint8_t (*read)(void *ctx, uint16_t offset, uint8_t *data, uint16_t len);
+    /// Write the table from the start to the end, offset grows with every call. Returns 0 if it failed
+    uint8_t (*write)(void *ctx, uint16_t offset, const uint8_t *data, uint16_t len);
+    void *ctx;
+} DS18B20_Store_t;
+
+/**
+ * @brief  Throughput of the scheduler since @ref DS18B20_schedulerStart
+ */
+typedef struct {
+    uint32_t samples;          /*!< Temperatures read */
+    uint32_t failures;         /*!< Reads which gave no temperature (DS18B20_TEMP_NOT_READ or below) */
+    uint32_t ms;               /*!< Time of the work */
+    uint32_t rate;             /*!< Samples per 1000 s */
+    uint32_t busyPolls;        /*!< Calls of @ref DS18B20_schedulerPoll which used the bus */
+    uint32_t idlePolls;        /*!< Calls which had nothing to do */
+} DS18B20_SchedulerStats_t;
+
 /**
  * @brief  Ds18B20 working struct
  * @note   It is fully private and should not be touched by user
  */
-typedef struct {
+typedef struct Ds18B20 {
     uint8_t sensors_found;
-    int16_t correction[MAX_DS18B20_SENSORS];
-    uint32_t lastTimeMeasured[MAX_DS18B20_SENSORS];
-    uint8_t ROMS[MAX_DS18B20_SENSORS][8];
-    uint16_t timeNeeded;
+    DS18B20_Pool_t pool;                        //where the sensors are kept
+    uint32_t lastTimeMeasured;                  //the last conversion started, on any sensor
+    uint8_t readyMode;                          //DS18B20_READY_TIMER or DS18B20_READY_POLL
+    uint8_t pollInterval;                       //poll: ms between the read slots
+    uint8_t convPoll;                           //poll: nothing was sent after Convert T
+    uint8_t convDone;                           //poll: the sensors said they are done
+    uint8_t convSensor;                         //poll: the sensor of the last Convert T, or DS18B20_MEASUREALL
+    uint32_t lastPoll;
+    uint16_t timeNeeded;                        //the longest conversion of the sensors
+    uint8_t parasites;                          //sensors powered from the data line
+    DS18B20_Pullup_t pullup;                    //strong pull-up of the bus, NULL - there is none
+    uint8_t powerBusy;                          //parasite sensors convert, the bus must be quiet
+    uint32_t powerStart;
+    uint16_t powerTime;
+    uint8_t staggering;                         //MEASUREALL: the parasite sensors are started one by one
+    uint8_t staggerNext;                        //staggering: the first sensor not started yet
+    uint8_t readMode;                           //DS18B20_READ_FULL ... DS18B20_READ_HYBRID
+    uint8_t fullReadEvery;                      //hybrid: full read every N samples
+    int16_t maxStep;                            //hybrid: the biggest plausible change between samples
+    uint8_t retries;                            //reads again when the data is broken
+    uint8_t backoffMs;                          //wait before the first retry, doubled for the next
+    uint8_t quarantineAfter;                    //failed reads in a row to quarantine a sensor, 0 - never
+    uint8_t probeEvery;                         //reads of a quarantined sensor per probe
+    DS18B20_Ring_t *ring;                       //where the readings are published, NULL - nowhere
     OneWire_t ow;
+    OW_Transaction_t tr;            //asynchronous operation
+    uint8_t trData[9];
+    uint8_t trRom[8];
+    uint8_t trSensor;
+    DS18B20_Callback_t trDone;
+    volatile int16_t trResult;
+    void *ctx;                      //for the user of the callbacks, see Ds18B20Group.h
+    uint8_t schedGroups;            //scheduler, 0 - stopped
+    uint8_t schedState[DS18B20_SCHED_MAX_GROUPS];
+    uint8_t schedNext[DS18B20_SCHED_MAX_GROUPS];                //next sensor to convert or read
+    uint32_t schedMeasured[DS18B20_SCHED_MAX_GROUPS];           //the last conversion of the group started
+    uint16_t schedTime[DS18B20_SCHED_MAX_GROUPS];               //the longest conversion of the group
+    DS18B20_Callback_t schedDone;
+    uint32_t schedStarted;
+    DS18B20_SchedulerStats_t schedStats;
+#if MAX_DS18B20_SENSORS > 0
+    //The pool of DS18B20_init
+    uint8_t roms[MAX_DS18B20_SENSORS][DS18B20_ROM_PACKED];
+    int16_t correction[MAX_DS18B20_SENSORS];
+    int16_t lastRaw[MAX_DS18B20_SENSORS];
+    uint8_t sinceFull[MAX_DS18B20_SENSORS];
+    uint8_t cfg[MAX_DS18B20_SENSORS][DS18B20_CFG_BYTES];
+    uint8_t flags[MAX_DS18B20_SENSORS];
+    DS18B20_SensorStats_t stats[MAX_DS18B20_SENSORS];
+    uint8_t fails[MAX_DS18B20_SENSORS];
+    int16_t latest[MAX_DS18B20_SENSORS];
+    uint32_t latestTick[MAX_DS18B20_SENSORS];
+#endif
 } Ds18B20_t;
 
 /**
- * @brief Initialization of the library
+ * @brief Initialization of the library. The configuration of every sensor found is read
+ * and kept, it is written only to the sensors where it differs.
  * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
- * @param *huart: Handle to UART
- * @param precision: select one from defined precision. It will be set all the same for all found sensors
+ * @param *huart: Handle to UART, NULL - the transport of @ref DS18B20_setTransport
+ * @param precision: select one from defined precision. It will be set all the same for all found sensors.
+ * The alarms are switched off (DS18B20_ALARM_HIGH_OFF, DS18B20_ALARM_LOW_OFF).
+ * DS18B20_KEEP_CONFIG - keep the precision and the alarms of every sensor.
  */
 void DS18B20_init(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision);
 
+/**
+ * @brief Initialization with the sensors kept in the pool given by the caller instead of
+ * the arrays of MAX_DS18B20_SENSORS in @ref Ds18B20_t. Every bus could have a pool of its size.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *huart: Handle to UART
+ * @param precision: see @ref DS18B20_init
+ * @param *pool: the pool, see @ref DS18B20_POOL_DEFINE. It must stay in memory, the arrays are cleared.
+ * The arrays of MAX_DS18B20_SENSORS stay in @ref Ds18B20_t unused, see MAX_DS18B20_SENSORS
+ */
+void DS18B20_initWithPool(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision, const DS18B20_Pool_t *pool);
+
+/**
+ * @brief Initialization with the sensors known from the last start. The ROM table is loaded
+ * from the store and every sensor is checked by its scratchpad read (Match ROM), which is
+ * needed for the configuration anyway. The search runs only if the table is not valid or
+ * some sensor didn't answer. The sensors found by the search which are not in the table
+ * are added at the end and the table is saved, so the index of a sensor is kept over
+ * the restarts. A sensor which is not found keeps its index, its reads fail.
+ * Erase the store to number the sensors again.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *huart: Handle to UART
+ * @param precision: see @ref DS18B20_init
+ * @param *pool: the pool, NULL - the arrays of MAX_DS18B20_SENSORS in @ref Ds18B20_t
+ * @param *store: where the ROM table is kept, NULL - search every time
+ * @retval 1 - the sensors were known, 0 - the search was run
+ */
+uint8_t DS18B20_initWithStore(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precision,
+                              const DS18B20_Pool_t *pool, const DS18B20_Store_t *store);
+
 /**
  * @brief Returns the amount of found sensors in @ref DS18B20_init
  * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
@@ -109,9 +381,66 @@ void DS18B20_init(Ds18B20_t *ds18B20, UART_HandleTypeDef *huart, uint8_t precisi
  */
 uint8_t DS18B20_getSensorsAvailable(Ds18B20_t *ds18B20);
 
+/**
+ * @brief Returns the full ROM of the sensor
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @param *rom: 8 bytes to fill
+ * @retval 1 - done, 0 - no such sensor
+ */
+uint8_t DS18B20_getROM(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t *rom);
+
+/**
+ * @brief Tells if the sensor is powered from the data line, it is found by @ref DS18B20_init
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @retval 1 - parasite power, 0 - external power or no such sensor
+ */
+uint8_t DS18B20_isParasite(Ds18B20_t *ds18B20, uint8_t sensor);
+
+/**
+ * @brief Gives the function switching the strong pull-up of the bus. Call it after the init.
+ * A parasite powered sensor takes its power from the line while it converts, nothing
+ * may be sent on the bus meanwhile. The pull-up resistor could power only one conversion,
+ * with the strong pull-up all the sensors convert at once.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param pullup: the function, NULL - there is no strong pull-up
+ */
+void DS18B20_setStrongPullup(Ds18B20_t *ds18B20, DS18B20_Pullup_t pullup);
+
+/**
+ * @brief Gives the lock of the bus for several tasks of an RTOS, see @ref OW_setLock.
+ * Every blocking function takes it for its transaction: one conversion, one read with its
+ * retries, one configuration change, the whole search. The asynchronous functions don't,
+ * their transactions run from the interrupts: the task which starts them keeps the bus
+ * with OW_lock(&ds18B20->ow) until they are done.
+ * The lock is kept by the init, set it before to lock the search.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param lock, unlock: the hooks, NULL - one task uses the bus
+ * @param *ctx: the mutex
+ */
+void DS18B20_setLock(Ds18B20_t *ds18B20, OW_Lock_t lock, OW_Unlock_t unlock, void *ctx);
+
+/**
+ * @brief Puts the bus on another slot engine than the UART, see @ref OW_setTransport.
+ * Call it before the init and give the init NULL for huart, it keeps the transport then.
+ * The asynchronous functions (DS18B20_getTempRawAsync, the groups) run from the UART
+ * interrupts, they fail on such a bus.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *transport: the functions of the engine, e.g. OW_gpioTransport of OneWireGpio.h
+ * @param *ctx: data of the engine
+ */
+void DS18B20_setTransport(Ds18B20_t *ds18B20, const OW_Transport_t *transport, void *ctx);
+
 /**
  * Use this function to start convertion. The temperature will be avalable after the
  * time needed for the covertion. It depends on the precition set in @ref DS18B20_init
+ * While parasite powered sensors convert, the next operation on the bus waits for them.
+ * With more than one parasite sensor and no strong pull-up DS18B20_MEASUREALL starts the
+ * external powered sensors and the first parasite one and returns. @ref DS18B20_isTempReady
+ * starts the next parasite sensor when the one before is done and says ready after the last.
+ * A read before that (@ref DS18B20_getTempRaw, @ref DS18B20_getAlarmed) starts the rest
+ * itself and waits for every one but the last, N parasite sensors take N conversion times.
  * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
  * @param sensor: index of the sensor, if specified DS18B20_MEASUREALL the
  * convertion will be started on all connected sensors.
@@ -120,8 +449,12 @@ void DS18B20_startMeasure(Ds18B20_t *ds18B20, uint8_t sensor);
 
 /**
  * Check whether the tempereture could be read from the sensor.
+ * There is one time for all the sensors, the time of the last conversion started on any of them,
+ * so after measuring one sensor the others are ready when it is ready.
+ * The time needed follows the precision of the sensor, for DS18B20_MEASUREALL it's the longest one.
+ * With DS18B20_READY_POLL it may send a read slot, see @ref DS18B20_setReadyMode.
  * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
- * @param sensor: index of the sensor. It specified DS18B20_MEASUREALL, the time will be checked on first sensor.
+ * @param sensor: index of the sensor or DS18B20_MEASUREALL.
  * @retval 1 - temperature could be read, 0 - not ready, keep waiting
  */
 uint8_t DS18B20_isTempReady(Ds18B20_t *ds18B20, uint8_t sensor);
@@ -134,6 +467,77 @@ uint8_t DS18B20_isTempReady(Ds18B20_t *ds18B20, uint8_t sensor);
  */
 int16_t DS18B20_getTempRaw(Ds18B20_t *ds18B20, uint8_t sensor);
 
+/**
+ * Same as @ref DS18B20_getTempRaw, but it never waits for the bus. A task which can't wait
+ * behind the search or a sweep of another one gets the temperature if the bus is free.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @retval the temperature, DS18B20_TEMP_BUSY - another task has the bus or the parasite sensors
+ * of DS18B20_MEASUREALL are not all started yet (see @ref DS18B20_startMeasure), nothing was read
+ */
+int16_t DS18B20_tryGetTempRaw(Ds18B20_t *ds18B20, uint8_t sensor);
+
+/**
+ * Select how @ref DS18B20_isTempReady knows the conversion is done.
+ * DS18B20_READY_TIMER - after the worst case time of the precision, this is the default.
+ * DS18B20_READY_POLL - the sensors with external power hold read slots low while converting,
+ *   so one read slot after Convert T tells whether all of them are done. The slot is sent
+ *   no more often than pollInterval and only if nothing else was sent to the bus after
+ *   @ref DS18B20_startMeasure. It tells about the sensor of the last start only (all of them
+ *   after DS18B20_MEASUREALL), the others wait for the timer. The timer still says ready
+ *   after the worst case time.
+ *   Don't use it with parasite powered sensors: they can't hold the bus, the slot says done at once.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param mode: DS18B20_READY_TIMER or DS18B20_READY_POLL
+ * @param pollInterval: ms between the read slots, 0 - at every call
+ */
+void DS18B20_setReadyMode(Ds18B20_t *ds18B20, uint8_t mode, uint8_t pollInterval);
+
+/**
+ * Select how much of the scratchpad @ref DS18B20_getTempRaw reads. The sensor allows
+ * to stop reading at any point with a reset, so the temperature only read takes
+ * 2 bytes instead of 9.
+ * DS18B20_READ_FULL - 9 bytes with CRC, this is the default.
+ * DS18B20_READ_TEMP_ONLY - 2 bytes, there is no CRC to check so the errors of the
+ *   bus are not detected (only values out of -55...125 are rejected). 0xFFFF is also what
+ *   a missing sensor gives: then the read goes on to the configuration register (5 bytes)
+ *   and its fixed bits tell -0.0625 degrees from no answer.
+ * DS18B20_READ_HYBRID - 2 bytes, but all 9 with CRC on the first read of the sensor,
+ *   every fullReadEvery samples and when the value is out of the range, is the power-up
+ *   85 degrees or differs from the previous one by more than maxStep.
+ * The asynchronous read is always full.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure 
+ * @param mode: DS18B20_READ_FULL, DS18B20_READ_TEMP_ONLY or DS18B20_READ_HYBRID
+ * @param fullReadEvery: hybrid: every which sample is read in full, 0 is the same as 1
+ * @param maxStep: hybrid: the biggest plausible change in steps of 0.0625 degrees
+ */
+void DS18B20_setReadMode(Ds18B20_t *ds18B20, uint8_t mode, uint8_t fullReadEvery, int16_t maxStep);
+
+/**
+ * Set what @ref DS18B20_getTempRaw does when a read fails. By default it just returns the error.
+ * Broken data (CRC error, value out of the range) is read again at once: a spike of noise
+ * passes, a sensor which doesn't answer will not answer the retry, so it is not retried.
+ * A sensor which fails quarantineAfter reads in a row goes to quarantine: the reads return
+ * DS18B20_TEMP_QUARANTINE without touching the bus, only every probeEvery read the sensor
+ * is probed with 5 bytes of its scratchpad. When the probe passes the sensor rejoins,
+ * gets back its configuration if it was power cycled and is read as usual.
+ * The scheduler reads by @ref DS18B20_getTempRaw and follows it, the asynchronous reads don't.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param retries: reads more after broken data, 0 - none
+ * @param backoffMs: wait before the first retry, doubled for every next one. 0 - no wait
+ * @param quarantineAfter: failed reads in a row to quarantine the sensor, 0 - never
+ * @param probeEvery: every which read probes a quarantined sensor, 0 is the same as 1
+ */
+void DS18B20_setRetry(Ds18B20_t *ds18B20, uint8_t retries, uint8_t backoffMs, uint8_t quarantineAfter, uint8_t probeEvery);
+
+/**
+ * Check if the sensor is in quarantine, see @ref DS18B20_setRetry
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @retval 1 - in quarantine
+ */
+uint8_t DS18B20_isQuarantined(Ds18B20_t *ds18B20, uint8_t sensor);
+
 /**
  * Set the correction of the sensor in raw value. The temperature returned by @ref DS18B20_getTempRaw will be corrected by this value
  * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure 
@@ -142,9 +546,232 @@ int16_t DS18B20_getTempRaw(Ds18B20_t *ds18B20, uint8_t sensor);
  */
 void DS18B20_setCorrection(Ds18B20_t *ds18B20, uint8_t sensor, int16_t cor);
 
-///Convertion of the raw value to degrees centigare
+/**
+ * Set the alarm thresholds of the sensor. After a conversion the sensor is in alarm
+ * if its temperature in whole degrees is >= high or <= low.
+ * Only the sensors with other thresholds are written, then they are read back.
+ * The thresholds are written to the scratchpad only, the sensor loses them at power off,
+ * see @ref DS18B20_saveConfig.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor or DS18B20_MEASUREALL for all of them
+ * @param high: TH in degrees centigrade, DS18B20_ALARM_HIGH_OFF - never
+ * @param low: TL in degrees centigrade, DS18B20_ALARM_LOW_OFF - never
+ * @retval 1 - the sensors have the thresholds, 0 - some write failed
+ */
+uint8_t DS18B20_setAlarm(Ds18B20_t *ds18B20, uint8_t sensor, int8_t high, int8_t low);
+
+/**
+ * Set the precision of the sensor. Only the sensors with another precision are written,
+ * then they are read back. The conversion time of the sensor follows its precision.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor or DS18B20_MEASUREALL for all of them
+ * @param precision: DS18B20_9BITS ... DS18B20_12BITS
+ * @retval 1 - the sensors have the precision, 0 - some write failed
+ */
+uint8_t DS18B20_setResolution(Ds18B20_t *ds18B20, uint8_t sensor, uint8_t precision);
+
+/**
+ * Get the configuration of the sensor kept by the library
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @param *high, *low: the alarm thresholds
+ * @param *precision: DS18B20_9BITS ... DS18B20_12BITS
+ * @retval 1 - done, 0 - no such sensor or its configuration is unknown
+ */
+uint8_t DS18B20_getConfig(Ds18B20_t *ds18B20, uint8_t sensor, int8_t *high, int8_t *low, uint8_t *precision);
+
+/**
+ * Copy the thresholds and the precision of the sensor to its EEPROM (Copy Scratchpad),
+ * the sensor loads them at power on. It waits 10 ms for the EEPROM to be written.
+ * The EEPROM wears out, call it when the configuration is changed, not at every start.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor or DS18B20_MEASUREALL for all of them
+ * @retval 1 - done, 0 - no sensors answered
+ */
+uint8_t DS18B20_saveConfig(Ds18B20_t *ds18B20, uint8_t sensor);
+
+/**
+ * Find the sensors in alarm after the last conversion by the alarm search.
+ * Only the sensors in alarm take the bus time.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *sensors: array for the indexes of the sensors in alarm
+ * @param max: size of the array
+ * @retval amount of sensors in alarm
+ */
+uint8_t DS18B20_getAlarmed(Ds18B20_t *ds18B20, uint8_t *sensors, uint8_t max);
+
+/**
+ * Read only the sensors in alarm. The cycle is the same as for all of them:
+\code
+DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+//...
+if (DS18B20_isTempReady(&ds18b20, 0)) {
+    uint8_t n = DS18B20_readAlarmed(&ds18b20, sensors, temps, MAX_DS18B20_SENSORS);
+}
+\endcode
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *sensors: array for the indexes of the sensors in alarm
+ * @param *temps: array for their temperatures, see @ref DS18B20_getTempRaw
+ * @param max: size of the arrays
+ * @retval amount of sensors in alarm
+ */
+uint8_t DS18B20_readAlarmed(Ds18B20_t *ds18B20, uint8_t *sensors, int16_t *temps, uint8_t max);
+
+/**
+ * Asynchronous version of @ref DS18B20_startMeasure. The caller doesn't wait,
+ * the UART callbacks must be forwarded to the library, see @ref OW_rxCpltCallback
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor or DS18B20_MEASUREALL
+ * @param done: called when the command is sent, could be NULL
+ * @retval 1 - started, 0 - another asynchronous operation is running or wrong sensor,
+ * parasite sensors are converting or they can't convert at once (no strong pull-up)
+ */
+uint8_t DS18B20_startMeasureAsync(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_Callback_t done);
+
+/**
+ * Asynchronous version of @ref DS18B20_getTempRaw.
+ * The result is passed to done and could be taken by @ref DS18B20_getAsyncResult
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @param done: called when the temperature is read, could be NULL
+ * @retval 1 - started, 0 - another asynchronous operation is running or wrong sensor
+ */
+uint8_t DS18B20_getTempRawAsync(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_Callback_t done);
+
+/**
+ * Poll flag of the asynchronous operations
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @retval 1 - the operation is running, 0 - done
+ */
+uint8_t DS18B20_isAsyncBusy(Ds18B20_t *ds18B20);
+
+/**
+ * Result of the last asynchronous operation, see @ref DS18B20_Callback_t
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ */
+int16_t DS18B20_getAsyncResult(Ds18B20_t *ds18B20);
+
+/**
+ * Start the scheduler which reads all the sensors again and again keeping the bus busy.
+ * The sensors are split into groups, the groups are converted and read one after
+ * another so the conversion of one group goes while another one is being read.
+ * One group converts all the sensors with one command, more groups need Convert T
+ * per sensor but overlap the conversion time with the reads. The best amount depends
+ * on the number of sensors and the resolution, see @ref DS18B20_getSchedulerStats
+ * and tools/ow_bench.c.
+ * With parasite powered sensors the bus is quiet while they convert, so there is always
+ * one group. Without the strong pull-up they are converted one by one, the externally
+ * powered ones convert meanwhile.
+ * The functions of the library must not be called for the bus while the scheduler runs.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param groups: 1...DS18B20_SCHED_MAX_GROUPS, no more than the sensors
+ * @param done: called from @ref DS18B20_schedulerPoll for every sensor read
+ */
+void DS18B20_schedulerStart(Ds18B20_t *ds18B20, uint8_t groups, DS18B20_Callback_t done);
+
+/**
+ * Do the next step of the scheduler: one Convert T or one read. Call it from the loop
+ * as often as possible.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @retval 1 - the bus was used, 0 - waiting for the conversions or stopped
+ */
+uint8_t DS18B20_schedulerPoll(Ds18B20_t *ds18B20);
+
+/**
+ * Stop the scheduler
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ */
+void DS18B20_schedulerStop(Ds18B20_t *ds18B20);
+
+/**
+ * Get the throughput achieved by the scheduler
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *stats: the statistics to fill
+ */
+void DS18B20_getSchedulerStats(Ds18B20_t *ds18B20, DS18B20_SchedulerStats_t *stats);
+
+/**
+ * Publish every completed read (blocking, asynchronous and by the scheduler) to the ring.
+ * The reads skipped by the quarantine are not published.
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param *ring: the ring, see @ref DS18B20_RING_DEFINE. NULL - stop publishing
+ */
+void DS18B20_setRing(Ds18B20_t *ds18B20, DS18B20_Ring_t *ring);
+
+/**
+ * Copy out the readings published since the last drain, the oldest first
+ * @param *ring: the ring given to @ref DS18B20_setRing
+ * @param *readings: where to copy them
+ * @param max: the size of readings
+ * @retval the amount copied, the rest stays in the ring
+ */
+uint16_t DS18B20_ringDrain(DS18B20_Ring_t *ring, DS18B20_Reading_t *readings, uint16_t max);
+
+/**
+ * The readings waiting in the ring
+ * @param *ring: the ring given to @ref DS18B20_setRing
+ */
+uint16_t DS18B20_ringCount(DS18B20_Ring_t *ring);
+
+/**
+ * Get the last good temperature of the sensor without touching the bus
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @param *raw: the temperature
+ * @param *ageMs: ms since it was read, could be NULL
+ * @retval 0 - the sensor was never read successfully, raw and ageMs are not set
+ */
+uint8_t DS18B20_getLatest(Ds18B20_t *ds18B20, uint8_t sensor, int16_t *raw, uint32_t *ageMs);
+
+/**
+ * Get the counters of a sensor. The counters of the bus (resets, presence failures, UART
+ * timeouts and errors, slots, busy time) are given by OW_getStats(&ds18B20->ow, ...).
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor
+ * @param *stats: the counters to fill, zeros for a sensor which is not found
+ * @param reset: 1 to start counting from zero after the copy
+ */
+void DS18B20_getStats(Ds18B20_t *ds18B20, uint8_t sensor, DS18B20_SensorStats_t *stats, uint8_t reset);
+
+/**
+ * Set the correction of the sensor in thousandths of a degree, it is rounded to the step of 0.0625
+ * @param *ds18B20: Pointer to @ref Ds18B20_t working Ds18B20 structure
+ * @param sensor: index of the sensor to apply the correction
+ * @param milli: correction in 0.001 degrees centigrade
+ */
+void DS18B20_setCorrectionMilli(Ds18B20_t *ds18B20, uint8_t sensor, int32_t milli);
+
+///Size of the buffer enough for any value written by @ref DS18B20_formatDec, with the 0 at the end
+#define DS18B20_FORMAT_SIZE 13
+
+/**
+ * Write a fixed point number as decimal text, no printf needed
+ * @param *buf: at least @ref DS18B20_FORMAT_SIZE chars, 0 terminated
+ * @param value: the number multiplied by 10^decimals
+ * @param decimals: 0 to 9 digits after the point, 0 - no point
+ * @retval the amount of chars written without the 0
+ */
+uint8_t DS18B20_formatDec(char *buf, int32_t value, uint8_t decimals);
+
+/**
+ * Write the raw value of the temperature as degrees centigrade, e.g. -10.13 for 0xFF5E and 2 decimals
+ * @param *buf: at least @ref DS18B20_FORMAT_SIZE chars, 0 terminated
+ * @param raw: the temperature in steps of 0.0625
+ * @param decimals: 0 to 4 digits after the point, rounded half away from zero. 4 is exact
+ * @retval the amount of chars written without the 0
+ */
+uint8_t DS18B20_format(char *buf, int16_t raw, uint8_t decimals);
+
+///Convertion of the raw value to thousandths of degree centigrade, rounded half away from zero
+inline static int32_t DS18B20_toMilli(int16_t t){return ((int32_t)t * 125 + (t < 0 ? -1 : 1)) / 2;};
+///Convertion of the raw value to hundredths of degree centigrade, rounded half away from zero
+inline static int32_t DS18B20_toCenti(int16_t t){return ((int32_t)t * 25 + (t < 0 ? -2 : 2)) / 4;};
+///Convertion of thousandths of degree centigrade to the raw value, rounded to the nearest step
+inline static int16_t DS18B20_fromMilli(int32_t t){return (int16_t)((t * 2 + (t < 0 ? -62 : 62)) / 125);};
+
+///Convertion of the raw value to degrees centigare. Needs the soft-float library on Cortex-M3, see @ref DS18B20_toMilli
 inline static double DS18B20_convertToDouble(int16_t t){return (double)t * 0.0625;};
-///Convertion of degrees centigare to raw value
+///Convertion of degrees centigare to raw value. Needs the soft-float library on Cortex-M3, see @ref DS18B20_fromMilli
 inline static int16_t DS18B20_convertToInt(double t){return (int16_t)((t/0.0625)+0.5);};
 
 
@@ -0,0 +1,160 @@
+#include "Ds18B20Group.h"
+
+void DS18B20_groupInit(Ds18B20Group_t *group)
+{
+    uint8_t *p = (uint8_t*)group;
+    for(uint16_t i=0;i<sizeof(Ds18B20Group_t);i++) {
+        p[i] = 0;
+    }
+}
+
+uint8_t DS18B20_groupAdd(Ds18B20Group_t *group, Ds18B20_t *ds18B20, int16_t *temps)
+{
+    if (group->count >= DS18B20_GROUP_MAX_BUSES) return 0;
+
+    ds18B20->ctx = group;
+    group->buses[group->count] = ds18B20;
+    group->temps[group->count] = temps;
+    group->state[group->count] = DS18B20_GROUP_DONE;
+    group->count++;
+    return 1;
+}
+
+/**
+ * Index of the bus in the group
+ */
+static uint8_t DS18B20_groupBus(Ds18B20Group_t *group, Ds18B20_t *ds18B20)
+{
+    uint8_t b = 0;
+    while (b < group->count && group->buses[b] != ds18B20) b++;
+    return b;
+}
+
+/**
+ * Keeps the result of the sensor and reports it
+ */
+static void DS18B20_groupResult(Ds18B20Group_t *group, uint8_t b, uint8_t sensor, int16_t result)
+{
+    group->temps[b][sensor] = result;
+    if (group->done) group->done(group, b, sensor, result);
+}
+
+/**
+ * Nothing could be read from the bus
+ */
+static void DS18B20_groupFail(Ds18B20Group_t *group, uint8_t b)
+{
+    for (uint8_t s=0;s<group->buses[b]->sensors_found;s++) {
+        DS18B20_groupResult(group, b, s, DS18B20_TEMP_NOT_READ);
+    }
+    group->state[b] = DS18B20_GROUP_DONE;
+}
+
+static void DS18B20_groupDone(Ds18B20_t *ds18B20, uint8_t sensor, int16_t result);
+
+/**
+ * Starts the read of the sensor. Those which can't be started are not read
+ * and the next one is tried, the bus is done after the last one.
+ */
+static void DS18B20_groupRead(Ds18B20Group_t *group, uint8_t b, uint8_t sensor)
+{
+    Ds18B20_t *ds18B20 = group->buses[b];
+
+    for (;sensor<ds18B20->sensors_found;sensor++) {
+        if (DS18B20_getTempRawAsync(ds18B20, sensor, DS18B20_groupDone)) return;
+        DS18B20_groupResult(group, b, sensor, DS18B20_TEMP_NOT_READ);
+    }
+    group->state[b] = DS18B20_GROUP_DONE;
+}
+
+/**
+ * Called from the interrupt when an operation of a bus is done, starts the next one
+ */
+static void DS18B20_groupDone(Ds18B20_t *ds18B20, uint8_t sensor, int16_t result)
+{
+    Ds18B20Group_t *group = (Ds18B20Group_t*)ds18B20->ctx;
+    uint8_t b = DS18B20_groupBus(group, ds18B20);
+    if (b >= group->count) return;
+
+    if (group->state[b] == DS18B20_GROUP_CONVERT) {
+        if (result == DS18B20_TEMP_NOT_READ) {
+            DS18B20_groupFail(group, b);
+        } else {
+            group->state[b] = DS18B20_GROUP_WAIT;
+        }
+        return;
+    }
+
+    //A failed sensor doesn't stop the others
+    DS18B20_groupResult(group, b, sensor, result);
+    DS18B20_groupRead(group, b, sensor + 1);
+}
+
+uint8_t DS18B20_groupStart(Ds18B20Group_t *group, DS18B20_GroupCallback_t done)
+{
+    if (group->running) return 0;
+
+    group->done = done;
+    group->running = 1;
+    group->started = HAL_GetTick();
+
+    for (uint8_t b=0;b<group->count;b++) {
+        group->state[b] = DS18B20_GROUP_CONVERT;
+    }
+    for (uint8_t b=0;b<group->count;b++) {
+        Ds18B20_t *ds18B20 = group->buses[b];
+        if (ds18B20->sensors_found == 0) {
+            group->state[b] = DS18B20_GROUP_DONE;
+        } else if (!DS18B20_startMeasureAsync(ds18B20, DS18B20_MEASUREALL, DS18B20_groupDone)) {
+            DS18B20_groupFail(group, b);
+        }
+    }
+    return 1;
+}
+
+uint8_t DS18B20_groupPoll(Ds18B20Group_t *group)
+{
+    uint8_t busy = 0;
+
+    for (uint8_t b=0;b<group->count;b++) {
+        Ds18B20_t *ds18B20 = group->buses[b];
+        OW_asyncPoll(&ds18B20->ow);
+
+        if (group->state[b] == DS18B20_GROUP_WAIT && DS18B20_isTempReady(ds18B20, DS18B20_MEASUREALL)) {
+            group->state[b] = DS18B20_GROUP_READ;
+            DS18B20_groupRead(group, b, 0);
+        }
+        if (group->state[b] != DS18B20_GROUP_DONE) busy = 1;
+    }
+
+    if (!busy && group->running) {
+        group->running = 0;
+        group->cycleTime = HAL_GetTick() - group->started;
+    }
+    return busy;
+}
+
+void DS18B20_groupReadAll(Ds18B20Group_t *group)
+{
+    DS18B20_groupStart(group, group->done);
+    while (DS18B20_groupPoll(group));
+}
+
+uint32_t DS18B20_groupGetCycleTime(Ds18B20Group_t *group)
+{
+    return group->cycleTime;
+}
+
+void DS18B20_groupTxCpltCallback(Ds18B20Group_t *group, UART_HandleTypeDef *huart)
+{
+    for (uint8_t b=0;b<group->count;b++) {
+        OW_txCpltCallback(&group->buses[b]->ow, huart);
+    }
+}
+
+void DS18B20_groupRxCpltCallback(Ds18B20Group_t *group, UART_HandleTypeDef *huart)
+{
+    for (uint8_t b=0;b<group->count;b++) {
+        OW_rxCpltCallback(&group->buses[b]->ow, huart);
+    }
+}
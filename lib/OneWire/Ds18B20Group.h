@@ -0,0 +1,168 @@
+#ifndef DS18B20_GROUP_h
+#define DS18B20_GROUP_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : Ds18B20Group.h
+ * @brief          : DS18B20 sensors on several buses at once
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR 
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE 
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * Every Ds18B20_t has its own UART, but the blocking functions use one bus at
+ * a time. The group runs the asynchronous operations on all its buses at once:
+ * the conversion is started everywhere, then every bus reads its sensors one
+ * after another from the interrupts, independent of the others. The cycle takes
+ * about the time of the slowest bus instead of the sum of them.
+ *
+ * Usage:
+\code
+Ds18B20_t bus1, bus3;
+Ds18B20Group_t group;
+int16_t temps1[MAX_DS18B20_SENSORS], temps3[MAX_DS18B20_SENSORS];
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  DS18B20_groupTxCpltCallback(&group, huart);
+}
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+  DS18B20_groupRxCpltCallback(&group, huart);
+}
+
+DS18B20_init(&bus1, &huart1, DS18B20_12BITS);
+DS18B20_init(&bus3, &huart3, DS18B20_12BITS);
+DS18B20_groupInit(&group);
+DS18B20_groupAdd(&group, &bus1, temps1);
+DS18B20_groupAdd(&group, &bus3, temps3);
+
+DS18B20_groupStart(&group, NULL);
+//in the loop
+if (!DS18B20_groupPoll(&group)) {
+  //temps1 and temps3 are filled
+  DS18B20_groupStart(&group, NULL);
+}
+\endcode
+ */
+
+#include "Ds18B20.h"
+
+/**
+ * Maximum buses in a group. Define more before including this file
+ */
+#ifndef DS18B20_GROUP_MAX_BUSES
+#define DS18B20_GROUP_MAX_BUSES 3
+#endif
+
+/* State of a bus in the group */
+#define DS18B20_GROUP_DONE    0
+#define DS18B20_GROUP_CONVERT 1 /*!< Convert T is being sent */
+#define DS18B20_GROUP_WAIT    2 /*!< Sensors are converting */
+#define DS18B20_GROUP_READ    3 /*!< Sensors are being read */
+
+struct Ds18B20Group;
+
+/**
+ * Called from the interrupt for every sensor read
+ * @param bus: index of the bus in the group
+ * @param temp: see @ref DS18B20_getTempRaw
+ */
+typedef void (*DS18B20_GroupCallback_t)(struct Ds18B20Group *group, uint8_t bus, uint8_t sensor, int16_t temp);
+
+/**
+ * @brief  Group of buses
+ * @note   It is fully private and should not be touched by user
+ */
+typedef struct Ds18B20Group {
+    Ds18B20_t *buses[DS18B20_GROUP_MAX_BUSES];
+    int16_t *temps[DS18B20_GROUP_MAX_BUSES];
+    volatile uint8_t state[DS18B20_GROUP_MAX_BUSES];
+    uint8_t count;
+    uint8_t running;
+    DS18B20_GroupCallback_t done;
+    void *ctx;                      //for the user of the callback
+    uint32_t started;
+    uint32_t cycleTime;
+} Ds18B20Group_t;
+
+/**
+ * @brief Clears the group
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ */
+void DS18B20_groupInit(Ds18B20Group_t *group);
+
+/**
+ * @brief Adds the bus to the group. Call it after @ref DS18B20_init, the bus
+ * must not be used by anybody else while the group is running.
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ * @param *ds18B20: initialized bus
+ * @param *temps: array of DS18B20_getSensorsAvailable elements for the temperatures
+ * @retval 1 - added, 0 - the group is full
+ */
+uint8_t DS18B20_groupAdd(Ds18B20Group_t *group, Ds18B20_t *ds18B20, int16_t *temps);
+
+/**
+ * @brief Starts the conversion on all the buses, then they read all their sensors.
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ * @param done: called for every sensor, with DS18B20_TEMP_NOT_READ if it was not read. Could be NULL
+ * @retval 1 - started, 0 - the cycle is running
+ */
+uint8_t DS18B20_groupStart(Ds18B20Group_t *group, DS18B20_GroupCallback_t done);
+
+/**
+ * @brief Moves the cycle on: starts reading the buses which have finished the conversion
+ * and checks the timeouts. Call it from the main loop.
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ * @retval 1 - the cycle is running, 0 - all the sensors are read
+ */
+uint8_t DS18B20_groupPoll(Ds18B20Group_t *group);
+
+/**
+ * @brief One whole cycle: convert and read all sensors on all buses, blocks until done.
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ */
+void DS18B20_groupReadAll(Ds18B20Group_t *group);
+
+/**
+ * @brief Duration of the last cycle in ms, from the start to the last sensor read
+ * @param *group: Pointer to @ref Ds18B20Group_t
+ */
+uint32_t DS18B20_groupGetCycleTime(Ds18B20Group_t *group);
+
+/**
+ * @brief Call it from HAL_UART_TxCpltCallback
+ */
+void DS18B20_groupTxCpltCallback(Ds18B20Group_t *group, UART_HandleTypeDef *huart);
+
+/**
+ * @brief Call it from HAL_UART_RxCpltCallback
+ */
+void DS18B20_groupRxCpltCallback(Ds18B20Group_t *group, UART_HandleTypeDef *huart);
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of DS18B20_GROUP_h */
@@ -0,0 +1,64 @@
+#include "Ds18B20Store.h"
+
+#ifdef HAL_FLASH_MODULE_ENABLED
+
+static uint8_t DS18B20_flashRead(void *ctx, uint16_t offset, uint8_t *data, uint16_t len)
+{
+    DS18B20_FlashStore_t *flash = (DS18B20_FlashStore_t*)ctx;
+    if ((uint32_t)offset + len > (uint32_t)flash->pages * FLASH_PAGE_SIZE) return 0;
+
+    //The flash is read as memory
+    const uint8_t *p = (const uint8_t*)(flash->address + offset);
+    for (uint16_t i=0;i<len;i++) {
+        data[i] = p[i];
+    }
+    return 1;
+}
+
+static uint8_t DS18B20_flashWrite(void *ctx, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    DS18B20_FlashStore_t *flash = (DS18B20_FlashStore_t*)ctx;
+    if ((uint32_t)offset + len > (uint32_t)flash->pages * FLASH_PAGE_SIZE) return 0;
+
+    HAL_StatusTypeDef status = HAL_OK;
+    HAL_FLASH_Unlock();
+
+    //The table is written from the start, erase it first
+    if (offset == 0) {
+        FLASH_EraseInitTypeDef erase = { 0 };
+        uint32_t pageError;
+        erase.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase.PageAddress = flash->address;
+        erase.NbPages = flash->pages;
+        status = HAL_FLASHEx_Erase(&erase, &pageError);
+        flash->hasPending = 0;
+    }
+
+    //Only half-words could be written, an odd byte waits for the next one
+    for (uint16_t i=0;i<len && status == HAL_OK;i++) {
+        uint16_t pos = offset + i;
+        if (!flash->hasPending) {
+            flash->pending = data[i];
+            flash->hasPending = 1;
+        } else {
+            uint16_t halfWord = flash->pending | ((uint16_t)data[i] << 8);
+            status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, flash->address + pos - 1, halfWord);
+            flash->hasPending = 0;
+        }
+    }
+
+    HAL_FLASH_Lock();
+    return status == HAL_OK;
+}
+
+void DS18B20_flashStoreInit(DS18B20_Store_t *store, DS18B20_FlashStore_t *flash, uint32_t address, uint8_t pages)
+{
+    flash->address = address;
+    flash->pages = pages;
+    flash->hasPending = 0;
+    store->read = DS18B20_flashRead;
+    store->write = DS18B20_flashWrite;
+    store->ctx = flash;
+}
+
+#endif /* HAL_FLASH_MODULE_ENABLED */
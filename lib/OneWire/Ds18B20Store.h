@@ -0,0 +1,81 @@
+#ifndef DS18B20_STORE_h
+#define DS18B20_STORE_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : Ds18B20Store.h
+ * @brief          : ROM table of DS18B20_initWithStore in the flash of STM32F1
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR 
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE 
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * The table is kept in the last pages of the flash, keep them out of the
+ * program in the linker script. The pages are erased and written only when
+ * the search finds new sensors. Enable the HAL FLASH module in CubeMX.
+ *
+ * Usage:
+\code
+//The last 2 KB of STM32F103C8 (64 KB): 2 pages of 1 KB, enough for 254 sensors
+DS18B20_FlashStore_t flash;
+DS18B20_Store_t store;
+
+DS18B20_flashStoreInit(&store, &flash, 0x0800F800, 2);
+DS18B20_initWithStore(&ds18b20, &huart3, DS18B20_12BITS, NULL, &store);
+\endcode
+ */
+
+#include "Ds18B20.h"
+
+#ifdef HAL_FLASH_MODULE_ENABLED
+
+/**
+ * @brief  Flash area of the store
+ * @note   It is fully private and should not be touched by user
+ */
+typedef struct {
+    uint32_t address;          /*!< Start of the first page */
+    uint8_t pages;             /*!< Pages erased before the table is written */
+    uint8_t pending;           /*!< Low byte of the half-word not written yet */
+    uint8_t hasPending;
+} DS18B20_FlashStore_t;
+
+/**
+ * @brief Makes the store in the flash pages
+ * @param *store: the store to give to @ref DS18B20_initWithStore
+ * @param *flash: the flash area, it must stay in memory
+ * @param address: start of the page, FLASH_PAGE_SIZE aligned
+ * @param pages: amount of pages for the table
+ */
+void DS18B20_flashStoreInit(DS18B20_Store_t *store, DS18B20_FlashStore_t *flash, uint32_t address, uint8_t pages);
+
+#endif /* HAL_FLASH_MODULE_ENABLED */
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of DS18B20_STORE_h */
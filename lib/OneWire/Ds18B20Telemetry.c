@@ -0,0 +1,163 @@
+#include "Ds18B20Telemetry.h"
+
+static void DS18B20_put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static uint16_t DS18B20_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+void DS18B20_telemetryInit(DS18B20_Telemetry_t *tlm, UART_HandleTypeDef *huart)
+{
+    uint8_t *p = (uint8_t*)tlm;
+    for(uint16_t i=0;i<sizeof(DS18B20_Telemetry_t);i++) {
+        p[i] = 0;
+    }
+    tlm->huart = huart;
+}
+
+uint8_t DS18B20_telemetryAdd(DS18B20_Telemetry_t *tlm, Ds18B20_t *ds18B20, const DS18B20_Reading_t *reading)
+{
+    if (tlm->len == 0) {
+        tlm->len = DS18B20_TLM_HEADER;
+        tlm->tick = reading->tick;
+    }
+    if (tlm->len + DS18B20_TLM_READING + 2 > DS18B20_TLM_PAYLOAD_MAX) {
+        tlm->dropped++;
+        return 0;
+    }
+
+    uint8_t rom[8];
+    uint16_t id = DS18B20_getROM(ds18B20, reading->sensor, rom) ? OW_CRC16(rom, 8, 0) : 0;
+    uint32_t dt = reading->tick - tlm->tick;
+
+    uint8_t *p = &tlm->payload[tlm->len];
+    p[0] = reading->sensor;
+    DS18B20_put16(&p[1], id);
+    DS18B20_put16(&p[3], (uint16_t)reading->raw);
+    p[5] = reading->status;
+    DS18B20_put16(&p[6], dt > 0xFFFF ? 0xFFFF : dt);
+    tlm->len += DS18B20_TLM_READING;
+    return 1;
+}
+
+/**
+ * COBS: every 0 is replaced by the distance to the next one, a code byte starts
+ * every run of up to 254 non-zero bytes. Returns the length with the 0 at the end
+ */
+static uint16_t DS18B20_cobsEncode(const uint8_t *in, uint16_t len, uint8_t *out)
+{
+    uint16_t code = 0, o = 1;
+    uint8_t run = 1;
+
+    for (uint16_t i=0;i<len;i++) {
+        if (in[i]) {
+            out[o++] = in[i];
+            run++;
+        }
+        if (!in[i] || run == 0xFF) {
+            out[code] = run;
+            code = o++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    out[o++] = 0;
+    return o;
+}
+
+/* Decodes in place, the output is never longer than the input. Returns the length or 0 */
+static uint16_t DS18B20_cobsDecode(uint8_t *buf, uint16_t len)
+{
+    uint16_t i = 0, o = 0;
+
+    while (i < len) {
+        uint8_t run = buf[i++];
+        if (run == 0 || i + run - 1 > len) return 0;
+        for (uint8_t k=1;k<run;k++) {
+            buf[o++] = buf[i++];
+        }
+        if (run < 0xFF && i < len) buf[o++] = 0;
+    }
+    return o;
+}
+
+uint8_t DS18B20_telemetrySend(DS18B20_Telemetry_t *tlm)
+{
+    if (tlm->len == 0) return 1;
+    if (tlm->sending) return 0;
+
+    uint8_t *p = tlm->payload;
+    p[0] = DS18B20_TLM_VERSION;
+    DS18B20_put16(&p[1], tlm->seq);
+    DS18B20_put16(&p[3], tlm->tick & 0xFFFF);
+    DS18B20_put16(&p[5], tlm->tick >> 16);
+    p[7] = (tlm->len - DS18B20_TLM_HEADER) / DS18B20_TLM_READING;
+    DS18B20_put16(&p[tlm->len], OW_CRC16(p, tlm->len, 0));
+
+    uint16_t n = DS18B20_cobsEncode(p, tlm->len + 2, tlm->tx);
+    tlm->sending = 1;
+    HAL_StatusTypeDef status;
+#ifdef HAL_DMA_MODULE_ENABLED
+    if (tlm->huart->hdmatx != NULL) {
+        status = HAL_UART_Transmit_DMA(tlm->huart, tlm->tx, n);
+    } else
+#endif
+    status = HAL_UART_Transmit_IT(tlm->huart, tlm->tx, n);
+    if (status != HAL_OK) {
+        tlm->sending = 0;
+        return 0;
+    }
+
+    tlm->seq++;
+    tlm->frames++;
+    tlm->len = 0;
+    return 1;
+}
+
+uint8_t DS18B20_telemetryHeartbeat(DS18B20_Telemetry_t *tlm)
+{
+    if (tlm->len == 0) {
+        tlm->len = DS18B20_TLM_HEADER;
+        tlm->tick = HAL_GetTick();
+    }
+    return DS18B20_telemetrySend(tlm);
+}
+
+uint8_t DS18B20_telemetryIsBusy(DS18B20_Telemetry_t *tlm)
+{
+    return tlm->sending;
+}
+
+void DS18B20_telemetryTxCpltCallback(DS18B20_Telemetry_t *tlm, UART_HandleTypeDef *huart)
+{
+    if (huart == tlm->huart) tlm->sending = 0;
+}
+
+int16_t DS18B20_telemetryDecode(uint8_t *frame, uint16_t len, DS18B20_TelemetryHeader_t *header,
+                                DS18B20_TelemetryReading_t *readings, uint8_t max)
+{
+    len = DS18B20_cobsDecode(frame, len);
+    if (len < DS18B20_TLM_HEADER + 2 || frame[0] != DS18B20_TLM_VERSION) return -1;
+    if (len != DS18B20_TLM_HEADER + frame[7] * DS18B20_TLM_READING + 2) return -1;
+    if (OW_CRC16(frame, len - 2, 0) != DS18B20_get16(&frame[len - 2])) return -1;
+
+    header->seq = DS18B20_get16(&frame[1]);
+    header->tick = DS18B20_get16(&frame[3]) | ((uint32_t)DS18B20_get16(&frame[5]) << 16);
+    header->count = frame[7];
+
+    uint8_t n = header->count < max ? header->count : max;
+    for (uint8_t i=0;i<n;i++) {
+        const uint8_t *p = &frame[DS18B20_TLM_HEADER + i * DS18B20_TLM_READING];
+        readings[i].sensor = p[0];
+        readings[i].id = DS18B20_get16(&p[1]);
+        readings[i].raw = (int16_t)DS18B20_get16(&p[3]);
+        readings[i].status = p[5];
+        readings[i].tick = header->tick + DS18B20_get16(&p[6]);
+    }
+    return n;
+}
@@ -0,0 +1,179 @@
+#ifndef DS18B20_TELEMETRY_h
+#define DS18B20_TELEMETRY_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : Ds18B20Telemetry.h
+ * @brief          : Binary frames of DS18B20 readings sent by a UART with DMA
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * The readings of a cycle are collected into one frame, which is sent by DMA
+ * (or IT) while the next cycle is read. Frame before the framing, little endian:
+ *   version (1), sequence number (2), tick of the first reading (4), count (1)
+ *   count readings of 8 bytes: sensor index (1), ROM id (2), raw value (2),
+ *     status DS18B20_READING_... (1), ms since the tick of the frame (2)
+ *   CRC16 of all the bytes before (2), see OneWireCrc.h
+ * The ROM id is CRC16 of the ROM, it stays the same when the sensors are
+ * found in another order. The frame is COBS encoded, so it has no 0 bytes,
+ * and a 0 ends it: a receiver finds the next frame after any lost byte.
+ *
+ * tools/ow_telemetry.c decodes the frames on a PC.
+ *
+ * Usage:
+\code
+DS18B20_RING_DEFINE(readings, 32);
+DS18B20_Telemetry_t telemetry;
+DS18B20_Reading_t batch[8];
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  DS18B20_telemetryTxCpltCallback(&telemetry, huart);
+}
+
+DS18B20_telemetryInit(&telemetry, &huart1);
+DS18B20_setRing(&ds18b20, &readings);
+
+//after a cycle
+uint16_t n;
+while ((n = DS18B20_ringDrain(&readings, batch, 8))) {
+  for (uint16_t i=0;i<n;i++) DS18B20_telemetryAdd(&telemetry, &ds18b20, &batch[i]);
+}
+DS18B20_telemetrySend(&telemetry);
+\endcode
+ */
+
+#include "Ds18B20.h"
+
+/**
+ * Maximum readings in a frame. Define more before including this file
+ */
+#ifndef DS18B20_TLM_MAX_READINGS
+#define DS18B20_TLM_MAX_READINGS 64
+#endif
+#if DS18B20_TLM_MAX_READINGS > 255
+#error "The count of a frame is one byte"
+#endif
+
+#define DS18B20_TLM_VERSION 1
+#define DS18B20_TLM_HEADER 8
+#define DS18B20_TLM_READING 8
+///Bytes of the frame before COBS
+#define DS18B20_TLM_PAYLOAD_MAX (DS18B20_TLM_HEADER + DS18B20_TLM_MAX_READINGS * DS18B20_TLM_READING + 2)
+///Bytes on the line: COBS adds a byte per 254 and the first one, then the 0 at the end
+#define DS18B20_TLM_FRAME_MAX (DS18B20_TLM_PAYLOAD_MAX + DS18B20_TLM_PAYLOAD_MAX / 254 + 2)
+
+/**
+ * @brief  Encoder of the frames of one UART
+ * @note   It is fully private and should not be touched by user
+ */
+typedef struct {
+    UART_HandleTypeDef *huart;
+    uint8_t payload[DS18B20_TLM_PAYLOAD_MAX];   //the frame being collected
+    uint16_t len;                               //bytes in payload, 0 - no readings yet
+    uint32_t tick;                              //tick of the first reading of the frame
+    uint8_t tx[DS18B20_TLM_FRAME_MAX];          //the frame being sent
+    volatile uint8_t sending;
+    uint16_t seq;
+    uint32_t frames;                            //frames sent
+    uint32_t dropped;                           //readings lost because the frame was full
+} DS18B20_Telemetry_t;
+
+/**
+ * @brief  Header of a decoded frame
+ */
+typedef struct {
+    uint16_t seq;
+    uint32_t tick;
+    uint8_t count;                              //readings in the frame
+} DS18B20_TelemetryHeader_t;
+
+/**
+ * @brief  A decoded reading
+ */
+typedef struct {
+    int16_t raw;
+    uint16_t id;                                //CRC16 of the ROM
+    uint8_t sensor;
+    uint8_t status;                             //DS18B20_READING_...
+    uint32_t tick;                              //the tick of the frame plus the offset of the reading
+} DS18B20_TelemetryReading_t;
+
+/**
+ * Initialize the encoder
+ * @param *huart: UART for the frames, with DMA linked or without it (IT is used then)
+ */
+void DS18B20_telemetryInit(DS18B20_Telemetry_t *tlm, UART_HandleTypeDef *huart);
+
+/**
+ * Add a reading to the frame being collected
+ * @param *ds18B20: the bus the reading is from, for the ROM id
+ * @param *reading: a reading from @ref DS18B20_ringDrain
+ * @retval 0 - the frame is full, the reading is dropped and counted
+ */
+uint8_t DS18B20_telemetryAdd(DS18B20_Telemetry_t *tlm, Ds18B20_t *ds18B20, const DS18B20_Reading_t *reading);
+
+/**
+ * Close the frame and start sending it, the next readings go to a new frame
+ * @retval 0 - the previous frame is still being sent or the UART is busy, the readings
+ * stay and the next call sends them with the new ones. 1 - sending or nothing to send
+ */
+uint8_t DS18B20_telemetrySend(DS18B20_Telemetry_t *tlm);
+
+/**
+ * Same as @ref DS18B20_telemetrySend, but with no readings collected it sends a frame of 0
+ * readings. The receiver knows the device runs and has nothing to report, e.g. no sensors.
+ * @retval see @ref DS18B20_telemetrySend
+ */
+uint8_t DS18B20_telemetryHeartbeat(DS18B20_Telemetry_t *tlm);
+
+/**
+ * @retval 1 - a frame is being sent
+ */
+uint8_t DS18B20_telemetryIsBusy(DS18B20_Telemetry_t *tlm);
+
+/**
+ * Call it from HAL_UART_TxCpltCallback
+ */
+void DS18B20_telemetryTxCpltCallback(DS18B20_Telemetry_t *tlm, UART_HandleTypeDef *huart);
+
+/**
+ * Decode a frame in place
+ * @param *frame: the bytes received before the 0, they are overwritten
+ * @param len: amount of the bytes
+ * @param *header: header of the frame
+ * @param *readings: up to max readings
+ * @retval amount of the readings, -1 - the frame is broken (COBS, length, version or CRC)
+ */
+int16_t DS18B20_telemetryDecode(uint8_t *frame, uint16_t len, DS18B20_TelemetryHeader_t *header,
+                                DS18B20_TelemetryReading_t *readings, uint8_t max);
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of DS18B20_TELEMETRY_h */
@@ -4,13 +4,12 @@
 /**
  * internal function to reset uart when an error happens
  * 
- * It seems this function is unneeded when 8 bits are sent separatly
+ * It is needed after a failed DMA transfer, the instance of the UART is kept
  */
 void OW_resetUART(OneWire_t* ow)
 {
 	HAL_UART_DeInit(ow->huart);
 
-	ow->huart->Instance = USART3;
 	ow->huart->Init.BaudRate = 115200;
 	ow->huart->Init.WordLength = UART_WORDLENGTH_8B;
 	ow->huart->Init.StopBits = UART_STOPBITS_1;
@@ -22,15 +21,8 @@ void OW_resetUART(OneWire_t* ow)
 	HAL_UART_Init(ow->huart);
 
 	ow->status = HAL_OK;
+	ow->stats.uartResets++;
 }
-
-void OW_init(OneWire_t *ow, UART_HandleTypeDef *huart)
-{
-    /* Save settings */
-    ow->huart = huart;
-	ow->status = HAL_OK;
-}
-
 uint8_t bitsToByte(uint8_t *bits) {
     uint8_t target_byte, i;
     target_byte = 0;
@@ -79,7 +71,76 @@ void OW_setBaudRate(UART_HandleTypeDef *huart, uint32_t bdr)
 	__HAL_UART_ENABLE(huart); //Not sure it is needed
 }
 
-uint8_t OW_reset(OneWire_t *ow)
+/// Baud rate of the bit slots at the current speed
+static uint32_t OW_workSpeed(OneWire_t *ow)
+{
+	return ow->speed == OW_SPEED_OVERDRIVE ? OW_OD_WORK_SPEED : OW_WORK_SPEED;
+}
+
+/// Counts len bit slots at the current speed
+static void OW_countSlots(OneWire_t *ow, uint16_t len)
+{
+	ow->stats.slots += len;
+	if (ow->speed == OW_SPEED_OVERDRIVE) ow->stats.odSlots += len;
+}
+
+/// Counts the failure of a transfer by the status
+static void OW_countStatus(OneWire_t *ow)
+{
+	if (ow->status == HAL_TIMEOUT) {
+		ow->stats.timeouts++;
+	} else if (ow->status != HAL_OK) {
+		ow->stats.errors++;
+	}
+}
+
+void OW_getStats(OneWire_t *ow, OW_Stats_t *stats, uint8_t reset)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = ow->stats;
+	if (reset) {
+		OW_Stats_t zero = {0};
+		ow->stats = zero;
+	}
+	__set_PRIMASK(primask);
+
+	const OW_Transport_t *t = ow->transport;
+	uint64_t ns = 0;
+	if (t) {
+		ns = (uint64_t)(stats->resets - stats->odResets) * t->resetNs[OW_SPEED_STANDARD] +
+		     (uint64_t)stats->odResets * t->resetNs[OW_SPEED_OVERDRIVE] +
+		     (uint64_t)(stats->slots - stats->odSlots) * t->slotNs[OW_SPEED_STANDARD] +
+		     (uint64_t)stats->odSlots * t->slotNs[OW_SPEED_OVERDRIVE];
+	}
+	stats->busyMs = (uint32_t)(ns / 1000000);
+}
+
+void OW_setLock(OneWire_t *ow, OW_Lock_t lock, OW_Unlock_t unlock, void *ctx)
+{
+	ow->lock = lock;
+	ow->unlock = unlock;
+	ow->lockCtx = ctx;
+}
+
+uint8_t OW_lock(OneWire_t *ow)
+{
+	return ow->lock == NULL || ow->lock(ow->lockCtx, HAL_MAX_DELAY);
+}
+
+uint8_t OW_tryLock(OneWire_t *ow)
+{
+	return ow->lock == NULL || ow->lock(ow->lockCtx, 0);
+}
+
+void OW_unlock(OneWire_t *ow)
+{
+	if (ow->unlock) ow->unlock(ow->lockCtx);
+}
+
+/* ------------------------- UART transport ------------------------- */
+
+static uint8_t OW_uartReset(OneWire_t *ow, uint8_t speed)
 {
 	//Reset UART if there is an error
 	if (ow->status != HAL_OK) {
@@ -89,98 +150,445 @@ uint8_t OW_reset(OneWire_t *ow)
     uint8_t reset = 0xF0;
     uint8_t resetBack = 0;
 
-    OW_setBaudRate(ow->huart, OW_RESET_SPEED);
-    
+    OW_setBaudRate(ow->huart, speed == OW_SPEED_OVERDRIVE ? OW_OD_RESET_SPEED : OW_RESET_SPEED);
+
 	HAL_UART_Transmit_IT(ow->huart, &reset, 1);
     ow->status = HAL_UART_Receive(ow->huart, &resetBack, 1, OW_TIMEOUT);
 
-    OW_setBaudRate(ow->huart, OW_WORK_SPEED);
+    OW_setBaudRate(ow->huart, OW_workSpeed(ow));
 
     return reset!=resetBack;
 }
 
+/**
+ * Time to wait for a bulk transfer: the usual timeout plus the time of the slots
+ * themselves. One slot takes 10 bits at OW_WORK_SPEED, about 87us.
+ */
+#define OW_BULK_TIMEOUT(slots) (OW_TIMEOUT + ((uint32_t)(slots) * 10000 / OW_WORK_SPEED) + 1)
+
+/* Bit slots go by DMA if both channels are linked, otherwise by interrupts */
+static HAL_StatusTypeDef OW_touchReceive(UART_HandleTypeDef *huart, uint8_t *slots, uint16_t len)
+{
+#ifdef HAL_DMA_MODULE_ENABLED
+	if (huart->hdmatx != NULL && huart->hdmarx != NULL) {
+		return HAL_UART_Receive_DMA(huart, slots, len);
+	}
+#endif
+	return HAL_UART_Receive_IT(huart, slots, len);
+}
+
+static HAL_StatusTypeDef OW_touchTransmit(UART_HandleTypeDef *huart, uint8_t *slots, uint16_t len)
+{
+#ifdef HAL_DMA_MODULE_ENABLED
+	if (huart->hdmatx != NULL && huart->hdmarx != NULL) {
+		return HAL_UART_Transmit_DMA(huart, slots, len);
+	}
+#endif
+	return HAL_UART_Transmit_IT(huart, slots, len);
+}
+
+/* Echoes which are not received yet */
+static uint16_t OW_touchLeft(UART_HandleTypeDef *huart)
+{
+#ifdef HAL_DMA_MODULE_ENABLED
+	if (huart->hdmatx != NULL && huart->hdmarx != NULL) {
+		return __HAL_DMA_GET_COUNTER(huart->hdmarx);
+	}
+#endif
+	return huart->RxXferCount;
+}
+
+/**
+ * Starts the exchange: RX of rxLen echoes and TX of the first txLen slots.
+ *
+ * RX is started before TX on the same buffer. A slot is always read out
+ * by TX before its echo is written back by RX, so the buffer is used in place.
+ * Since every received byte is the echo of a transmitted one, TX and RX cannot
+ * get out of sync the way two separate IT/blocking calls do. If they do anyway
+ * (overrun, noise, lost DMA request) the transfer is aborted and the status is
+ * set, so the next @ref OW_reset will reinitialize the UART.
+ */
+static void OW_touchStart(OneWire_t *ow, uint8_t *slots, uint16_t rxLen, uint16_t txLen)
+{
+	UART_HandleTypeDef *huart = ow->huart;
+
+	//A byte left in DR or an overrun from a previous transfer would shift
+	//all the echoes by one
+	__HAL_UART_CLEAR_OREFLAG(huart);
+
+	ow->status = OW_touchReceive(huart, slots, rxLen);
+	if (ow->status == HAL_OK) {
+		ow->status = OW_touchTransmit(huart, slots, txLen);
+	}
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(huart);
+	}
+}
+
+/* Waits till TX (gState) or RX (RxState) of the exchange is done */
+static void OW_touchWait(OneWire_t *ow, volatile HAL_UART_StateTypeDef *state, uint16_t len)
+{
+	uint32_t start = HAL_GetTick();
+	while (*state != HAL_UART_STATE_READY) {
+		if ((HAL_GetTick() - start) > OW_BULK_TIMEOUT(len)) {
+			ow->status = HAL_TIMEOUT;
+			break;
+		}
+	}
+}
+
+/* Waits for the last echo, aborts the exchange if it failed */
+static void OW_touchEnd(OneWire_t *ow, uint16_t len)
+{
+	UART_HandleTypeDef *huart = ow->huart;
+
+	if (ow->status != HAL_OK) return;
+	OW_touchWait(ow, &huart->RxState, len);
+
+	if (ow->status == HAL_OK &&
+		(huart->ErrorCode != HAL_UART_ERROR_NONE || OW_touchLeft(huart) != 0)) {
+		//Desync: some echoes were lost
+		ow->status = HAL_ERROR;
+	}
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(huart);
+	}
+}
+
+static void OW_uartTouch(OneWire_t *ow, uint8_t *slots, uint16_t len)
+{
+	if (len == 1) {
+		//One slot costs less as a blocking exchange than set up for IT or DMA
+		HAL_UART_Transmit_IT(ow->huart, slots, 1);
+		ow->status = HAL_UART_Receive(ow->huart, slots, 1, OW_TIMEOUT);
+		return;
+	}
+	OW_touchStart(ow, slots, len, len);
+	OW_touchEnd(ow, len);
+}
+
+static uint8_t OW_uartTriplet(OneWire_t *ow, uint8_t direction)
+{
+	uint8_t s[3] = {WIRE_1, WIRE_1, WIRE_1};
+
+	//RX is armed for all three echoes, so the direction slot only needs TX
+	//to be started as soon as the two read slots are sent
+	OW_touchStart(ow, s, 3, 2);
+	if (ow->status != HAL_OK) return OW_TRIPLET_NONE;
+	OW_touchWait(ow, &ow->huart->gState, 2);
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(ow->huart);
+		return OW_TRIPLET_NONE;
+	}
+
+	//RXNE of the last echo comes before TC, both read slots are back
+	uint8_t id_bit = s[0] == WIRE_1;
+	uint8_t cmp_id_bit = s[1] == WIRE_1;
+	if (id_bit && cmp_id_bit) {
+		HAL_UART_AbortReceive(ow->huart);
+		return OW_TRIPLET_NONE;
+	}
+
+	//All the devices have the same bit, there is no choice
+	if (id_bit != cmp_id_bit) direction = id_bit;
+
+	s[2] = direction ? WIRE_1 : WIRE_0;
+	ow->status = OW_touchTransmit(ow->huart, &s[2], 1);
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(ow->huart);
+		return OW_TRIPLET_NONE;
+	}
+	OW_touchEnd(ow, 1);
+	if (ow->status != HAL_OK) return OW_TRIPLET_NONE;
+
+	return id_bit | (cmp_id_bit << 1) | (direction ? OW_TRIPLET_DIR : 0);
+}
+
+static void OW_uartSetSpeed(OneWire_t *ow, uint8_t speed)
+{
+	OW_setBaudRate(ow->huart, speed == OW_SPEED_OVERDRIVE ? OW_OD_WORK_SPEED : OW_WORK_SPEED);
+}
+
+/// Nanoseconds of one UART byte (10 bits) at baud
+#define OW_UART_BYTE_NS(baud) ((uint32_t)(10000000000ULL / (baud)))
+
+/* Without DMA every slot is a blocking exchange of one byte */
+static const OW_Transport_t OW_uartTransport = {
+	.reset = OW_uartReset,
+	.touch = OW_uartTouch,
+	.triplet = OW_uartTriplet,
+	.setSpeed = OW_uartSetSpeed,
+	.bulkSlots = 1,
+	.resetNs = { OW_UART_BYTE_NS(OW_RESET_SPEED), OW_UART_BYTE_NS(OW_OD_RESET_SPEED) },
+	.slotNs = { OW_UART_BYTE_NS(OW_WORK_SPEED), OW_UART_BYTE_NS(OW_OD_WORK_SPEED) },
+};
+
+/* With DMA a chunk of bytes is one transfer of their slots */
+static const OW_Transport_t OW_uartDmaTransport = {
+	.reset = OW_uartReset,
+	.touch = OW_uartTouch,
+	.triplet = OW_uartTriplet,
+	.setSpeed = OW_uartSetSpeed,
+	.bulkSlots = OW_BULK_BYTES * 8,
+	.resetNs = { OW_UART_BYTE_NS(OW_RESET_SPEED), OW_UART_BYTE_NS(OW_OD_RESET_SPEED) },
+	.slotNs = { OW_UART_BYTE_NS(OW_WORK_SPEED), OW_UART_BYTE_NS(OW_OD_WORK_SPEED) },
+};
+
+/* ------------------------------------------------------------------ */
+
+void OW_setTransport(OneWire_t *ow, const OW_Transport_t *transport, void *ctx)
+{
+	ow->transport = transport;
+	ow->transportCtx = ctx;
+}
+
+void OW_init(OneWire_t *ow, UART_HandleTypeDef *huart)
+{
+    /* Save settings */
+    ow->huart = huart;
+	if (huart != NULL) {
+		uint8_t dma = 0;
+#ifdef HAL_DMA_MODULE_ENABLED
+		dma = huart->hdmatx != NULL && huart->hdmarx != NULL;
+#endif
+		OW_setTransport(ow, dma ? &OW_uartDmaTransport : &OW_uartTransport, huart);
+	}
+	ow->status = HAL_OK;
+	ow->speed = OW_SPEED_STANDARD;
+	ow->head = NULL;
+	ow->tail = NULL;
+	ow->phase = 0;
+	ow->finishing = 0;
+	OW_Stats_t zero = {0};
+	ow->stats = zero;
+}
+
+static uint8_t OW_resetAt(OneWire_t *ow, uint8_t speed)
+{
+	//OW_init with huart NULL and no OW_setTransport before it
+	if (ow->transport == NULL) {
+		ow->status = HAL_ERROR;
+		OW_countStatus(ow);
+		return 0;
+	}
+
+	uint8_t presence = ow->transport->reset(ow, speed);
+
+	ow->stats.resets++;
+	if (speed == OW_SPEED_OVERDRIVE) ow->stats.odResets++;
+	OW_countStatus(ow);
+	if (!presence) ow->stats.noPresence++;
+
+    return presence;
+}
+
+uint8_t OW_reset(OneWire_t *ow)
+{
+	//Standard reset returns all the devices to standard speed
+	ow->speed = OW_SPEED_STANDARD;
+	return OW_resetAt(ow, OW_SPEED_STANDARD);
+}
+
+uint8_t OW_resetOverdrive(OneWire_t *ow)
+{
+	if (ow->speed == OW_SPEED_OVERDRIVE && OW_resetAt(ow, OW_SPEED_OVERDRIVE)) {
+		return 1;
+	}
+	return OW_reset(ow);
+}
+
+void OW_touch(OneWire_t *ow, uint8_t *slots, uint16_t len)
+{
+	if (ow->transport == NULL) {
+		ow->status = HAL_ERROR;
+		OW_countStatus(ow);
+		return;
+	}
+	ow->transport->touch(ow, slots, len);
+	OW_countSlots(ow, len);
+	OW_countStatus(ow);
+}
+
 void OW_sendBit(OneWire_t *ow, uint8_t b)
 {
-    uint8_t r,s;
-    s = b ? WIRE_1 : WIRE_0;
-    HAL_UART_Transmit_IT(ow->huart, &s, 1);
-    ow->status = HAL_UART_Receive(ow->huart, &r, 1, OW_TIMEOUT);
+    uint8_t s = b ? WIRE_1 : WIRE_0;
+	OW_touch(ow, &s, 1);
 }
 
 uint8_t OW_receiveBit(OneWire_t *ow)
 {
-    uint8_t s = 0xFF, r;
-    HAL_UART_Transmit_IT(ow->huart, &s, 1);
-    ow->status = HAL_UART_Receive(ow->huart, &r, 1, OW_TIMEOUT);
+    uint8_t s = WIRE_1;
+	OW_touch(ow, &s, 1);
 
-	if (r==0xFF) return 1;
+	if (s==WIRE_1) return 1;
 
 	return 0;
 }
 
-void OW_sendByte(OneWire_t *ow, uint8_t b)
+uint8_t OW_triplet(OneWire_t *ow, uint8_t direction)
 {
-    uint8_t sendByte[8];
-    //uint8_t recvByte[8];
+	const OW_Transport_t *t = ow->transport;
+
+	if (t && t->triplet) {
+		uint8_t triplet = t->triplet(ow, direction);
+		OW_countSlots(ow, triplet == OW_TRIPLET_NONE ? 2 : 3);
+		OW_countStatus(ow);
+		return triplet;
+	}
+
+	uint8_t s[2] = {WIRE_1, WIRE_1};
+	OW_touch(ow, s, 2);
+	if (ow->status != HAL_OK) return OW_TRIPLET_NONE;
 
-    byteToBits(b, sendByte); //0b01101001 => 0x00 0xFF 0xFF 0x00 0xFF 0x00 0x00 0xFF
+	uint8_t id_bit = s[0] == WIRE_1;
+	uint8_t cmp_id_bit = s[1] == WIRE_1;
+	if (id_bit && cmp_id_bit) return OW_TRIPLET_NONE;
 
-	for(uint8_t i=0;i<8;i++) {
-		OW_sendBit(ow, sendByte[i]);
+	//All the devices have the same bit, there is no choice
+	if (id_bit != cmp_id_bit) direction = id_bit;
+
+	OW_sendBit(ow, direction);
+	if (ow->status != HAL_OK) return OW_TRIPLET_NONE;
+
+	return id_bit | (cmp_id_bit << 1) | (direction ? OW_TRIPLET_DIR : 0);
+}
+
+/* Bytes of a transport which moves one slot at a time */
+static void OW_transferBits(OneWire_t *ow, const uint8_t *tx, uint8_t *rx, uint8_t len, uint8_t *crc)
+{
+	for (uint8_t i=0;i<len;i++) {
+		uint8_t b = tx ? tx[i] : 0xFF;
+		uint8_t r = 0;
+		for (uint8_t j=0;j<8;j++) {
+			if (b & 0x01) {
+				r |= (OW_receiveBit(ow) << j);
+			} else {
+				OW_sendBit(ow, 0);
+			}
+			b >>= 1;
+			//A dead UART would take OW_TIMEOUT for every bit left
+			if (ow->status != HAL_OK) {
+				if (rx) {
+					for (;i<len;i++) rx[i] = 0xFF;
+				}
+				return;
+			}
+		}
+		if (rx) rx[i] = r;
+		if (crc) *crc = OW_CRC8_update(*crc, r);
 	}
-	/* 
-	On a high loaded system there will be desynchronization of transmit and receive
-	buffer. It will lead to timeout errors.
-	I'm not sure if deinit and init will clear that error.
-	Below the example that creates such error.
-	*/
-    //HAL_UART_Transmit_IT(ow->huart, sendByte, 8);
-    //ow->status = HAL_UART_Receive(ow->huart, recvByte, 8, OW_TIMEOUT);
 }
 
-void OW_sendBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len)
+/* Up to OW_BULK_BYTES bytes in place, by touchBytes or by one touch of their slots */
+static void OW_touchChunk(OneWire_t *ow, uint8_t *bytes, uint8_t len)
 {
-    for(uint8_t i=0;i<len;i++) {
-		OW_sendByte(ow, bytes[i]);
-    }
+	const OW_Transport_t *t = ow->transport;
+
+	if (t->touchBytes) {
+		t->touchBytes(ow, bytes, len);
+		OW_countSlots(ow, len * 8);
+		OW_countStatus(ow);
+		return;
+	}
+
+	uint8_t *bits = ow->slots;
+	for (uint8_t i=0;i<len;i++) {
+		bits = byteToBits(bytes[i], bits);
+	}
+	OW_touch(ow, ow->slots, len * 8);
+	for (uint8_t i=0;i<len;i++) {
+		//Only the untouched slot is 1, the device pulling the bus low spoils it
+		uint8_t b = 0;
+		for (uint8_t j=0;j<8;j++) {
+			if (ow->slots[i*8 + j] == WIRE_1) b |= (1 << j);
+		}
+		bytes[i] = b;
+	}
 }
 
-uint8_t OW_receiveByte(OneWire_t *ow)
+/**
+ * Send tx and receive rx through the bus. Any of them could be NULL:
+ * with tx==NULL read slots are sent, with rx==NULL the echo is thrown away.
+ * The bytes go in chunks of OW_BULK_BYTES if the transport moves them at once
+ * (touchBytes, DMA of the UART) or bit by bit otherwise.
+ * CRC8 of the received bytes is added to crc if it's not NULL.
+ */
+static void OW_transferBytes(OneWire_t *ow, const uint8_t *tx, uint8_t *rx, uint8_t len, uint8_t *crc)
 {
-    uint8_t sendByte[8];
-    uint8_t recvByte[8];
-    byteToBits(0xFF, sendByte);
+	const OW_Transport_t *t = ow->transport;
 
-	for (uint8_t i=0;i<8;i++) {
-		recvByte[i] = OW_receiveBit(ow);
+	ow->stats.bytes += len;
+	//Without a transport the first slot fails
+	if (t == NULL || (t->touchBytes == NULL && t->bulkSlots < 8)) {
+		OW_transferBits(ow, tx, rx, len, crc);
+		return;
 	}
 
-    return bitsToByte(recvByte);
+	uint8_t max = OW_BULK_BYTES;
+	if (t->touchBytes == NULL && t->bulkSlots / 8 < max) max = t->bulkSlots / 8;
+	while (len) {
+		uint8_t chunk = len > max ? max : len;
+		uint8_t bytes[OW_BULK_BYTES];
+		for (uint8_t i=0;i<chunk;i++) {
+			bytes[i] = tx ? tx[i] : 0xFF;
+		}
+
+		OW_touchChunk(ow, bytes, chunk);
+		if (ow->status != HAL_OK) {
+			if (rx) {
+				for (uint8_t i=0;i<len;i++) rx[i] = 0xFF;
+			}
+			return;
+		}
+
+		if (rx) {
+			for (uint8_t i=0;i<chunk;i++) {
+				rx[i] = bytes[i];
+				if (crc) *crc = OW_CRC8_update(*crc, bytes[i]);
+			}
+			rx += chunk;
+		}
+		if (tx) tx += chunk;
+		len -= chunk;
+	}
+}
+
+void OW_sendByte(OneWire_t *ow, uint8_t b)
+{
+	OW_transferBytes(ow, &b, NULL, 1, NULL);
+}
+
+void OW_sendBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len)
+{
+	OW_transferBytes(ow, bytes, NULL, len, NULL);
+}
+
+uint8_t OW_receiveByte(OneWire_t *ow)
+{
+	uint8_t b;
+	OW_transferBytes(ow, NULL, &b, 1, NULL);
+	return b;
 }
 
 void OW_receiveBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len)
 {
-    for(uint8_t i=0;i<len;i++) {
-        bytes[i] = OW_receiveByte(ow);
-    }
+	OW_transferBytes(ow, NULL, bytes, len, NULL);
+}
+
+uint8_t OW_receiveBytesCRC8(OneWire_t *ow, uint8_t *bytes, uint8_t len, uint8_t crc)
+{
+	OW_transferBytes(ow, NULL, bytes, len, &crc);
+	return crc;
 }
 
 uint8_t OW_CRC8(uint8_t* addr, uint8_t len)
 {
-    uint8_t crc = 0, inbyte, i, mix;
-	
+	uint8_t crc = 0;
+
 	while (len--) {
-		inbyte = *addr++;
-		for (i = 8; i; i--) {
-			mix = (crc ^ inbyte) & 0x01;
-			crc >>= 1;
-			if (mix) {
-				crc ^= 0x8C;
-			}
-			inbyte >>= 1;
-		}
+		crc = OW_CRC8_update(crc, *addr++);
 	}
-	
+
 	/* Return calculated CRC */
 	return crc;
 }
@@ -204,11 +612,52 @@ uint8_t OW_first(OneWire_t *ow)
 }
 
 
+/**
+ * The 64 steps of the search by the search function of the transport. The directions
+ * are the ones the triplets would take, the discrepancies it reports give last_zero.
+ * Without the (1, 1) reads a device lost in the middle is caught by the CRC.
+ */
+static uint8_t OW_searchAll(OneWire_t *ow, uint8_t *last_zero)
+{
+	uint8_t rom[8], diff[8];
+
+	for (uint8_t i = 0; i < 64; i++) {
+		uint8_t mask = 1 << (i & 7);
+		uint8_t dir = i + 1 < ow->LastDiscrepancy ? (ow->ROM_NO[i >> 3] & mask) != 0 :
+			i + 1 == ow->LastDiscrepancy;
+		if (dir) {
+			rom[i >> 3] |= mask;
+		} else {
+			rom[i >> 3] &= ~mask;
+		}
+	}
+
+	ow->transport->search(ow, rom, diff);
+	OW_countSlots(ow, 64 * 3);
+	OW_countStatus(ow);
+	if (ow->status != HAL_OK || OW_CRC8(rom, 8) != 0) return 0;
+
+	for (uint8_t i = 0; i < 64; i++) {
+		uint8_t mask = 1 << (i & 7);
+		/* 0 was picked on a discrepancy */
+		if ((diff[i >> 3] & mask) && !(rom[i >> 3] & mask)) {
+			*last_zero = i + 1;
+			if (*last_zero < 9) {
+				ow->LastFamilyDiscrepancy = *last_zero;
+			}
+		}
+	}
+	for (uint8_t i = 0; i < 8; i++) {
+		ow->ROM_NO[i] = rom[i];
+	}
+	return 1;
+}
+
 uint8_t OW_search(OneWire_t* ow, uint8_t command)
 {
 	uint8_t id_bit_number;
 	uint8_t last_zero, rom_byte_number, search_result;
-	uint8_t id_bit, cmp_id_bit;
+	uint8_t id_bit, cmp_id_bit, triplet;
 	uint8_t rom_byte_mask, search_direction;
 
 	/* Initialize for search */
@@ -229,63 +678,64 @@ uint8_t OW_search(OneWire_t* ow, uint8_t command)
 
 		/* Issue the search command */
         OW_sendByte(ow, command);
-		
+
+		/* The transport takes all the steps at once */
+		if (ow->transport->search) {
+			if (OW_searchAll(ow, &last_zero)) {
+				id_bit_number = 65;
+			}
+			rom_byte_number = 8;
+		}
+
 		/* Loop to do the search */
-		do {
-			/* Read a bit and its complement */
-			id_bit = OW_receiveBit(ow); //0
-			cmp_id_bit = OW_receiveBit(ow); //1
+		while (rom_byte_number < 8) {
+			/* If this discrepancy is before the Last Discrepancy on a previous next then pick the same as last time */
+			if (id_bit_number < ow->LastDiscrepancy) {
+				search_direction = ((ow->ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
+			} else {
+				/* If equal to last pick 1, if not then pick 0 */
+				search_direction = (id_bit_number == ow->LastDiscrepancy);
+			}
+
+			/* Read a bit and its complement, write the direction: it is used only on a discrepancy */
+			triplet = OW_triplet(ow, search_direction);
+			id_bit = (triplet & OW_TRIPLET_ID) != 0;
+			cmp_id_bit = (triplet & OW_TRIPLET_CMP) != 0;
 
 			/* Check for no devices on 1-wire */
 			if ((id_bit == 1) && (cmp_id_bit == 1)) {
 				break;
-			} else {
-				/* All devices coupled have 0 or 1 */
-				if (id_bit != cmp_id_bit) {
-					/* Bit write value for search */
-					search_direction = id_bit; //1
-				} else {
-					/* If this discrepancy is before the Last Discrepancy on a previous next then pick the same as last time */
-					if (id_bit_number < ow->LastDiscrepancy) {
-						search_direction = ((ow->ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
-					} else {
-						/* If equal to last pick 1, if not then pick 0 */
-						search_direction = (id_bit_number == ow->LastDiscrepancy);
-					}
-					
-					/* If 0 was picked then record its position in LastZero */
-					if (search_direction == 0) {
-						last_zero = id_bit_number;
-
-						/* Check for Last discrepancy in family */
-						if (last_zero < 9) {
-							ow->LastFamilyDiscrepancy = last_zero;
-						}
-					}
-				}
+			}
 
-				/* Set or clear the bit in the ROM byte rom_byte_number with mask rom_byte_mask */
-				if (search_direction == 1) { // 1
-					ow->ROM_NO[rom_byte_number] |= rom_byte_mask; // |= 1
-				} else {
-					ow->ROM_NO[rom_byte_number] &= ~rom_byte_mask;
-				}
-				
-				/* Serial number search direction write bit */
-                OW_sendBit(ow, search_direction);  //1
-
-				/* Increment the byte counter id_bit_number and shift the mask rom_byte_mask */
-				id_bit_number++; // 1 -> 2
-				rom_byte_mask <<= 1; // 0b10
-
-				/* If the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask */
-				if (rom_byte_mask == 0) {
-					rom_byte_number++;
-					rom_byte_mask = 1;
+			/* If 0 was picked on a discrepancy then record its position in LastZero */
+			if (id_bit == cmp_id_bit && search_direction == 0) {
+				last_zero = id_bit_number;
+
+				/* Check for Last discrepancy in family */
+				if (last_zero < 9) {
+					ow->LastFamilyDiscrepancy = last_zero;
 				}
 			}
+			search_direction = (triplet & OW_TRIPLET_DIR) != 0;
+
+			/* Set or clear the bit in the ROM byte rom_byte_number with mask rom_byte_mask */
+			if (search_direction == 1) {
+				ow->ROM_NO[rom_byte_number] |= rom_byte_mask;
+			} else {
+				ow->ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+			}
+
+			/* Increment the byte counter id_bit_number and shift the mask rom_byte_mask */
+			id_bit_number++;
+			rom_byte_mask <<= 1;
+
+			/* If the mask is 0 then go to new SerialNum byte rom_byte_number and reset mask */
+			if (rom_byte_mask == 0) {
+				rom_byte_number++;
+				rom_byte_mask = 1;
+			}
 		/* Loop until through all ROM bytes 0-7 */
-		} while (rom_byte_number < 8);
+		}
 
 		/* If the search was successful then */
 		if (!(id_bit_number < 65)) {
@@ -316,6 +766,63 @@ uint8_t OW_next(OneWire_t* ow)
    return OW_search(ow, OW_CMD_SEARCHROM);
 }
 
+uint8_t OW_targetFamily(OneWire_t *ow, uint8_t family)
+{
+	/* The search goes the way of ROM_NO up to the last bit, so it starts from the family */
+	ow->ROM_NO[0] = family;
+	for (uint8_t i = 1; i < 8; i++) {
+		ow->ROM_NO[i] = 0;
+	}
+	ow->LastDiscrepancy = 64;
+	ow->LastFamilyDiscrepancy = 0;
+	ow->LastDeviceFlag = 0;
+
+	if (!OW_search(ow, OW_CMD_SEARCHROM)) {
+		return 0;
+	}
+	if (ow->ROM_NO[0] != family) {
+		/* Nobody of the family, the search found the next one */
+		OW_resetSearch(ow);
+		return 0;
+	}
+	return 1;
+}
+
+uint8_t OW_nextInFamily(OneWire_t *ow)
+{
+	/* The next device differs in the bit after the last discrepancy,
+	 * in the family code it's another family */
+	if (ow->LastDiscrepancy <= 8) {
+		return 0;
+	}
+	return OW_search(ow, OW_CMD_SEARCHROM);
+}
+
+uint8_t OW_skipFamily(OneWire_t *ow)
+{
+	/* Take the other way at the last discrepancy in the family code */
+	ow->LastDiscrepancy = ow->LastFamilyDiscrepancy;
+	ow->LastFamilyDiscrepancy = 0;
+
+	if (ow->LastDiscrepancy == 0) {
+		/* It was the last family */
+		OW_resetSearch(ow);
+		return 0;
+	}
+	return OW_search(ow, OW_CMD_SEARCHROM);
+}
+
+uint8_t OW_firstAlarm(OneWire_t *ow)
+{
+	OW_resetSearch(ow);
+	return OW_search(ow, OW_CMD_ALARMSEARCH);
+}
+
+uint8_t OW_nextAlarm(OneWire_t *ow)
+{
+	return OW_search(ow, OW_CMD_ALARMSEARCH);
+}
+
 uint8_t OW_getROM(OneWire_t* ow, uint8_t index)
 {
 	return ow->ROM_NO[index];
@@ -331,20 +838,278 @@ void OW_getFullROM(OneWire_t* ow, uint8_t *firstIndex)
 
 void OW_select(OneWire_t* ow, uint8_t* addr)
 {
-    uint8_t i;
-	OW_sendByte(ow, OW_CMD_MATCHROM);
-	
-	for (i = 0; i < 8; i++) {
-		OW_sendByte(ow, *(addr + i));
+	uint8_t data[9];
+	data[0] = OW_CMD_MATCHROM;
+	for (uint8_t i = 0; i < 8; i++) {
+		data[i + 1] = addr[i];
 	}
+	//Command and ROM in one transfer
+	OW_transferBytes(ow, data, NULL, sizeof(data), NULL);
 }
 
 void OW_selectWithPointer(OneWire_t* ow, uint8_t* ROM)
 {
-    uint8_t i;
-	OW_sendByte(ow, OW_CMD_MATCHROM);
-	
-	for (i = 0; i < 8; i++) {
-		OW_sendByte(ow, *(ROM + i));
+	OW_select(ow, ROM);
+}
+
+/* The slots go at speed from now on */
+static void OW_setSpeed(OneWire_t *ow, uint8_t speed)
+{
+	ow->speed = speed;
+	if (ow->transport && ow->transport->setSpeed) ow->transport->setSpeed(ow, speed);
+}
+
+void OW_overdriveSkip(OneWire_t *ow)
+{
+	OW_sendByte(ow, OW_CMD_ODSKIPROM);
+	OW_setSpeed(ow, OW_SPEED_OVERDRIVE);
+}
+
+void OW_overdriveSelect(OneWire_t *ow, uint8_t *addr)
+{
+	//The command goes at standard speed, the ROM at overdrive
+	OW_sendByte(ow, OW_CMD_ODMATCHROM);
+	OW_setSpeed(ow, OW_SPEED_OVERDRIVE);
+	OW_transferBytes(ow, addr, NULL, 8, NULL);
+}
+
+/* Phases of the asynchronous engine */
+#define OW_PH_IDLE  0
+#define OW_PH_RESET 1
+#define OW_PH_DATA  2
+
+/* All the bytes of the transaction after reset, up to 255 + 255 + 9 */
+static uint16_t OW_asyncLength(const OW_Transaction_t *tr)
+{
+	uint16_t len = (uint16_t)tr->txLen + tr->rxLen;
+	if (tr->flags & OW_TR_MATCHROM) {
+		len += 9;
+	} else if (tr->flags & OW_TR_SKIPROM) {
+		len += 1;
+	}
+	return len;
+}
+
+/* Byte at pos of the transaction, read slots are 0xFF */
+static uint8_t OW_asyncByte(const OW_Transaction_t *tr, uint16_t pos)
+{
+	if (tr->flags & OW_TR_MATCHROM) {
+		if (pos == 0) return OW_CMD_MATCHROM;
+		if (pos < 9) return tr->rom[pos - 1];
+		pos -= 9;
+	} else if (tr->flags & OW_TR_SKIPROM) {
+		if (pos == 0) return OW_CMD_SKIPROM;
+		pos--;
 	}
+	if (pos < tr->txLen) return tr->tx[pos];
+	return 0xFF;
+}
+
+/**
+ * Starts RX and then TX of len slots, by DMA if it is linked.
+ * The engine goes on when both of them are completed: RXNE of the last echo
+ * comes before TC of the last byte, so TX may be still busy in RX callback.
+ */
+static HAL_StatusTypeDef OW_asyncTransfer(OneWire_t *ow, uint16_t len)
+{
+	UART_HandleTypeDef *huart = ow->huart;
+	HAL_StatusTypeDef status;
+
+	__HAL_UART_CLEAR_OREFLAG(huart);
+	ow->pending = 2;
+#ifdef HAL_DMA_MODULE_ENABLED
+	if (huart->hdmatx != NULL && huart->hdmarx != NULL) {
+		status = HAL_UART_Receive_DMA(huart, ow->slots, len);
+		if (status == HAL_OK) status = HAL_UART_Transmit_DMA(huart, ow->slots, len);
+		return status;
+	}
+#endif
+	status = HAL_UART_Receive_IT(huart, ow->slots, len);
+	if (status == HAL_OK) status = HAL_UART_Transmit_IT(huart, ow->slots, len);
+	return status;
+}
+
+static void OW_asyncBegin(OneWire_t *ow);
+
+/* Removes the head of the queue and starts the next one.
+ * A transaction which fails at once is finished by the loop, not by
+ * a nested call, so the stack does not grow with the queue. */
+static void OW_asyncFinish(OneWire_t *ow, uint8_t state)
+{
+	if (ow->finishing) {
+		ow->ended = state;
+		return;
+	}
+	ow->finishing = 1;
+
+	do {
+		OW_Transaction_t *tr = ow->head;
+
+		if (state == OW_TR_ERROR) {
+			if (ow->huart) {
+				HAL_UART_Abort(ow->huart);
+				OW_setBaudRate(ow->huart, OW_workSpeed(ow));
+			}
+			if (ow->status == HAL_OK) ow->status = HAL_ERROR;
+			OW_countStatus(ow);
+		}
+
+		ow->head = tr->next;
+		if (ow->head == NULL) ow->tail = NULL;
+		ow->phase = OW_PH_IDLE;
+
+		tr->state = state;
+		if (tr->done) tr->done(tr);
+
+		ow->ended = OW_TR_BUSY;
+		OW_asyncBegin(ow);
+		state = ow->ended;
+	} while (state != OW_TR_BUSY);
+
+	ow->finishing = 0;
+}
+
+/* Sends the next chunk of bytes or completes the transaction */
+static void OW_asyncData(OneWire_t *ow)
+{
+	OW_Transaction_t *tr = ow->head;
+	uint16_t len = OW_asyncLength(tr);
+
+	if (ow->pos >= len) {
+		OW_asyncFinish(ow, OW_TR_DONE);
+		return;
+	}
+
+	uint8_t chunk = len - ow->pos > OW_BULK_BYTES ? OW_BULK_BYTES : (uint8_t)(len - ow->pos);
+
+	uint8_t *bits = ow->slots;
+	for (uint8_t i=0;i<chunk;i++) {
+		bits = byteToBits(OW_asyncByte(tr, ow->pos + i), bits);
+	}
+	ow->chunk = chunk;
+	ow->phase = OW_PH_DATA;
+	ow->stats.bytes += chunk;
+	OW_countSlots(ow, chunk * 8);
+
+	if (OW_asyncTransfer(ow, chunk * 8) != HAL_OK) {
+		OW_asyncFinish(ow, OW_TR_ERROR);
+	}
+}
+
+static void OW_asyncBegin(OneWire_t *ow)
+{
+	OW_Transaction_t *tr = ow->head;
+	if (ow->phase != OW_PH_IDLE || tr == NULL) return;
+
+	tr->state = OW_TR_BUSY;
+	tr->crc = 0;
+	ow->started = HAL_GetTick();
+	ow->pos = 0;
+
+	//The engine runs on the interrupts of the UART
+	if (ow->huart == NULL) {
+		ow->status = HAL_ERROR;
+		OW_asyncFinish(ow, OW_TR_ERROR);
+		return;
+	}
+
+	if (!(tr->flags & OW_TR_RESET)) {
+		OW_asyncData(ow);
+		return;
+	}
+
+	if (ow->status != HAL_OK) {
+		OW_resetUART(ow);
+	}
+	ow->phase = OW_PH_RESET;
+	ow->speed = OW_SPEED_STANDARD;
+	ow->stats.resets++;
+	OW_setBaudRate(ow->huart, OW_RESET_SPEED);
+	ow->slots[0] = 0xF0;
+	if (OW_asyncTransfer(ow, 1) != HAL_OK) {
+		OW_asyncFinish(ow, OW_TR_ERROR);
+	}
+}
+
+static void OW_asyncStart(OneWire_t *ow)
+{
+	//The loop of OW_asyncFinish starts it
+	if (ow->finishing) return;
+	OW_asyncBegin(ow);
+}
+
+/* Both TX and RX of the transfer are completed */
+static void OW_asyncStep(OneWire_t *ow)
+{
+	OW_Transaction_t *tr = ow->head;
+
+	if (ow->phase == OW_PH_RESET) {
+		OW_setBaudRate(ow->huart, OW_WORK_SPEED);
+		if (ow->slots[0] == 0xF0) {
+			ow->stats.noPresence++;
+			OW_asyncFinish(ow, OW_TR_NOPRESENCE);
+			return;
+		}
+		OW_asyncData(ow);
+		return;
+	}
+
+	//Keep only the bytes which are read
+	uint16_t first = OW_asyncLength(tr) - tr->rxLen;
+	for (uint8_t i=0;i<ow->chunk;i++) {
+		uint16_t pos = ow->pos + i;
+		if (pos < first) continue;
+		uint8_t b = 0;
+		for (uint8_t j=0;j<8;j++) {
+			if (ow->slots[i*8 + j] == WIRE_1) b |= (1 << j);
+		}
+		tr->rx[pos - first] = b;
+		tr->crc = OW_CRC8_update(tr->crc, b);
+	}
+	ow->pos += ow->chunk;
+	OW_asyncData(ow);
+}
+
+void OW_asyncQueue(OneWire_t *ow, OW_Transaction_t *tr)
+{
+	tr->state = OW_TR_QUEUED;
+	tr->next = NULL;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (ow->tail) {
+		ow->tail->next = tr;
+	} else {
+		ow->head = tr;
+	}
+	ow->tail = tr;
+	OW_asyncStart(ow);
+	__set_PRIMASK(primask);
+}
+
+uint8_t OW_asyncPoll(OneWire_t *ow)
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (ow->phase != OW_PH_IDLE &&
+		(now - ow->started) > OW_BULK_TIMEOUT(OW_asyncLength(ow->head) * 8)) {
+		ow->status = HAL_TIMEOUT;
+		OW_asyncFinish(ow, OW_TR_ERROR);
+	}
+	__set_PRIMASK(primask);
+
+	return ow->head != NULL;
+}
+
+void OW_txCpltCallback(OneWire_t *ow, UART_HandleTypeDef *huart)
+{
+	if (huart != ow->huart || ow->phase == OW_PH_IDLE) return;
+	if (--ow->pending == 0) OW_asyncStep(ow);
+}
+
+void OW_rxCpltCallback(OneWire_t *ow, UART_HandleTypeDef *huart)
+{
+	if (huart != ow->huart || ow->phase == OW_PH_IDLE) return;
+	if (--ow->pending == 0) OW_asyncStep(ow);
 }
@@ -36,6 +36,7 @@ extern "C" {
  * https://stm32f4-discovery.net/2015/07/hal-library-05-onewire-for-stm32fxxx/
  * Unlike that library this one doesn't use delays.
  * It use system UART to communicate with OneWire device(s).
+ * Other slot engines work under the same API, see @ref OW_Transport_t.
  * 
  * UART must be set before calling this function
  * Settings of UART:
@@ -59,6 +60,7 @@ extern "C" {
  */
 
 #include "stm32f1xx_hal.h"
+#include "OneWireCrc.h"
 
 #define WIRE_1 0xFF
 #define WIRE_0 0x00
@@ -66,8 +68,36 @@ extern "C" {
 #define OW_RESET_SPEED 9600
 #define OW_WORK_SPEED 115200
 
+/**
+ * Overdrive: 0xF0 at 66600 baud is a 75us reset pulse (48...80us),
+ * at 1000000 baud 0xFF is a 1us read/write 1 slot and 0x00 is 9us write 0.
+ * The UART must be able to run at 1 Mbit/s from its bus clock.
+ */
+#define OW_OD_RESET_SPEED 66600
+#define OW_OD_WORK_SPEED 1000000
+
+/* Speed of @ref OneWire_t */
+#define OW_SPEED_STANDARD  0
+#define OW_SPEED_OVERDRIVE 1
+
 #define OW_TIMEOUT 5 //1 ms is enouph
 
+/**
+ * Maximum amount of bytes moved by one bulk transfer. Every byte of 1-Wire
+ * data takes 8 UART bytes (bit slots) in the buffer of @ref OneWire_t, so the
+ * default costs 72 bytes of RAM per bus and covers Match ROM (9 bytes) or
+ * the whole DS18B20 scratchpad in one transfer. Longer transfers are split.
+ */
+#ifndef OW_BULK_BYTES
+#define OW_BULK_BYTES 9
+#endif
+
+/* Bits returned by @ref OW_triplet */
+#define OW_TRIPLET_ID   0x01 /*!< The bit read first */
+#define OW_TRIPLET_CMP  0x02 /*!< Its complement */
+#define OW_TRIPLET_DIR  0x04 /*!< The direction written */
+#define OW_TRIPLET_NONE 0x03 /*!< No device answered, nothing written */
+
 /* OneWire commands */
 #define OW_CMD_RSCRATCHPAD			0xBE
 #define OW_CMD_WSCRATCHPAD			0x4E
@@ -75,30 +105,228 @@ extern "C" {
 #define OW_CMD_RECEEPROM			0xB8
 #define OW_CMD_RPWRSUPPLY			0xB4
 #define OW_CMD_SEARCHROM			0xF0
+#define OW_CMD_ALARMSEARCH			0xEC
 #define OW_CMD_READROM				0x33
 #define OW_CMD_MATCHROM			    0x55
 #define OW_CMD_SKIPROM				0xCC
+#define OW_CMD_ODSKIPROM			0x3C
+#define OW_CMD_ODMATCHROM			0x69
+
+/* Flags of @ref OW_Transaction_t */
+#define OW_TR_RESET     0x01 /*!< Start with reset, the transaction fails without presence */
+#define OW_TR_SKIPROM   0x02 /*!< Send Skip ROM after reset */
+#define OW_TR_MATCHROM  0x04 /*!< Send Match ROM and rom after reset */
+
+/* State of @ref OW_Transaction_t */
+#define OW_TR_DONE       0 /*!< Completed successfully */
+#define OW_TR_QUEUED     1
+#define OW_TR_BUSY       2
+#define OW_TR_NOPRESENCE 3 /*!< No device answered the reset */
+#define OW_TR_ERROR      4 /*!< UART error or timeout */
+
+struct OW_Transaction;
+typedef void (*OW_TransactionCallback_t)(struct OW_Transaction *tr);
+
+/**
+ * @brief  Asynchronous transaction: reset, ROM select, txLen bytes to send
+ * (the command goes first) and rxLen bytes to receive.
+ * @note   It must stay in memory until done, the engine keeps a pointer to it
+ */
+typedef struct OW_Transaction {
+	uint8_t flags;                  /*!< OW_TR_RESET, OW_TR_SKIPROM, OW_TR_MATCHROM */
+	const uint8_t *rom;             /*!< ROM for OW_TR_MATCHROM */
+	const uint8_t *tx;              /*!< Bytes to send */
+	uint8_t txLen;
+	uint8_t *rx;                    /*!< Buffer for the received bytes */
+	uint8_t rxLen;
+	OW_TransactionCallback_t done;  /*!< Called from the interrupt when done, could be NULL */
+	void *ctx;                      /*!< For the user of the callback */
+	volatile uint8_t state;         /*!< OW_TR_DONE ... OW_TR_ERROR, poll it if no callback */
+	uint8_t crc;                    /*!< CRC8 of the received bytes, 0 if they end with valid CRC */
+	struct OW_Transaction *next;    /*!< Private */
+} OW_Transaction_t;
+
+/**
+ * @brief  Takes the lock of a bus shared by several tasks, see @ref OW_setLock
+ * @param  ctx: the mutex given to OW_setLock
+ * @param  waitMs: 0 - don't wait, HAL_MAX_DELAY - wait as long as it takes
+ * @retval 1 - the caller has the bus
+ */
+typedef uint8_t (*OW_Lock_t)(void *ctx, uint32_t waitMs);
+typedef void (*OW_Unlock_t)(void *ctx);
+
+struct OneWire;
+
+/**
+ * @brief  Slot engine of a bus: the UART of @ref OW_init, a GPIO pin timed by a timer
+ * (OneWireGpio.h), a DS2480B bridge (OneWireDs2480.h) or anything else which makes
+ * the resets and the bit slots.
+ * The functions of this file build the bytes, the search and the ROM commands on it.
+ * Every function sets ow->status: HAL_OK or why it failed, the next reset may recover.
+ * The engine keeps its own data in ow->transportCtx.
+ *
+ * The optional functions are NULL if the engine can't do it faster than by the slots.
+ * Those it has are used at once: the bytes go by touchBytes, then by touch in chunks of
+ * bulkSlots, then bit by bit; the search goes by search, then by triplet, then by touch.
+ */
+typedef struct {
+	/** Reset at OW_SPEED_STANDARD or OW_SPEED_OVERDRIVE, the slots go at ow->speed after it.
+	 *  Returns 1 if some device answered */
+	uint8_t (*reset)(struct OneWire *ow, uint8_t speed);
+	/** len slots, WIRE_1 (read or write 1) or WIRE_0 each. What the line had is put back
+	 *  in place: WIRE_1 only if nobody pulled it low */
+	void (*touch)(struct OneWire *ow, uint8_t *slots, uint16_t len);
+	/** Optional: len bytes at once, 0xFF reads a byte. The bytes read are put back in place */
+	void (*touchBytes)(struct OneWire *ow, uint8_t *bytes, uint8_t len);
+	/** Optional: one step of the search, see @ref OW_triplet */
+	uint8_t (*triplet)(struct OneWire *ow, uint8_t direction);
+	/** Optional: all 64 steps of the search after its command. rom: in - the direction
+	 *  taken on a discrepancy at every bit, out - the ROM found. diff: out - the bits the
+	 *  devices differed in. A bit nobody answered reads as 1, only the CRC of rom tells it */
+	void (*search)(struct OneWire *ow, uint8_t *rom, uint8_t *diff);
+	/** Optional: the slots go at the speed from now on. NULL if touch looks at ow->speed */
+	void (*setSpeed)(struct OneWire *ow, uint8_t speed);
+	uint16_t bulkSlots;   /*!< Slots touch moves at once, less than 8 - the bytes go bit by bit */
+	uint32_t resetNs[2];  /*!< Time of the reset at both speeds, for busyMs of @ref OW_getStats */
+	uint32_t slotNs[2];   /*!< Time of the slot at both speeds */
+} OW_Transport_t;
+
+/**
+ * @brief  Counters of a bus since @ref OW_init, see @ref OW_getStats
+ * @note   They wrap around, take the difference of two snapshots or read them with reset
+ */
+typedef struct {
+	uint32_t resets;        /*!< Reset pulses, also of the asynchronous engine */
+	uint32_t noPresence;    /*!< Resets no device answered */
+	uint32_t slots;         /*!< Bit slots, one UART byte each on the UART */
+	uint32_t odResets;      /*!< Resets at overdrive speed, counted in resets too */
+	uint32_t odSlots;       /*!< Slots at overdrive speed, counted in slots too */
+	uint32_t bytes;         /*!< Bytes of data sent and received */
+	uint32_t timeouts;      /*!< Transfers which did not end in time */
+	uint32_t errors;        /*!< Other failures: overrun, lost echoes, HAL busy, line held low */
+	uint32_t crcErrors;     /*!< Bad CRC reported by the device drivers, see Ds18B20.h */
+	uint32_t uartResets;    /*!< Reinitializations of the UART by @ref OW_resetUART */
+	uint32_t busyMs;        /*!< Time the bus was busy, from resets and slots at the times of the transport */
+} OW_Stats_t;
 
 /**
  * @brief  OneWire working struct
  * @note   Except ROM_NO member, everything is fully private and should not be touched by user
  */
-typedef struct {
+typedef struct OneWire {
 	uint8_t LastDiscrepancy;       /*!< Search private */
 	uint8_t LastFamilyDiscrepancy; /*!< Search private */
 	uint8_t LastDeviceFlag;        /*!< Search private */
 	uint8_t ROM_NO[8];             /*!< 8-bytes address of last search device */
-	UART_HandleTypeDef *huart;
+	UART_HandleTypeDef *huart;        /*!< NULL if the bus is not on a UART */
 	HAL_StatusTypeDef status;
+	const OW_Transport_t *transport;  /*!< The slot engine, see @ref OW_setTransport */
+	void *transportCtx;
+	uint8_t speed;                    /*!< OW_SPEED_STANDARD or OW_SPEED_OVERDRIVE */
+	uint8_t slots[OW_BULK_BYTES * 8]; /*!< Bit slots of a bulk transfer, TX and RX in place */
+	OW_Transaction_t *volatile head;  /*!< Queue of asynchronous transactions */
+	OW_Transaction_t *tail;
+	volatile uint8_t phase;           /*!< What the asynchronous engine waits for */
+	volatile uint8_t pending;         /*!< TX and RX completions to wait */
+	uint16_t pos;                     /*!< Position in the bytes of the transaction */
+	uint8_t chunk;                    /*!< Bytes in the current transfer */
+	uint32_t started;                 /*!< Tick when the transaction started */
+	uint8_t finishing;                /*!< OW_asyncFinish is running its loop */
+	uint8_t ended;                    /*!< State of a transaction finished inside the loop */
+	OW_Stats_t stats;                 /*!< busyMs is calculated by @ref OW_getStats */
+	OW_Lock_t lock;                   /*!< NULL - one task uses the bus, see @ref OW_setLock */
+	OW_Unlock_t unlock;
+	void *lockCtx;
 } OneWire_t;
 
 /**
  * @brief Initialization of library. Do it before using
+ * @note If both huart->hdmatx and huart->hdmarx are linked (DMA channels set
+ * to normal mode, byte width) the bytes are sent and received by DMA: one
+ * transfer of 8 bit slots per byte for up to @ref OW_BULK_BYTES bytes.
+ * Otherwise every bit is sent separately.
  * @par ow - pointer to OneWire_t structure
- * @par huart pointer to UART handle
+ * @par huart pointer to UART handle, NULL - the transport set by @ref OW_setTransport
+ * before the init. Without either of them every operation on the bus fails with
+ * status HAL_ERROR.
  */
 void OW_init(OneWire_t *ow, UART_HandleTypeDef *huart);
 
+/**
+ * @brief Puts the bus on another slot engine than the UART. Call @ref OW_init with
+ * huart NULL after it, the init keeps the transport then.
+ * The asynchronous engine (@ref OW_asyncQueue) needs the UART, its transactions fail
+ * on other transports.
+\code
+OW_Gpio_t pin = { GPIOB, GPIO_PIN_0, &htim2 };
+OW_setTransport(&ow, &OW_gpioTransport, &pin);
+OW_init(&ow, NULL);
+\endcode
+ * @par ow - pointer to OneWire_t structure
+ * @par transport - the functions of the engine, they must stay in memory
+ * @par ctx - data of the engine, ow->transportCtx
+ */
+void OW_setTransport(OneWire_t *ow, const OW_Transport_t *transport, void *ctx);
+
+/**
+ * @brief Changes the baud rate of a running UART by its BRR, without the extra byte
+ * HAL_UART_DeInit and HAL_UART_Init would put on the line
+ * @par huart - pointer to UART handle
+ * @par bdr - the baud rate
+ */
+void OW_setBaudRate(UART_HandleTypeDef *huart, uint32_t bdr);
+
+/**
+ * @brief Snapshot of the counters of the bus. They are updated from the interrupts
+ * too, so they are copied with the interrupts disabled.
+ * @par ow - pointer to OneWire_t structure
+ * @par *stats - the counters to fill
+ * @par reset - 1 to start counting from zero after the copy
+ */
+void OW_getStats(OneWire_t *ow, OW_Stats_t *stats, uint8_t reset);
+
+/**
+ * @brief Sets the lock of a bus used by several tasks of an RTOS. The functions of this
+ * file don't take it: a task takes it for a whole transaction (reset, select, command, data)
+ * with @ref OW_lock or @ref OW_tryLock. The device drivers take it for every transaction of
+ * theirs. @ref OW_init keeps it. Without a lock (bare metal) the calls do nothing.
+\code
+//FreeRTOS
+uint8_t busLock(void *m, uint32_t waitMs) {
+  return xSemaphoreTake((SemaphoreHandle_t)m, waitMs == HAL_MAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+void busUnlock(void *m) {
+  xSemaphoreGive((SemaphoreHandle_t)m);
+}
+
+OW_setLock(&ow, busLock, busUnlock, xSemaphoreCreateMutex());
+\endcode
+ * @par ow - pointer to OneWire_t structure
+ * @par lock, unlock - the hooks, NULL for no lock
+ * @par ctx - the mutex passed to the hooks
+ */
+void OW_setLock(OneWire_t *ow, OW_Lock_t lock, OW_Unlock_t unlock, void *ctx);
+
+/**
+ * @brief Takes the lock of the bus, waits while another task has it
+ * @par ow - pointer to OneWire_t structure
+ * @return 1 - taken, 0 - the hook failed
+ */
+uint8_t OW_lock(OneWire_t *ow);
+
+/**
+ * @brief Takes the lock of the bus if it is free, never waits
+ * @par ow - pointer to OneWire_t structure
+ * @return 1 - taken, 0 - another task has the bus
+ */
+uint8_t OW_tryLock(OneWire_t *ow);
+
+/**
+ * @brief Gives the lock of the bus back
+ * @par ow - pointer to OneWire_t structure
+ */
+void OW_unlock(OneWire_t *ow);
+
 /**
  * @brief Each communication with OneWire bus must start with
  * this function.
@@ -107,6 +335,72 @@ void OW_init(OneWire_t *ow, UART_HandleTypeDef *huart);
  */
 uint8_t OW_reset(OneWire_t *ow);
 
+/**
+ * @brief Reset at overdrive speed, only the devices put to overdrive by
+ * @ref OW_overdriveSkip or @ref OW_overdriveSelect answer it and stay in overdrive.
+ * If nobody answers the bus falls back to the standard speed with @ref OW_reset.
+ * @par	   ow - pointer to OneWire_t structure
+ * @return 1 - some devices discovered, 0 - no devices on the bus
+ */
+uint8_t OW_resetOverdrive(OneWire_t *ow);
+
+/**
+ * @brief Overdrive Skip ROM: all overdrive capable devices go to overdrive,
+ * the bus runs at overdrive speed until the next @ref OW_reset.
+ * Other devices ignore the bus until the next standard reset.
+ * Call it after @ref OW_reset.
+ * @par	   ow - pointer to OneWire_t structure
+ */
+void OW_overdriveSkip(OneWire_t *ow);
+
+/**
+ * @brief Overdrive Match ROM: the device goes to overdrive, the ROM is sent at
+ * overdrive speed already. Call it after @ref OW_reset.
+ * @par	   ow - pointer to OneWire_t structure
+ * @par    *addr: Pointer to first location of 8-bytes long ROM address
+ */
+void OW_overdriveSelect(OneWire_t *ow, uint8_t *addr);
+
+/**
+ * @brief   Send one bit (one slot) through OneWire bus
+ * @par	    ow - pointer to OneWire_t structure
+ * @par     b - bit to send
+ */
+void OW_sendBit(OneWire_t *ow, uint8_t b);
+
+/**
+ * @brief   Receive one bit: one read slot
+ * @par	    ow - pointer to OneWire_t structure
+ * @return  the bit, 1 if no device pulled the bus low
+ */
+uint8_t OW_receiveBit(OneWire_t *ow);
+
+/**
+ * @brief   Full-duplex exchange of bit slots in one transfer. On the UART it goes
+ * by DMA if it is linked or by interrupts otherwise, every byte of slots is one
+ * UART byte. WIRE_1 is a read or write 1 slot, WIRE_0 is write 0. The echoes
+ * replace the slots in place, a read slot gives 1 only if its echo is still WIRE_1.
+ * @note    Check ow->status for HAL_OK: on error the transfer is aborted and
+ * the next @ref OW_reset reinitializes the UART.
+ * @par	    ow - pointer to OneWire_t structure
+ * @par     *slots - slots to send, the echoes on return
+ * @par     len - amount of slots
+ */
+void OW_touch(OneWire_t *ow, uint8_t *slots, uint16_t len);
+
+/**
+ * @brief   One step of the ROM search: two read slots in one transfer, then the
+ * direction slot at once. On the UART the echoes of both read slots are already
+ * received, so the direction is chosen without a new receive. A transport without
+ * triplet makes it of two touches.
+ * @par	    ow - pointer to OneWire_t structure
+ * @par     direction - bit to write if the devices differ (both read bits are 0)
+ * @return  OW_TRIPLET_ID and OW_TRIPLET_CMP for the read bits, OW_TRIPLET_DIR
+ * if 1 was written. OW_TRIPLET_NONE if no device answered or the UART failed,
+ * the direction slot is not sent then.
+ */
+uint8_t OW_triplet(OneWire_t *ow, uint8_t direction);
+
 /**
  * @brief   Send one byte through OneWire bus
  * @par	    ow - pointer to OneWire_t structure
@@ -137,6 +431,16 @@ uint8_t OW_receiveByte(OneWire_t *ow);
  */
 void OW_receiveBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len);
 
+/**
+ * @brief   Receive some bytes from OneWire bus calculating CRC8 as they come
+ * @par	    ow - pointer to OneWire_t structure
+ * @par     *bytes - array to fill
+ * @par     len - length of bytes
+ * @par     crc - CRC8 of the bytes before, 0 to start
+ * @return  CRC8 of all the bytes, 0 if the last byte is valid CRC of the previous ones
+ */
+uint8_t OW_receiveBytesCRC8(OneWire_t *ow, uint8_t *bytes, uint8_t len, uint8_t crc);
+
 /**
  * @brief  Calculates 8-bit CRC for 1-wire devices
  * @par    *addr: Pointer to 8-bit array of data to calculate CRC
@@ -193,6 +497,63 @@ uint8_t OW_search(OneWire_t* ow, uint8_t command);
  */
 uint8_t OW_next(OneWire_t* ow);
 
+/**
+ * @brief  Starts the search from the first device of the family. The devices of a family
+ * come one after another, continue with @ref OW_nextInFamily. The other families are not searched.
+\code
+status = OW_targetFamily(&OneWireStruct, 0x28);
+while (status) {
+	OW_getFullROM(&OneWireStruct, ROM_Array_Pointer);
+	status = OW_nextInFamily(&OneWireStruct);
+}
+\endcode
+ * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
+ * @param  family: family code, the first byte of ROM
+ * @retval  Device status:
+ *            - 0: No devices of the family
+ *            - > 0: Device detected
+ */
+uint8_t OW_targetFamily(OneWire_t *ow, uint8_t family);
+
+/**
+ * @brief  Reads next device of the same family as the last one found
+ * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
+ * @retval  Device status:
+ *            - 0: No devices of the family any more, the search is not done
+ *            - > 0: New device detected
+ */
+uint8_t OW_nextInFamily(OneWire_t *ow);
+
+/**
+ * @brief  Continues the search from the next family after the last device found.
+ * The rest of the devices of its family are skipped.
+ * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
+ * @retval  Device status:
+ *            - 0: No devices of other families any more
+ *            - > 0: Device detected
+ */
+uint8_t OW_skipFamily(OneWire_t *ow);
+
+/**
+ * @brief  Starts alarm search: only the devices with the alarm flag set answer it.
+ * It is used the same way as @ref OW_first and @ref OW_next
+ * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
+ * @retval  Device status:
+ *            - 0: No devices in alarm
+ *            - > 0: Device detected
+ */
+uint8_t OW_firstAlarm(OneWire_t *ow);
+
+/**
+ * @brief  Reads next device in alarm
+ * @note   Use @ref OW_firstAlarm to start searching
+ * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
+ * @retval  Device status:
+ *            - 0: No devices in alarm any more
+ *            - > 0: New device detected
+ */
+uint8_t OW_nextAlarm(OneWire_t *ow);
+
 /**
  * @brief  Gets ROM number from device from search
  * @param  *OneWireStruct: Pointer to @ref OneWire_t working onewire
@@ -222,6 +583,51 @@ void OW_select(OneWire_t* ow, uint8_t* addr);
  */
 void OW_selectWithPointer(OneWire_t* ow, uint8_t* ROM);
 
+/**
+ * @brief  Queues an asynchronous transaction. If the bus is idle it starts at once.
+ * The transaction is driven by UART interrupts, the caller doesn't wait.
+ * On a bus without UART (@ref OW_setTransport) it ends with OW_TR_ERROR at once.
+ * Don't call blocking functions for the same bus until the queue is empty.
+\code
+uint8_t cmd = 0x44;
+OW_Transaction_t tr = { .flags = OW_TR_RESET | OW_TR_SKIPROM, .tx = &cmd, .txLen = 1 };
+OW_asyncQueue(&ow, &tr);
+//...
+if (tr.state == OW_TR_DONE) { }
+\endcode
+ * @param  *ow: Pointer to @ref OneWire_t working onewire
+ * @param  *tr: Transaction, its state is set to OW_TR_QUEUED
+ */
+void OW_asyncQueue(OneWire_t *ow, OW_Transaction_t *tr);
+
+/**
+ * @brief  Checks the timeout of the running transaction. Call it from the main loop,
+ * a lost interrupt would block the queue forever otherwise.
+ * @param  *ow: Pointer to @ref OneWire_t working onewire
+ * @retval 1 - there are transactions queued or running, 0 - the bus is idle
+ */
+uint8_t OW_asyncPoll(OneWire_t *ow);
+
+/**
+ * @brief  Call it from HAL_UART_TxCpltCallback, it ignores other UARTs
+ * @param  *ow: Pointer to @ref OneWire_t working onewire
+ * @param  *huart: the UART from the callback
+ */
+void OW_txCpltCallback(OneWire_t *ow, UART_HandleTypeDef *huart);
+
+/**
+ * @brief  Call it from HAL_UART_RxCpltCallback, it ignores other UARTs
+\code
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	OW_rxCpltCallback(&ds18b20.ow, huart);
+}
+\endcode
+ * @param  *ow: Pointer to @ref OneWire_t working onewire
+ * @param  *huart: the UART from the callback
+ */
+void OW_rxCpltCallback(OneWire_t *ow, UART_HandleTypeDef *huart);
+
 /* C++ detection */
 #ifdef __cplusplus
 }
@@ -0,0 +1,77 @@
+#include "OneWireCrc.h"
+
+/**
+ * One bit of CRC8 shifted out. CRC8 is linear: the CRC of a byte is XOR of
+ * the CRCs of its bits, so the table is built from the CRCs of 0x01...0x80.
+ * The CRC of 0x80 is the polynomial itself, each lower bit goes one more shift.
+ */
+#define OW_CRC8_SHIFT(c) (((c) & 0x01) ? (((c) >> 1) ^ 0x8C) : ((c) >> 1))
+
+enum {
+    OW_CRC8_BIT7 = 0x8C,
+    OW_CRC8_BIT6 = OW_CRC8_SHIFT(OW_CRC8_BIT7),
+    OW_CRC8_BIT5 = OW_CRC8_SHIFT(OW_CRC8_BIT6),
+    OW_CRC8_BIT4 = OW_CRC8_SHIFT(OW_CRC8_BIT5),
+    OW_CRC8_BIT3 = OW_CRC8_SHIFT(OW_CRC8_BIT4),
+    OW_CRC8_BIT2 = OW_CRC8_SHIFT(OW_CRC8_BIT3),
+    OW_CRC8_BIT1 = OW_CRC8_SHIFT(OW_CRC8_BIT2),
+    OW_CRC8_BIT0 = OW_CRC8_SHIFT(OW_CRC8_BIT1)
+};
+
+#define OW_CRC8_IF(i, bit, crc) (((i) & (bit)) ? (crc) : 0)
+#define OW_CRC8_T(i) (uint8_t)( \
+    OW_CRC8_IF(i, 0x01, OW_CRC8_BIT0) ^ OW_CRC8_IF(i, 0x02, OW_CRC8_BIT1) ^ \
+    OW_CRC8_IF(i, 0x04, OW_CRC8_BIT2) ^ OW_CRC8_IF(i, 0x08, OW_CRC8_BIT3) ^ \
+    OW_CRC8_IF(i, 0x10, OW_CRC8_BIT4) ^ OW_CRC8_IF(i, 0x20, OW_CRC8_BIT5) ^ \
+    OW_CRC8_IF(i, 0x40, OW_CRC8_BIT6) ^ OW_CRC8_IF(i, 0x80, OW_CRC8_BIT7))
+#define OW_CRC8_T4(i)   OW_CRC8_T(i), OW_CRC8_T((i) + 1), OW_CRC8_T((i) + 2), OW_CRC8_T((i) + 3)
+#define OW_CRC8_T16(i)  OW_CRC8_T4(i), OW_CRC8_T4((i) + 4), OW_CRC8_T4((i) + 8), OW_CRC8_T4((i) + 12)
+#define OW_CRC8_T64(i)  OW_CRC8_T16(i), OW_CRC8_T16((i) + 16), OW_CRC8_T16((i) + 32), OW_CRC8_T16((i) + 48)
+
+#ifdef OW_CRC8_NIBBLE
+const uint8_t OW_CRC8_tableLow[16] = { OW_CRC8_T16(0) };
+const uint8_t OW_CRC8_tableHigh[16] = {
+    OW_CRC8_T(0x00), OW_CRC8_T(0x10), OW_CRC8_T(0x20), OW_CRC8_T(0x30),
+    OW_CRC8_T(0x40), OW_CRC8_T(0x50), OW_CRC8_T(0x60), OW_CRC8_T(0x70),
+    OW_CRC8_T(0x80), OW_CRC8_T(0x90), OW_CRC8_T(0xA0), OW_CRC8_T(0xB0),
+    OW_CRC8_T(0xC0), OW_CRC8_T(0xD0), OW_CRC8_T(0xE0), OW_CRC8_T(0xF0)
+};
+#else
+const uint8_t OW_CRC8_table[256] = {
+    OW_CRC8_T64(0), OW_CRC8_T64(64), OW_CRC8_T64(128), OW_CRC8_T64(192)
+};
+#endif
+
+/// Parity of a nibble
+static const uint8_t oddparity[16] = { 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 };
+
+uint16_t OW_CRC16_update(uint16_t crc, uint8_t data)
+{
+    uint16_t cdata = (data ^ crc) & 0xFF;
+    crc >>= 8;
+
+    if (oddparity[cdata & 0x0F] ^ oddparity[cdata >> 4]) {
+        crc ^= 0xC001;
+    }
+
+    cdata <<= 6;
+    crc ^= cdata;
+    cdata <<= 1;
+    crc ^= cdata;
+
+    return crc;
+}
+
+uint16_t OW_CRC16(const uint8_t *data, uint16_t len, uint16_t crc)
+{
+    while (len--) {
+        crc = OW_CRC16_update(crc, *data++);
+    }
+    return crc;
+}
+
+uint8_t OW_CRC16_check(const uint8_t *data, uint16_t len, const uint8_t *inverted_crc, uint16_t crc)
+{
+    crc = ~OW_CRC16(data, len, crc);
+    return (crc & 0xFF) == inverted_crc[0] && (crc >> 8) == inverted_crc[1];
+}
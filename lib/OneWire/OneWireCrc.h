@@ -0,0 +1,110 @@
+#ifndef ONE_WIRE_CRC_h
+#define ONE_WIRE_CRC_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireCrc.h
+ * @brief          : CRC8 and CRC16 of 1-Wire devices
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"), 
+ * to deal in the Software without restriction, including without limitation 
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom 
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included 
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR 
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, 
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE 
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * CRC8 (x^8 + x^5 + x^4 + 1) of ROMs and scratchpads and CRC16
+ * (x^16 + x^15 + x^2 + 1) of memory and switch devices.
+ * 
+ * CRC8 is calculated by a table of 256 bytes in flash, it is made by the 
+ * compiler. Define OW_CRC8_NIBBLE to use two tables of 16 bytes instead,
+ * it is a bit slower.
+ * 
+ * Both could be calculated byte by byte as the bytes come:
+\code
+uint8_t crc = 0;
+for (i = 0; i < 9; i++) {
+    crc = OW_CRC8_update(crc, data[i]);
+}
+//crc == 0 - the data with its CRC at the end is valid
+\endcode
+ */
+
+#include <stdint.h>
+
+#ifdef OW_CRC8_NIBBLE
+extern const uint8_t OW_CRC8_tableLow[16];
+extern const uint8_t OW_CRC8_tableHigh[16];
+#else
+extern const uint8_t OW_CRC8_table[256];
+#endif
+
+/**
+ * @brief  Adds one byte to CRC8
+ * @par    crc - CRC of the previous bytes, start with 0
+ * @par    data - next byte
+ * @return new CRC
+ */
+inline static uint8_t OW_CRC8_update(uint8_t crc, uint8_t data)
+{
+#ifdef OW_CRC8_NIBBLE
+    uint8_t i = crc ^ data;
+    return OW_CRC8_tableLow[i & 0x0F] ^ OW_CRC8_tableHigh[i >> 4];
+#else
+    return OW_CRC8_table[crc ^ data];
+#endif
+}
+
+/**
+ * @brief  Adds one byte to CRC16
+ * @par    crc - CRC of the previous bytes, start with 0
+ * @par    data - next byte
+ * @return new CRC
+ */
+uint16_t OW_CRC16_update(uint16_t crc, uint8_t data);
+
+/**
+ * @brief  Calculates CRC16 of the array
+ * @par    *data - the bytes
+ * @par    len - amount of the bytes
+ * @par    crc - CRC of the previous bytes, 0 for the first ones
+ * @return CRC16
+ */
+uint16_t OW_CRC16(const uint8_t *data, uint16_t len, uint16_t crc);
+
+/**
+ * @brief  Checks the bytes against CRC16 sent by a device. The devices send
+ * CRC16 inverted, least significant byte first.
+ * @par    *data - the bytes
+ * @par    len - amount of the bytes
+ * @par    *inverted_crc - two bytes of the CRC as they are received
+ * @par    crc - CRC of the previous bytes, often it's the command and the address
+ * @return 1 - CRC is valid
+ */
+uint8_t OW_CRC16_check(const uint8_t *data, uint16_t len, const uint8_t *inverted_crc, uint16_t crc);
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_CRC_h */
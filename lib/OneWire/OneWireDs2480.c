@@ -0,0 +1,317 @@
+#include "OneWireDs2480.h"
+
+/* Mode switches */
+#define DS2480_DATA_MODE    0xE1
+#define DS2480_COMMAND_MODE 0xE3
+
+/* Commands, the speed is or-ed in */
+#define DS2480_RESET        0xC1
+#define DS2480_BIT          0x81 /*!< Bit 4 - the bit to write */
+#define DS2480_SEARCH_ON    0xB1
+#define DS2480_SEARCH_OFF   0xA1
+
+/* Speeds of the commands */
+#define DS2480_REGULAR      0x00
+#define DS2480_FLEX         0x04
+#define DS2480_OVERDRIVE    0x08
+
+/* Configuration: 0 ppp vvv 1, the answer is the same with bit 0 clear */
+#define DS2480_CONFIG(param, value) (0x01 | ((param) << 4) | ((value) << 1))
+/* Reading it: 0 000 ppp 1, the answer is 0 000 vvv 0 */
+#define DS2480_READ(param)          (0x01 | ((param) << 1))
+#define DS2480_PDSRC        1
+#define DS2480_W1LT         4
+#define DS2480_DSO          5
+#define DS2480_RBR          7
+
+/* Answer to the reset: 11 0 rrr pp, pp - the bus */
+#define DS2480_RESET_MASK     0xC0
+#define DS2480_RESET_SHORT    0x00
+#define DS2480_RESET_NOBODY   0x03
+
+/* Slots to a UART exchange, the 0xE3 of the data go twice */
+#define DS2480_CHUNK 8
+
+/* Time of the slots for the timeouts, us */
+#define DS2480_SLOT_US(ow) ((ow)->speed == OW_SPEED_OVERDRIVE ? 10 : 70)
+
+void OW_initDs2480(OW_Ds2480_t *bridge, UART_HandleTypeDef *huart)
+{
+	bridge->huart = huart;
+	bridge->baudRate = 115200;
+	bridge->flex = 1;
+	bridge->slewRate = OW_DS2480_SLEW_1V37;
+	bridge->write1Low = OW_DS2480_W1LT_US(10);
+	bridge->sampleOffset = OW_DS2480_DSO_US(8);
+	bridge->found = 0;
+	bridge->data = 0;
+}
+
+static uint8_t OW_ds2480Speed(OW_Ds2480_t *b, uint8_t speed)
+{
+	if (speed == OW_SPEED_OVERDRIVE) return DS2480_OVERDRIVE;
+	return b->flex ? DS2480_FLEX : DS2480_REGULAR;
+}
+
+static uint8_t OW_ds2480Rbr(uint32_t baud)
+{
+	if (baud >= 115200) return 3;
+	if (baud >= 57600) return 2;
+	if (baud >= 19200) return 1;
+	return 0;
+}
+
+/* Starts RX of the answers before TX of the bytes, the bridge answers as soon as it can */
+static void OW_ds2480Start(OneWire_t *ow, uint8_t *tx, uint16_t txLen, uint8_t *rx, uint16_t rxLen)
+{
+	UART_HandleTypeDef *huart = ((OW_Ds2480_t*)ow->transportCtx)->huart;
+
+	__HAL_UART_CLEAR_OREFLAG(huart);
+	ow->status = HAL_OK;
+	if (rxLen) ow->status = HAL_UART_Receive_IT(huart, rx, rxLen);
+	if (ow->status == HAL_OK) ow->status = HAL_UART_Transmit_IT(huart, tx, txLen);
+}
+
+/* Waits till TX (gState) or RX (RxState) is done */
+static void OW_ds2480Wait(OneWire_t *ow, volatile HAL_UART_StateTypeDef *state, uint32_t timeout)
+{
+	uint32_t start = HAL_GetTick();
+	while (ow->status == HAL_OK && *state != HAL_UART_STATE_READY) {
+		if ((HAL_GetTick() - start) > timeout) ow->status = HAL_TIMEOUT;
+	}
+}
+
+/* Waits for the end of the exchange. On a failure the bridge is found again by the next reset */
+static void OW_ds2480End(OneWire_t *ow, uint32_t timeout)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+
+	OW_ds2480Wait(ow, &b->huart->gState, timeout);
+	OW_ds2480Wait(ow, &b->huart->RxState, timeout);
+	if (ow->status == HAL_OK && b->huart->ErrorCode != HAL_UART_ERROR_NONE) {
+		ow->status = HAL_ERROR;
+	}
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(b->huart);
+		b->found = 0;
+	}
+}
+
+/* The bytes of both ways at the baud rate plus the time on the bus */
+static uint32_t OW_ds2480Timeout(OW_Ds2480_t *b, uint16_t bytes, uint32_t busUs)
+{
+	return OW_TIMEOUT + (uint32_t)bytes * 10000 / b->baudRate + busUs / 1000 + 1;
+}
+
+static void OW_ds2480Exchange(OneWire_t *ow, uint8_t *tx, uint16_t txLen, uint8_t *rx, uint16_t rxLen, uint32_t busUs)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+
+	OW_ds2480Start(ow, tx, txLen, rx, rxLen);
+	if (ow->status != HAL_OK) {
+		HAL_UART_Abort(b->huart);
+		b->found = 0;
+		return;
+	}
+	OW_ds2480End(ow, OW_ds2480Timeout(b, txLen + rxLen, busUs));
+}
+
+/* Puts the command mode switch in tx if the bridge is in the data mode */
+static uint8_t OW_ds2480Command(OW_Ds2480_t *b, uint8_t *tx)
+{
+	if (!b->data) return 0;
+	b->data = 0;
+	tx[0] = DS2480_COMMAND_MODE;
+	return 1;
+}
+
+/* Puts the data mode switch in tx if the bridge is in the command mode */
+static uint8_t OW_ds2480Data(OW_Ds2480_t *b, uint8_t *tx)
+{
+	if (b->data) return 0;
+	b->data = 1;
+	tx[0] = DS2480_DATA_MODE;
+	return 1;
+}
+
+/**
+ * Break, timing byte, parameters, baud rate. The answer to the baud rate comes
+ * at the new rate, it is thrown away and the rate is read back instead.
+ */
+static uint8_t OW_ds2480Find(OneWire_t *ow)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	UART_HandleTypeDef *huart = b->huart;
+	uint8_t rbr = OW_ds2480Rbr(b->baudRate);
+	uint8_t tx[3], rx[3];
+
+	HAL_UART_Abort(huart);
+	b->found = 0;
+	b->data = 0;
+
+	//0x00 at 4800 holds the line low longer than any byte at 9600, it is a break
+	tx[0] = 0x00;
+	OW_setBaudRate(huart, 4800);
+	ow->status = HAL_UART_Transmit(huart, tx, 1, OW_TIMEOUT);
+	HAL_Delay(2);
+
+	//The bridge measures the timing byte and does not answer it
+	tx[0] = DS2480_RESET | DS2480_FLEX;
+	OW_setBaudRate(huart, 9600);
+	if (ow->status == HAL_OK) ow->status = HAL_UART_Transmit(huart, tx, 1, OW_TIMEOUT);
+	HAL_Delay(1);
+	if (ow->status != HAL_OK) return 0;
+
+	tx[0] = DS2480_CONFIG(DS2480_PDSRC, b->slewRate & 0x07);
+	tx[1] = DS2480_CONFIG(DS2480_W1LT, b->write1Low & 0x07);
+	tx[2] = DS2480_CONFIG(DS2480_DSO, b->sampleOffset & 0x07);
+	OW_ds2480Exchange(ow, tx, 3, rx, 3, 0);
+	for (uint8_t i = 0; ow->status == HAL_OK && i < 3; i++) {
+		if (rx[i] != (tx[i] & 0xFE)) ow->status = HAL_ERROR;
+	}
+	if (ow->status != HAL_OK) return 0;
+
+	tx[0] = DS2480_CONFIG(DS2480_RBR, rbr);
+	ow->status = HAL_UART_Transmit(huart, tx, 1, OW_TIMEOUT);
+	HAL_Delay(1);
+	OW_setBaudRate(huart, b->baudRate);
+	HAL_UART_Receive(huart, rx, 1, 0);
+
+	tx[0] = DS2480_READ(DS2480_RBR);
+	if (ow->status == HAL_OK) OW_ds2480Exchange(ow, tx, 1, rx, 1, 0);
+	if (ow->status == HAL_OK && rx[0] != (rbr << 1)) ow->status = HAL_ERROR;
+	if (ow->status != HAL_OK) return 0;
+
+	b->found = 1;
+	return 1;
+}
+
+static uint8_t OW_ds2480Reset(OneWire_t *ow, uint8_t speed)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	uint8_t tx[2], rx;
+
+	//A bridge which lost its settings (brown-out) doesn't answer, it is found again at once
+	for (uint8_t tries = 0; tries < 2; tries++) {
+		if (!b->found && !OW_ds2480Find(ow)) return 0;
+
+		uint8_t n = OW_ds2480Command(b, tx);
+		tx[n++] = DS2480_RESET | OW_ds2480Speed(b, speed);
+		OW_ds2480Exchange(ow, tx, n, &rx, 1, 1000);
+		if (ow->status == HAL_OK) break;
+	}
+	if (ow->status != HAL_OK) return 0;
+
+	if ((rx & DS2480_RESET_MASK) != DS2480_RESET_MASK) {
+		//Not an answer to the reset, the bridge is lost
+		ow->status = HAL_ERROR;
+		b->found = 0;
+		return 0;
+	}
+	if ((rx & 0x03) == DS2480_RESET_SHORT) {
+		ow->status = HAL_ERROR;
+		return 0;
+	}
+	return (rx & 0x03) != DS2480_RESET_NOBODY;
+}
+
+/* Single bit commands, DS2480_CHUNK in one exchange */
+static void OW_ds2480Touch(OneWire_t *ow, uint8_t *slots, uint16_t len)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	uint8_t speed = OW_ds2480Speed(b, ow->speed);
+	uint8_t tx[1 + DS2480_CHUNK], rx[DS2480_CHUNK];
+
+	ow->status = HAL_OK;
+	while (len) {
+		uint8_t chunk = len > DS2480_CHUNK ? DS2480_CHUNK : len;
+		uint8_t n = OW_ds2480Command(b, tx);
+		for (uint8_t i = 0; i < chunk; i++) {
+			tx[n++] = DS2480_BIT | speed | (slots[i] == WIRE_1 ? 0x10 : 0);
+		}
+		OW_ds2480Exchange(ow, tx, n, rx, chunk, chunk * DS2480_SLOT_US(ow));
+		if (ow->status != HAL_OK) return;
+		//The answer has the bit read in bits 0 and 1
+		for (uint8_t i = 0; i < chunk; i++) {
+			slots[i] = (rx[i] & 0x01) ? WIRE_1 : WIRE_0;
+		}
+		slots += chunk;
+		len -= chunk;
+	}
+}
+
+static void OW_ds2480TouchBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	uint8_t tx[1 + OW_BULK_BYTES * 2];
+
+	uint8_t n = OW_ds2480Data(b, tx);
+	for (uint8_t i = 0; i < len; i++) {
+		tx[n++] = bytes[i];
+		if (bytes[i] == DS2480_COMMAND_MODE) tx[n++] = DS2480_COMMAND_MODE;
+	}
+	OW_ds2480Exchange(ow, tx, n, bytes, len, len * 8 * DS2480_SLOT_US(ow));
+}
+
+/**
+ * Accelerator on, 16 bytes of data, accelerator off. Bits 2n+1 of the data are
+ * the directions, the answer has the discrepancy of the ROM bit n in bit 2n
+ * and the ROM bit in bit 2n+1.
+ */
+static void OW_ds2480Search(OneWire_t *ow, uint8_t *rom, uint8_t *diff)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	uint8_t speed = OW_ds2480Speed(b, ow->speed);
+	uint8_t tx[3 + 16 * 2 + 2], rx[16];
+
+	uint8_t n = OW_ds2480Command(b, tx);
+	tx[n++] = DS2480_SEARCH_ON | speed;
+	n += OW_ds2480Data(b, &tx[n]);
+	for (uint8_t i = 0; i < 16; i++) {
+		uint8_t r = 0;
+		for (uint8_t j = 0; j < 4; j++) {
+			if (rom[i >> 1] & (1 << ((i & 1) * 4 + j))) r |= 2 << (j * 2);
+		}
+		tx[n++] = r;
+		if (r == DS2480_COMMAND_MODE) tx[n++] = DS2480_COMMAND_MODE;
+	}
+	n += OW_ds2480Command(b, &tx[n]);
+	tx[n++] = DS2480_SEARCH_OFF | speed;
+
+	OW_ds2480Exchange(ow, tx, n, rx, 16, 64 * 3 * DS2480_SLOT_US(ow));
+	if (ow->status != HAL_OK) return;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		rom[i] = 0;
+		diff[i] = 0;
+	}
+	for (uint8_t i = 0; i < 16; i++) {
+		for (uint8_t j = 0; j < 4; j++) {
+			uint8_t bit = (i & 1) * 4 + j;
+			if (rx[i] & (1 << (j * 2))) diff[i >> 1] |= 1 << bit;
+			if (rx[i] & (2 << (j * 2))) rom[i >> 1] |= 1 << bit;
+		}
+	}
+}
+
+/* Accelerator off is a command without an answer which sets the speed */
+static void OW_ds2480SetSpeed(OneWire_t *ow, uint8_t speed)
+{
+	OW_Ds2480_t *b = (OW_Ds2480_t*)ow->transportCtx;
+	uint8_t tx[2];
+
+	uint8_t n = OW_ds2480Command(b, tx);
+	tx[n++] = DS2480_SEARCH_OFF | OW_ds2480Speed(b, speed);
+	OW_ds2480Exchange(ow, tx, n, NULL, 0, 0);
+}
+
+const OW_Transport_t OW_ds2480Transport = {
+	.reset = OW_ds2480Reset,
+	.touch = OW_ds2480Touch,
+	.touchBytes = OW_ds2480TouchBytes,
+	.search = OW_ds2480Search,
+	.setSpeed = OW_ds2480SetSpeed,
+	.bulkSlots = OW_BULK_BYTES * 8,
+	.resetNs = { 960000, 120000 },
+	.slotNs = { 70000, 10000 },
+};
@@ -0,0 +1,122 @@
+#ifndef ONE_WIRE_DS2480_h
+#define ONE_WIRE_DS2480_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireDs2480.h
+ * @brief          : Slot engine of OneWire.h on a DS2480B serial 1-Wire line driver
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * For long lines. The DS2480B makes the slots by itself, with the active
+ * pull-up and the slew rate control of a real line driver. The UART talks
+ * to it (TX to its RXD, RX to its TXD, no diode) and does not see the bus.
+ * UART settings: asynchronous mode, global interrupt enabled, 8-n-1,
+ * any baud rate, the transport sets it.
+ *
+ * The bridge has two modes. In the command mode every byte is a command:
+ * a reset, a single bit, a configuration parameter, and it answers each with
+ * one byte. In the data mode every byte goes to the bus as 8 slots and the
+ * byte read back is the answer. The transport switches the modes by itself
+ * (0xE1 - data, 0xE3 - command, 0xE3 of the data is sent twice).
+ * With the search accelerator one exchange of 16 bytes is a whole pass of
+ * the search: 64 triplets instead of 192 separate bit slots.
+ *
+ * The first reset, or the first one after an error, finds the bridge: a break
+ * (0x00 at 4800 baud), the timing byte 0xC1 at 9600 baud, the flexible speed
+ * parameters and then the baud rate of @ref OW_Ds2480_t.
+ *
+ * At standard speed the slots go at flexible speed (slew rate, write 1 low time,
+ * sample offset of Maxim AN192 for long lines) or at regular speed. Overdrive
+ * is always the fixed overdrive speed of the bridge.
+ *
+ * The strong pull-up and the programming pulse of the bridge are not used,
+ * the asynchronous engine of OneWire.h is not available.
+ *
+ * Usage:
+\code
+OW_Ds2480_t bridge;
+
+OW_initDs2480(&bridge, &huart3);
+DS18B20_setTransport(&ds18b20, &OW_ds2480Transport, &bridge);
+DS18B20_init(&ds18b20, NULL, DS18B20_12BITS);
+\endcode
+ */
+
+#include "OneWire.h"
+
+/* Pull down slew rate (PDSRC), V/us */
+#define OW_DS2480_SLEW_15     0
+#define OW_DS2480_SLEW_2V2    1
+#define OW_DS2480_SLEW_1V65   2
+#define OW_DS2480_SLEW_1V37   3
+#define OW_DS2480_SLEW_1V1    4
+#define OW_DS2480_SLEW_0V83   5
+#define OW_DS2480_SLEW_0V7    6
+#define OW_DS2480_SLEW_0V55   7
+
+/* Write 1 low time (W1LT) is 8us + code, 8...15us */
+#define OW_DS2480_W1LT_US(us)  ((us) - 8)
+
+/* Data sample offset and write 0 recovery time (DSO/W0RT) is 3us + code, 3...10us */
+#define OW_DS2480_DSO_US(us)   ((us) - 3)
+
+/**
+ * @brief  The UART and the settings of a bridge, the ctx of @ref OW_ds2480Transport
+ */
+typedef struct {
+	UART_HandleTypeDef *huart;   /*!< To the bridge */
+	uint32_t baudRate;           /*!< 9600, 19200, 57600 or 115200 */
+	uint8_t flex;                /*!< 1 - standard speed slots at flexible speed */
+	uint8_t slewRate;            /*!< OW_DS2480_SLEW_x */
+	uint8_t write1Low;           /*!< OW_DS2480_W1LT_US(us) */
+	uint8_t sampleOffset;        /*!< OW_DS2480_DSO_US(us) */
+	/* private */
+	uint8_t found;               /*!< The bridge is set up */
+	uint8_t data;                /*!< It is in the data mode */
+} OW_Ds2480_t;
+
+/**
+ * @brief  Settings of Maxim AN192 for long lines: 115200 baud, flexible speed,
+ * slew rate 1.37V/us, write 1 low time 10us, sample offset 8us.
+ * Change them before the first reset.
+ * @par bridge - the ctx of the transport
+ * @par huart - the UART to the bridge
+ */
+void OW_initDs2480(OW_Ds2480_t *bridge, UART_HandleTypeDef *huart);
+
+/**
+ * @brief  Give it to @ref OW_setTransport with the @ref OW_Ds2480_t of the bus
+ */
+extern const OW_Transport_t OW_ds2480Transport;
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_DS2480_h */
@@ -0,0 +1,97 @@
+#include "OneWireGpio.h"
+
+/**
+ * Times of Maxim AN126 in us, the letters are the ones of its table:
+ * write 1 - low a, high b; write 0 - low c, high d;
+ * read - low a, sample after e, high f; reset - low h, sample after i, high j
+ */
+typedef struct {
+	uint16_t a, b, c, d, e, f, h, i, j;
+} OW_GpioTiming_t;
+
+/* Indexed by OW_SPEED_*, every slot takes the same time: 70us and 10us */
+static const OW_GpioTiming_t OW_gpioTiming[2] = {
+	{ 6, 64, 60, 10, 9, 55, 480, 70, 410 },
+	{ 1, 9, 8, 2, 1, 8, 70, 9, 41 },
+};
+
+static uint16_t OW_gpioNow(OW_Gpio_t *g)
+{
+	return (uint16_t)__HAL_TIM_GET_COUNTER(g->htim);
+}
+
+/* Waits till us after start, the counter wraps at 16 bits */
+static void OW_gpioUntil(OW_Gpio_t *g, uint16_t start, uint16_t us)
+{
+	while ((uint16_t)(OW_gpioNow(g) - start) < us);
+}
+
+static uint8_t OW_gpioLine(OW_Gpio_t *g)
+{
+	return HAL_GPIO_ReadPin(g->port, g->pin) == GPIO_PIN_SET;
+}
+
+/* A line held low by a short or without pull-up is not a presence */
+static uint8_t OW_gpioIdle(OneWire_t *ow, OW_Gpio_t *g)
+{
+	ow->status = OW_gpioLine(g) ? HAL_OK : HAL_ERROR;
+	return ow->status == HAL_OK;
+}
+
+static uint8_t OW_gpioReset(OneWire_t *ow, uint8_t speed)
+{
+	OW_Gpio_t *g = (OW_Gpio_t*)ow->transportCtx;
+	const OW_GpioTiming_t *t = &OW_gpioTiming[speed];
+
+	if (!OW_gpioIdle(ow, g)) return 0;
+
+	uint16_t start = OW_gpioNow(g);
+	HAL_GPIO_WritePin(g->port, g->pin, GPIO_PIN_RESET);
+	OW_gpioUntil(g, start, t->h);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	HAL_GPIO_WritePin(g->port, g->pin, GPIO_PIN_SET);
+	OW_gpioUntil(g, start, t->h + t->i);
+	uint8_t presence = !OW_gpioLine(g);
+	__set_PRIMASK(primask);
+
+	OW_gpioUntil(g, start, t->h + t->i + t->j);
+	return presence;
+}
+
+static void OW_gpioTouch(OneWire_t *ow, uint8_t *slots, uint16_t len)
+{
+	OW_Gpio_t *g = (OW_Gpio_t*)ow->transportCtx;
+	const OW_GpioTiming_t *t = &OW_gpioTiming[ow->speed];
+
+	if (!OW_gpioIdle(ow, g)) return;
+
+	for (uint16_t n = 0; n < len; n++) {
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		uint16_t start = OW_gpioNow(g);
+		HAL_GPIO_WritePin(g->port, g->pin, GPIO_PIN_RESET);
+		if (slots[n] == WIRE_0) {
+			OW_gpioUntil(g, start, t->c);
+			HAL_GPIO_WritePin(g->port, g->pin, GPIO_PIN_SET);
+			__set_PRIMASK(primask);
+			OW_gpioUntil(g, start, t->c + t->d);
+		} else {
+			OW_gpioUntil(g, start, t->a);
+			HAL_GPIO_WritePin(g->port, g->pin, GPIO_PIN_SET);
+			OW_gpioUntil(g, start, t->a + t->e);
+			slots[n] = OW_gpioLine(g) ? WIRE_1 : WIRE_0;
+			__set_PRIMASK(primask);
+			OW_gpioUntil(g, start, t->a + t->e + t->f);
+		}
+	}
+}
+
+const OW_Transport_t OW_gpioTransport = {
+	.reset = OW_gpioReset,
+	.touch = OW_gpioTouch,
+	.bulkSlots = OW_BULK_BYTES * 8,
+	.resetNs = { 960000, 120000 },
+	.slotNs = { 70000, 10000 },
+};
@@ -0,0 +1,92 @@
+#ifndef ONE_WIRE_GPIO_h
+#define ONE_WIRE_GPIO_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireGpio.h
+ * @brief          : Slot engine of OneWire.h on a GPIO pin timed by a timer
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * For the boards without a free UART. The pin drives the bus directly:
+ * output open-drain, no pull (the 4.7k resistor is on the bus), high speed.
+ * In open-drain mode the input register reads the line, so one pin does both.
+ *
+ *  +3.3V----+
+ *           |
+ *           П 4.7k Resistor
+ *           U
+ *           |
+ *  PB0 -----+-------- to 1Wire bus
+ *
+ * The timer counts microseconds: up, prescaler to 1 MHz, period 0xFFFF,
+ * started by HAL_TIM_Base_Start before the init. Any timer will do, it is
+ * only read, and it may count for other code too.
+ *
+ * The slots are timed as in Maxim AN126, every slot with the interrupts
+ * disabled from its falling edge till the line is released or sampled:
+ * up to 60us at standard speed. The reset pulse keeps them enabled,
+ * only its presence window is cut. The CPU waits for every slot, a slot
+ * (70us) is shorter than a UART byte at 115200 baud (87us).
+ *
+ * Every slot is timed by the CPU, one after another. bulkSlots only sets how
+ * many of them one touch call takes (OW_BULK_BYTES bytes), so the bytes cost
+ * fewer calls; the search goes by touch. The asynchronous engine of OneWire.h
+ * is not available.
+ *
+ * Usage:
+\code
+OW_Gpio_t pin = { GPIOB, GPIO_PIN_0, &htim2 };
+
+HAL_TIM_Base_Start(&htim2);
+DS18B20_setTransport(&ds18b20, &OW_gpioTransport, &pin);
+DS18B20_init(&ds18b20, NULL, DS18B20_12BITS);
+\endcode
+ */
+
+#include "OneWire.h"
+
+/**
+ * @brief  The pin and the timer of a bus, the ctx of @ref OW_gpioTransport
+ */
+typedef struct {
+	GPIO_TypeDef *port;          /*!< Output open-drain */
+	uint16_t pin;                /*!< GPIO_PIN_x */
+	TIM_HandleTypeDef *htim;     /*!< Counts microseconds, 16 bits */
+} OW_Gpio_t;
+
+/**
+ * @brief  Give it to @ref OW_setTransport with the @ref OW_Gpio_t of the bus
+ */
+extern const OW_Transport_t OW_gpioTransport;
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_GPIO_h */
@@ -0,0 +1,1160 @@
+#include <string.h>
+#include "OneWireSim.h"
+#include "usart.h"
+#include "OneWireSimTask.h"
+
+#define PCLK1 36000000U
+#define PCLK2 72000000U
+
+/* States of a virtual device */
+enum {
+	ST_IDLE = 0,    //waits for a reset
+	ST_ROMCMD,      //receives ROM command
+	ST_READROM,     //sends ROM
+	ST_MATCH,       //receives ROM to compare
+	ST_SEARCH,      //search, alarm search
+	ST_FUNC,        //receives function command
+	ST_OUT,         //sends buf
+	ST_IN,          //receives buf, what for is in cmd
+	ST_BUSY,        //conversion or copy, read slots give 0 until done
+	ST_PWR          //read power supply
+};
+
+/**
+ * Simulated DS2480B: its mode, speed and parameters, the time its bus and
+ * its TX are busy till
+ */
+typedef struct {
+	uint32_t baud;
+	uint8_t calibrated;
+	uint8_t data;
+	uint8_t escape;
+	uint8_t search;
+	uint8_t speed;
+	uint8_t config[8];
+	uint64_t busAt;
+	uint64_t txAt;
+} Bridge_t;
+
+/**
+ * Simulated UART: the receive data register, armed IT/DMA reception
+ * and pending completions
+ */
+typedef struct {
+	OWSIM_Bus_t *bus;
+	uint8_t bridged;
+	Bridge_t bridge;
+	UART_HandleTypeDef *huart;
+	uint8_t rdr;
+	uint8_t rdrFull;
+	uint64_t rdrAt;
+	uint64_t busyUntil;
+	uint8_t txPending;
+	uint64_t txDoneAt;
+	uint8_t rxPending;
+	uint64_t rxDoneAt;
+	uint8_t *rxBuf;
+	uint16_t rxSize;
+	uint16_t rxCount;
+	uint8_t rxDma;
+	DMA_HandleTypeDef dmatx;
+	DMA_HandleTypeDef dmarx;
+	DMA_Channel_TypeDef chtx;
+	DMA_Channel_TypeDef chrx;
+	OWSIM_Sink_t sink;
+	void *sinkCtx;
+} Port_t;
+
+/**
+ * Simulated open-drain pin: the master pulls it low or lets it go,
+ * a device may hold it low for a while after the release
+ */
+typedef struct {
+	OWSIM_Bus_t *bus;
+	GPIO_TypeDef *port;
+	uint16_t pin;
+	uint8_t low;
+	uint64_t lowAt;
+	uint64_t lastFall;
+	uint64_t heldFrom;
+	uint64_t heldUntil;
+	uint64_t lastMax;
+} Pin_t;
+
+/* Buses without UART, run_until checks their strong pull-up too */
+#define SIM_WATCHED 8
+
+USART_TypeDef OWSIM_usart[OWSIM_UART_COUNT];
+GPIO_TypeDef OWSIM_gpio[OWSIM_GPIO_COUNT];
+TIM_TypeDef OWSIM_tim[OWSIM_TIM_COUNT];
+UART_HandleTypeDef huart1;
+UART_HandleTypeDef huart2;
+UART_HandleTypeDef huart3;
+
+static Port_t ports[OWSIM_UART_COUNT];
+static Pin_t pins[OWSIM_PIN_COUNT];
+static OWSIM_Bus_t *watched[SIM_WATCHED];
+static uint64_t clockNs;
+static uint8_t inIrq;
+
+/* A task calling the HAL lets the next one run, the callbacks are interrupts and are never cut */
+#ifdef OWSIM_TASKS
+#define SIM_PREEMPT() do { if (!inIrq) OWSIM_yield(); } while (0)
+#else
+#define SIM_PREEMPT() do { } while (0)
+#endif
+
+static void run_until(uint64_t t);
+
+/* -------------------------------- devices -------------------------------- */
+
+uint8_t OWSIM_crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+	while (len--) {
+		uint8_t b = *data++;
+		for (uint8_t i = 0; i < 8; i++) {
+			uint8_t mix = (crc ^ b) & 0x01;
+			crc >>= 1;
+			if (mix) crc ^= 0x8C;
+			b >>= 1;
+		}
+	}
+	return crc;
+}
+
+void OWSIM_initDevice(OWSIM_Device_t *dev, uint8_t family, uint64_t serial)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->rom[0] = family;
+	for (uint8_t i = 1; i < 7; i++) {
+		dev->rom[i] = (uint8_t)(serial >> (8 * (i - 1)));
+	}
+	dev->rom[7] = OWSIM_crc8(dev->rom, 7);
+	dev->connected = 1;
+}
+
+void OWSIM_initDS18B20(OWSIM_Device_t *dev, uint64_t serial, int16_t temperature)
+{
+	OWSIM_initDevice(dev, 0x28, serial);
+	dev->temperature = temperature;
+	dev->convTimeUs = OWSIM_DS18B20_CONV_US;
+	dev->eeprom[0] = 0x4B;
+	dev->eeprom[1] = 0x46;
+	dev->eeprom[2] = 0x7F;
+	//Power-up state: 85 degrees
+	dev->scratchpad[0] = 0x50;
+	dev->scratchpad[1] = 0x05;
+	dev->scratchpad[2] = dev->eeprom[0];
+	dev->scratchpad[3] = dev->eeprom[1];
+	dev->scratchpad[4] = dev->eeprom[2];
+	dev->scratchpad[5] = 0xFF;
+	dev->scratchpad[6] = 0x0C;
+	dev->scratchpad[7] = 0x10;
+	dev->scratchpad[8] = OWSIM_crc8(dev->scratchpad, 8);
+}
+
+static uint8_t dev_bit(const uint8_t *buf, uint8_t pos)
+{
+	return (buf[pos >> 3] >> (pos & 7)) & 0x01;
+}
+
+static void dev_collect(OWSIM_Device_t *d, uint8_t state, uint8_t bits)
+{
+	d->state = state;
+	d->pos = 0;
+	d->len = bits;
+	memset(d->buf, 0, sizeof(d->buf));
+}
+
+static void dev_send(OWSIM_Device_t *d, const uint8_t *data, uint8_t bytes)
+{
+	d->state = ST_OUT;
+	d->pos = 0;
+	d->len = bytes * 8;
+	memcpy(d->buf, data, bytes);
+}
+
+/* Finishes the conversion if its time has come */
+static void dev_update(OWSIM_Device_t *d, uint64_t t)
+{
+	if (!d->converting || t < d->busyUntil) return;
+
+	d->converting = 0;
+	d->conversions++;
+
+	uint8_t res = (d->scratchpad[4] >> 5) & 0x03;
+	int16_t raw = d->temperature & ~((1 << (3 - res)) - 1);
+	if (d->spoiled) {
+		//Not enough power: the sensor gives its power-up value
+		raw = 0x0550;
+	}
+	d->scratchpad[0] = (uint8_t)raw;
+	d->scratchpad[1] = (uint8_t)(raw >> 8);
+	d->scratchpad[8] = OWSIM_crc8(d->scratchpad, 8);
+
+	int16_t whole = raw >> 4;
+	d->alarm = (whole >= (int8_t)d->scratchpad[2]) || (whole <= (int8_t)d->scratchpad[3]);
+}
+
+static void dev_reset(OWSIM_Device_t *d)
+{
+	dev_collect(d, ST_ROMCMD, 8);
+}
+
+static void dev_startFunc(OWSIM_Device_t *d)
+{
+	//Only DS18B20 has function commands
+	if (d->rom[0] == 0x28) {
+		dev_collect(d, ST_FUNC, 8);
+	} else {
+		d->state = ST_IDLE;
+	}
+}
+
+static void dev_romCommand(OWSIM_Device_t *d, uint8_t cmd)
+{
+	switch (cmd) {
+		case 0x33: //Read ROM
+			dev_send(d, d->rom, 8);
+			d->state = ST_READROM;
+			break;
+		case 0x69: //Overdrive Match ROM
+			if (!d->overdrive) {
+				d->state = ST_IDLE;
+				break;
+			}
+			d->od = 1;
+			// fall through
+		case 0x55: //Match ROM
+			dev_collect(d, ST_MATCH, 64);
+			break;
+		case 0x3C: //Overdrive Skip ROM
+			if (!d->overdrive) {
+				d->state = ST_IDLE;
+				break;
+			}
+			d->od = 1;
+			dev_startFunc(d);
+			break;
+		case 0xCC: //Skip ROM
+			dev_startFunc(d);
+			break;
+		case 0xEC: //Alarm search
+			if (!d->alarm) {
+				d->state = ST_IDLE;
+				break;
+			}
+			// fall through
+		case 0xF0: //Search ROM
+			d->state = ST_SEARCH;
+			d->pos = 0;
+			d->phase = 0;
+			break;
+		default:
+			d->state = ST_IDLE;
+	}
+}
+
+static void dev_function(OWSIM_Device_t *d, OWSIM_Bus_t *bus, uint8_t cmd, uint64_t t)
+{
+	d->cmd = cmd;
+	switch (cmd) {
+		case 0x44: //Convert T
+		{
+			uint8_t res = (d->scratchpad[4] >> 5) & 0x03;
+			d->converting = 1;
+			d->spoiled = 0;
+			d->busyUntil = t + ((uint64_t)(d->convTimeUs >> (3 - res))) * 1000;
+			d->state = ST_BUSY;
+			//The time to check the power is known at the end of the slot
+			if (d->parasite) bus->powerCheck = 1;
+			break;
+		}
+		case 0xBE: //Read scratchpad
+			dev_update(d, t);
+			//The user may have changed the scratchpad
+			d->scratchpad[8] = OWSIM_crc8(d->scratchpad, 8);
+			dev_send(d, d->scratchpad, 9);
+			break;
+		case 0x4E: //Write scratchpad
+			dev_collect(d, ST_IN, 24);
+			break;
+		case 0x48: //Copy scratchpad
+			memcpy(d->eeprom, &d->scratchpad[2], 3);
+			d->busyUntil = t + 10000000ULL;
+			d->state = ST_BUSY;
+			break;
+		case 0xB8: //Recall EEPROM
+			memcpy(&d->scratchpad[2], d->eeprom, 3);
+			d->scratchpad[8] = OWSIM_crc8(d->scratchpad, 8);
+			d->busyUntil = t;
+			d->state = ST_BUSY;
+			break;
+		case 0xB4: //Read power supply
+			d->state = ST_PWR;
+			break;
+		default:
+			d->state = ST_IDLE;
+	}
+}
+
+static void dev_gotBits(OWSIM_Device_t *d, OWSIM_Bus_t *bus, uint64_t t)
+{
+	switch (d->state) {
+		case ST_ROMCMD:
+			dev_romCommand(d, d->buf[0]);
+			break;
+		case ST_MATCH:
+			if (memcmp(d->buf, d->rom, 8) == 0) {
+				dev_startFunc(d);
+			} else {
+				d->state = ST_IDLE;
+			}
+			break;
+		case ST_FUNC:
+			dev_function(d, bus, d->buf[0], t);
+			break;
+		case ST_IN:
+			if (d->cmd == 0x4E) {
+				d->scratchpad[2] = d->buf[0];
+				d->scratchpad[3] = d->buf[1];
+				d->scratchpad[4] = (d->buf[2] & 0x60) | 0x1F;
+				d->scratchpad[8] = OWSIM_crc8(d->scratchpad, 8);
+			}
+			d->state = ST_IDLE;
+			break;
+	}
+}
+
+/* Level the device drives in the coming slot: 1 - released, 0 - pulled low */
+static uint8_t dev_out(OWSIM_Device_t *d, uint64_t t)
+{
+	switch (d->state) {
+		case ST_READROM:
+		case ST_OUT:
+			return d->pos < d->len ? dev_bit(d->buf, d->pos) : 1;
+		case ST_SEARCH:
+			if (d->phase == 0) return dev_bit(d->rom, d->pos);
+			if (d->phase == 1) return !dev_bit(d->rom, d->pos);
+			return 1;
+		case ST_BUSY:
+			//Parasite powered device can't tell it's busy
+			if (d->parasite) return 1;
+			return t >= d->busyUntil;
+		case ST_PWR:
+			return !d->parasite;
+	}
+	return 1;
+}
+
+/* The device samples the line at the end of the slot */
+static void dev_in(OWSIM_Device_t *d, OWSIM_Bus_t *bus, uint8_t line, uint64_t t)
+{
+	switch (d->state) {
+		case ST_ROMCMD:
+		case ST_MATCH:
+		case ST_FUNC:
+		case ST_IN:
+			if (line) d->buf[d->pos >> 3] |= 1 << (d->pos & 7);
+			if (++d->pos == d->len) dev_gotBits(d, bus, t);
+			break;
+		case ST_READROM:
+			if (++d->pos == d->len) dev_startFunc(d);
+			break;
+		case ST_OUT:
+			if (d->pos < d->len) d->pos++;
+			break;
+		case ST_SEARCH:
+			if (d->phase < 2) {
+				d->phase++;
+			} else if (line != dev_bit(d->rom, d->pos)) {
+				d->state = ST_IDLE;
+			} else {
+				d->phase = 0;
+				if (++d->pos == 64) dev_startFunc(d);
+			}
+			break;
+	}
+}
+
+/* ---------------------------------- bus ---------------------------------- */
+
+void OWSIM_initBus(OWSIM_Bus_t *bus)
+{
+	memset(bus, 0, sizeof(*bus));
+}
+
+uint8_t OWSIM_addDevice(OWSIM_Bus_t *bus, OWSIM_Device_t *dev)
+{
+	if (bus->count >= OWSIM_MAX_DEVICES) return 0;
+	bus->devices[bus->count++] = dev;
+	return 1;
+}
+
+/* Any traffic takes the power of parasite devices during the conversion */
+static void bus_traffic(OWSIM_Bus_t *bus, uint64_t t)
+{
+	for (uint16_t i = 0; i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (!d->connected) continue;
+		dev_update(d, t);
+		if (d->converting && d->parasite) d->spoiled = 1;
+	}
+}
+
+/* The pull-up resistor can power only one converting parasite device */
+static void bus_power(OWSIM_Bus_t *bus)
+{
+	uint16_t converting = 0;
+
+	bus->powerCheck = 0;
+	if (bus->strongPullup) return;
+	for (uint16_t i = 0; i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (d->connected && d->parasite && d->converting) converting++;
+	}
+	for (uint16_t i = 0; converting > 1 && i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (d->connected && d->parasite && d->converting) d->spoiled = 1;
+	}
+}
+
+static uint8_t bus_reset(OWSIM_Bus_t *bus, uint8_t b, uint8_t zeros, uint8_t od, uint64_t t)
+{
+	uint8_t presence = 0;
+
+	bus->stats.resets++;
+	bus_traffic(bus, t);
+
+	for (uint16_t i = 0; i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (!d->connected) continue;
+		if (!od) {
+			//Standard reset returns everybody to standard speed
+			d->od = 0;
+			dev_reset(d);
+			presence = 1;
+		} else if (d->od) {
+			dev_reset(d);
+			presence = 1;
+		}
+	}
+
+	if (!presence) return b;
+	bus->stats.presences++;
+	//Presence pulse pulls the line low right after the reset pulse
+	return zeros < 8 ? b & ~(1 << zeros) : b;
+}
+
+static uint8_t bus_slot(OWSIM_Bus_t *bus, uint8_t b, uint8_t masterBit, uint8_t od, uint64_t t)
+{
+	uint8_t line = masterBit;
+
+	bus->stats.slots++;
+	bus_traffic(bus, t);
+
+	for (uint16_t i = 0; i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (d->connected && d->od == od) line &= dev_out(d, t);
+	}
+	for (uint16_t i = 0; i < bus->count; i++) {
+		OWSIM_Device_t *d = bus->devices[i];
+		if (d->connected && d->od == od) dev_in(d, bus, line, t);
+	}
+
+	//A device holding the line in a read slot spoils the first data bits
+	if (masterBit && !line) return b & 0xF8;
+	return b;
+}
+
+/* The master has 10us after the slot of Convert T to switch the strong pull-up on */
+static void bus_powerAfter(OWSIM_Bus_t *bus, uint64_t t)
+{
+	if (bus->powerCheck != 1) return;
+	bus->powerCheck = 2;
+	bus->powerAt = t + 10000;
+}
+
+static void bus_watch(OWSIM_Bus_t *bus)
+{
+	for (uint8_t i = 0; i < SIM_WATCHED; i++) {
+		if (watched[i] == bus) return;
+		if (watched[i] == NULL) {
+			watched[i] = bus;
+			return;
+		}
+	}
+}
+
+/* Some device is in overdrive, the short pulses are its slots */
+static uint8_t bus_anyOd(OWSIM_Bus_t *bus)
+{
+	for (uint16_t i = 0; i < bus->count; i++) {
+		if (bus->devices[i]->connected && bus->devices[i]->od) return 1;
+	}
+	return 0;
+}
+
+uint8_t OWSIM_busReset(OWSIM_Bus_t *bus, uint8_t od)
+{
+	SIM_PREEMPT();
+	bus_watch(bus);
+	uint64_t t = clockNs;
+	uint64_t ns = (od ? OWSIM_OD_RESET_US : OWSIM_RESET_US) * 1000ULL;
+	uint8_t presence = !bus_reset(bus, 1, 0, od, t);
+	bus->stats.busyNs += ns;
+	run_until(t + ns);
+	return presence;
+}
+
+uint8_t OWSIM_busSlot(OWSIM_Bus_t *bus, uint8_t masterBit, uint8_t od)
+{
+	SIM_PREEMPT();
+	bus_watch(bus);
+	uint64_t t = clockNs;
+	uint64_t ns = (od ? OWSIM_OD_SLOT_US : OWSIM_SLOT_US) * 1000ULL;
+	uint8_t line = bus_slot(bus, 1, masterBit, od, t) && masterBit;
+	bus->stats.busyNs += ns;
+	bus_powerAfter(bus, t + ns);
+	run_until(t + ns);
+	return line;
+}
+
+/* --------------------------------- UART ---------------------------------- */
+
+static Port_t *port_of(UART_HandleTypeDef *huart)
+{
+	if (huart == NULL || huart->Instance < OWSIM_usart || huart->Instance >= OWSIM_usart + OWSIM_UART_COUNT) {
+		return NULL;
+	}
+	Port_t *p = &ports[huart->Instance - OWSIM_usart];
+	p->huart = huart;
+	if (p->bus) p->bus->stats.halCalls++;
+	return p;
+}
+
+static uint64_t port_bitNs(Port_t *p)
+{
+	USART_TypeDef *inst = p->huart->Instance;
+	uint32_t pclk = inst == USART1 ? PCLK2 : PCLK1;
+	uint32_t brr = inst->BRR ? inst->BRR : UART_BRR_SAMPLING16(pclk, p->huart->Init.BaudRate);
+	return (uint64_t)brr * 1000000000ULL / pclk;
+}
+
+/* One byte on the line, returns what the receiver gets */
+static uint8_t port_line(Port_t *p, uint8_t b, uint64_t t)
+{
+	uint64_t bitNs = port_bitNs(p);
+	uint32_t baud = (uint32_t)(1000000000ULL / bitNs);
+	uint8_t zeros = 0;
+	while (zeros < 8 && !(b & (1 << zeros))) zeros++;
+	uint64_t lowNs = (zeros + 1) * bitNs;
+
+	if (p->sink) p->sink(p->huart->Instance, b, p->sinkCtx);
+	if (p->bus == NULL) return b;
+
+	p->bus->stats.uartBytes++;
+	p->bus->stats.busyNs += 10 * bitNs;
+
+	if (baud < 20000) {
+		if (lowNs >= 480000) return bus_reset(p->bus, b, zeros, 0, t);
+		return b;
+	}
+	if (baud < 100000) {
+		if (lowNs >= 48000) return bus_reset(p->bus, b, zeros, 1, t);
+		return b;
+	}
+	uint8_t od = baud >= 500000;
+	uint8_t masterBit = lowNs < (od ? 2000 : 15000);
+	return bus_slot(p->bus, b, masterBit, od, t);
+}
+
+static void port_received(Port_t *p, uint8_t b, uint64_t t)
+{
+	if (p->rxBuf) {
+		p->rxBuf[p->rxCount++] = b;
+		if (p->rxDma) p->chrx.CNDTR = p->rxSize - p->rxCount;
+		if (p->rxCount == p->rxSize) {
+			p->rxBuf = NULL;
+			p->rxPending = 1;
+			p->rxDoneAt = t;
+		}
+		return;
+	}
+	if (p->rdrFull) {
+		//Overrun: the new byte is lost
+		p->huart->Instance->SR |= 0x08;
+		return;
+	}
+	p->rdr = b;
+	p->rdrFull = 1;
+	p->rdrAt = t;
+}
+
+static void bridge_byte(Port_t *p, uint8_t b, uint64_t t);
+
+static void port_send(Port_t *p, const uint8_t *data, uint16_t size)
+{
+	uint64_t byteNs = 10 * port_bitNs(p);
+	uint64_t t = clockNs > p->busyUntil ? clockNs : p->busyUntil;
+	for (uint16_t i = 0; i < size; i++) {
+		if (p->bridged) {
+			t += byteNs;
+			bridge_byte(p, data[i], t);
+			continue;
+		}
+		uint8_t r = port_line(p, data[i], t);
+		t += byteNs;
+		if (p->bus) bus_powerAfter(p->bus, t);
+		port_received(p, r, t);
+	}
+	p->busyUntil = t;
+}
+
+/* Runs the completions due till t, then sets the clock to t */
+static void run_until(uint64_t t)
+{
+	//The strong pull-up is checked as it is when the time after Convert T comes
+	for (uint8_t i = 0; i < OWSIM_UART_COUNT; i++) {
+		OWSIM_Bus_t *bus = ports[i].bus;
+		if (bus && bus->powerCheck == 2 && t >= bus->powerAt) bus_power(bus);
+	}
+	for (uint8_t i = 0; i < SIM_WATCHED && watched[i]; i++) {
+		OWSIM_Bus_t *bus = watched[i];
+		if (bus->powerCheck == 2 && t >= bus->powerAt) bus_power(bus);
+	}
+
+	for (;;) {
+		Port_t *next = NULL;
+		uint8_t rx = 0;
+		uint64_t at = UINT64_MAX;
+		for (uint8_t i = 0; i < OWSIM_UART_COUNT; i++) {
+			Port_t *p = &ports[i];
+			//TX of a port ends before its RX
+			if (p->txPending && p->txDoneAt < at) {
+				next = p; rx = 0; at = p->txDoneAt;
+			}
+			if (p->rxPending && p->rxDoneAt < at) {
+				next = p; rx = 1; at = p->rxDoneAt;
+			}
+		}
+		if (next == NULL || at > t) break;
+
+		if (at > clockNs) clockNs = at;
+		uint8_t nested = inIrq;
+		inIrq = 1;
+		if (rx) {
+			next->rxPending = 0;
+			next->huart->RxState = HAL_UART_STATE_READY;
+			HAL_UART_RxCpltCallback(next->huart);
+		} else {
+			next->txPending = 0;
+			next->huart->gState = HAL_UART_STATE_READY;
+			HAL_UART_TxCpltCallback(next->huart);
+		}
+		inIrq = nested;
+	}
+	if (t > clockNs) clockNs = t;
+}
+
+void OWSIM_attach(UART_HandleTypeDef *huart, USART_TypeDef *instance, OWSIM_Bus_t *bus)
+{
+	Port_t *p = &ports[instance - OWSIM_usart];
+	memset(p, 0, sizeof(*p));
+	memset(huart, 0, sizeof(*huart));
+	memset(instance, 0, sizeof(*instance));
+	p->bus = bus;
+	p->huart = huart;
+	huart->Instance = instance;
+	huart->Init.BaudRate = 115200;
+	huart->Init.WordLength = UART_WORDLENGTH_8B;
+	huart->Init.StopBits = UART_STOPBITS_1;
+	huart->Init.Parity = UART_PARITY_NONE;
+	huart->Init.Mode = UART_MODE_TX_RX;
+	huart->Init.HwFlowCtl = UART_HWCONTROL_NONE;
+	huart->Init.OverSampling = UART_OVERSAMPLING_16;
+	HAL_UART_Init(huart);
+}
+
+void OWSIM_enableDMA(UART_HandleTypeDef *huart)
+{
+	Port_t *p = &ports[huart->Instance - OWSIM_usart];
+	p->dmatx.Instance = &p->chtx;
+	p->dmarx.Instance = &p->chrx;
+	p->dmatx.Parent = huart;
+	p->dmarx.Parent = huart;
+	huart->hdmatx = &p->dmatx;
+	huart->hdmarx = &p->dmarx;
+}
+
+void OWSIM_setSink(USART_TypeDef *instance, OWSIM_Sink_t sink, void *ctx)
+{
+	Port_t *p = &ports[instance - OWSIM_usart];
+	p->sink = sink;
+	p->sinkCtx = ctx;
+}
+
+uint64_t OWSIM_now(void)
+{
+	return clockNs / 1000;
+}
+
+void OWSIM_advance(uint64_t us)
+{
+	run_until(clockNs + us * 1000);
+}
+
+void OWSIM_reset(void)
+{
+	clockNs = 0;
+	memset(ports, 0, sizeof(ports));
+	memset(pins, 0, sizeof(pins));
+	memset(watched, 0, sizeof(watched));
+}
+
+void OWSIM_clearOverrun(UART_HandleTypeDef *huart)
+{
+	Port_t *p = port_of(huart);
+	if (p == NULL) return;
+	p->rdrFull = 0;
+	huart->Instance->SR &= ~0x08U;
+}
+
+/* -------------------------------- DS2480B -------------------------------- */
+
+/* Power-up: 9600 baud, command mode, waits for the timing byte */
+static void bridge_powerUp(Bridge_t *br)
+{
+	memset(br, 0, sizeof(*br));
+	br->baud = 9600;
+}
+
+void OWSIM_attachDs2480(UART_HandleTypeDef *huart, USART_TypeDef *instance, OWSIM_Bus_t *bus)
+{
+	OWSIM_attach(huart, instance, bus);
+	Port_t *p = &ports[instance - OWSIM_usart];
+	p->bridged = 1;
+	bridge_powerUp(&p->bridge);
+}
+
+/* The answer goes out after the bus is done and the answers before it, lost if the UART is at another rate */
+static void bridge_answer(Port_t *p, uint8_t b, uint8_t sameBaud)
+{
+	Bridge_t *br = &p->bridge;
+	uint64_t at = br->busAt > br->txAt ? br->busAt : br->txAt;
+	br->txAt = at + 10 * (1000000000ULL / br->baud);
+	if (sameBaud) port_received(p, b, br->txAt);
+}
+
+static uint8_t bridge_reset(Port_t *p)
+{
+	Bridge_t *br = &p->bridge;
+	uint8_t od = br->speed == 2;
+	uint64_t ns = (od ? OWSIM_OD_RESET_US : OWSIM_RESET_US) * 1000ULL;
+	uint8_t presence = !bus_reset(p->bus, 1, 0, od, br->busAt);
+	br->busAt += ns;
+	p->bus->stats.busyNs += ns;
+	return presence;
+}
+
+static uint8_t bridge_slot(Port_t *p, uint8_t masterBit)
+{
+	Bridge_t *br = &p->bridge;
+	uint8_t od = br->speed == 2;
+	uint64_t ns = (od ? OWSIM_OD_SLOT_US : OWSIM_SLOT_US) * 1000ULL;
+	uint8_t line = bus_slot(p->bus, 1, masterBit, od, br->busAt) && masterBit;
+	br->busAt += ns;
+	p->bus->stats.busyNs += ns;
+	bus_powerAfter(p->bus, br->busAt);
+	return line;
+}
+
+/* A byte of the data mode: 8 slots, or 4 triplets of the search accelerator */
+static uint8_t bridge_data(Port_t *p, uint8_t b)
+{
+	uint8_t r = 0;
+
+	if (!p->bridge.search) {
+		for (uint8_t i = 0; i < 8; i++) {
+			if (bridge_slot(p, (b >> i) & 1)) r |= 1 << i;
+		}
+		return r;
+	}
+	for (uint8_t i = 0; i < 4; i++) {
+		uint8_t dir = (b >> (i * 2 + 1)) & 1;
+		uint8_t id = bridge_slot(p, 1);
+		uint8_t cmp = bridge_slot(p, 1);
+		uint8_t diff = id == cmp;
+		if (id != cmp) dir = id;
+		if (id && cmp) dir = 1;
+		bridge_slot(p, dir);
+		r |= (diff << (i * 2)) | (dir << (i * 2 + 1));
+	}
+	return r;
+}
+
+/* A byte of the command mode, most of them are answered */
+static void bridge_command(Port_t *p, uint8_t b, uint8_t sameBaud)
+{
+	Bridge_t *br = &p->bridge;
+
+	if (b == 0xE1) {
+		br->data = 1;
+		return;
+	}
+	if (b == 0xE3 || b == 0xF1) return;
+	if (!(b & 0x80)) {
+		uint8_t param = (b >> 4) & 0x07;
+		if (param == 0) {
+			param = (b >> 1) & 0x07;
+			bridge_answer(p, br->config[param] << 1, sameBaud);
+			return;
+		}
+		br->config[param] = (b >> 1) & 0x07;
+		if (param == 7) {
+			//The answer is already at the new rate
+			static const uint32_t rates[4] = { 9600, 19200, 57600, 115200 };
+			br->baud = rates[br->config[7] & 0x03];
+			sameBaud = 0;
+		}
+		bridge_answer(p, b & 0xFE, sameBaud);
+		return;
+	}
+
+	br->speed = (b >> 2) & 0x03;
+	if (br->speed == 3) br->speed = 0;
+	switch ((b >> 5) & 0x03) {
+		case 0: //Single bit
+			bridge_answer(p, (b & 0xFC) | (bridge_slot(p, (b >> 4) & 1) ? 0x03 : 0), sameBaud);
+			break;
+		case 1: //Search accelerator on or off
+			br->search = (b >> 4) & 1;
+			break;
+		case 2: //Reset: revision 3, presence or nobody
+			bridge_answer(p, 0xCC | (bridge_reset(p) ? 0x01 : 0x03), sameBaud);
+			break;
+		default: //Pulse
+			bridge_answer(p, b & 0xFC, sameBaud);
+	}
+}
+
+static void bridge_byte(Port_t *p, uint8_t b, uint64_t t)
+{
+	Bridge_t *br = &p->bridge;
+	uint64_t bitNs = port_bitNs(p);
+	uint64_t bridgeBitNs = 1000000000ULL / br->baud;
+	uint8_t sameBaud = bitNs * 20 > bridgeBitNs * 19 && bitNs * 20 < bridgeBitNs * 21;
+
+	if (p->sink) p->sink(p->huart->Instance, b, p->sinkCtx);
+	p->bus->stats.uartBytes++;
+	if (br->busAt < t) br->busAt = t;
+
+	if (!sameBaud) {
+		//Low for a whole frame of the bridge is a break, anything else is noise
+		uint8_t zeros = 0;
+		while (zeros < 8 && !(b & (1 << zeros))) zeros++;
+		if ((zeros + 1) * bitNs >= 10 * bridgeBitNs) bridge_powerUp(br);
+		return;
+	}
+	if (!br->calibrated) {
+		//The timing byte is a reset command, it is not done nor answered
+		br->calibrated = (b & 0xE3) == 0xC1;
+		return;
+	}
+	if (!br->data) {
+		bridge_command(p, b, sameBaud);
+		return;
+	}
+	if (br->escape) {
+		br->escape = 0;
+		if (b != 0xE3) {
+			br->data = 0;
+			bridge_command(p, b, sameBaud);
+			return;
+		}
+	} else if (b == 0xE3) {
+		br->escape = 1;
+		return;
+	}
+	bridge_answer(p, bridge_data(p, b), sameBaud);
+}
+
+/* ---------------------------------- pins --------------------------------- */
+
+static Pin_t *pin_of(GPIO_TypeDef *port, uint16_t pin)
+{
+	for (uint8_t i = 0; i < OWSIM_PIN_COUNT; i++) {
+		if (pins[i].bus && pins[i].port == port && pins[i].pin == pin) return &pins[i];
+	}
+	return NULL;
+}
+
+uint8_t OWSIM_attachPin(GPIO_TypeDef *port, uint16_t pin, OWSIM_Bus_t *bus)
+{
+	Pin_t *p = pin_of(port, pin);
+	for (uint8_t i = 0; p == NULL && i < OWSIM_PIN_COUNT; i++) {
+		if (pins[i].bus == NULL) p = &pins[i];
+	}
+	if (p == NULL) return 0;
+	memset(p, 0, sizeof(*p));
+	p->bus = bus;
+	p->port = port;
+	p->pin = pin;
+	port->ODR |= pin;
+	bus_watch(bus);
+	return 1;
+}
+
+/* The last pulse was counted whole at its release, the part of it which didn't come is given back */
+static void pin_fall(Pin_t *p, uint64_t t)
+{
+	uint64_t gap = t - p->lastFall;
+	if (gap < p->lastMax) p->bus->stats.busyNs -= p->lastMax - gap;
+	p->lastMax = 0;
+	p->low = 1;
+	p->lowAt = t;
+	p->lastFall = t;
+}
+
+/* The length of the pulse tells what it was */
+static void pin_rise(Pin_t *p, uint64_t t)
+{
+	OWSIM_Bus_t *bus = p->bus;
+	uint64_t lowNs = t - p->lowAt;
+	uint8_t od = bus_anyOd(bus);
+
+	p->low = 0;
+	if (lowNs >= 480000 || (od && lowNs >= 48000)) {
+		uint8_t std = lowNs >= 480000;
+		if (!bus_reset(bus, 1, 0, !std, t)) {
+			p->heldFrom = t + (std ? 15000 : 2000);
+			p->heldUntil = p->heldFrom + (std ? 120000 : 16000);
+		}
+		p->lastMax = lowNs + (std ? 480000 : 50000);
+		bus->stats.busyNs += p->lastMax;
+		return;
+	}
+
+	uint8_t masterBit = lowNs < (od ? 5000 : 15000);
+	if (!bus_slot(bus, 1, masterBit, od, t) && masterBit) {
+		p->heldFrom = p->lowAt;
+		p->heldUntil = p->lowAt + (od ? 6000 : 30000);
+	}
+	bus_powerAfter(bus, t);
+	p->lastMax = (od ? OWSIM_OD_SLOT_US : OWSIM_SLOT_US) * 1000ULL;
+	if (p->lastMax < lowNs) p->lastMax = lowNs;
+	bus->stats.busyNs += p->lastMax;
+}
+
+/* ---------------------------------- HAL ---------------------------------- */
+
+uint32_t HAL_GetTick(void)
+{
+	SIM_PREEMPT();
+	run_until(clockNs + 1000);
+	return (uint32_t)(clockNs / 1000000);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+	SIM_PREEMPT();
+#ifdef OWSIM_TASKS
+	if (!inIrq && OWSIM_taskSleep(clockNs / 1000 + (uint64_t)Delay * 1000)) return;
+#endif
+	run_until(clockNs + (uint64_t)Delay * 1000000);
+}
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return PCLK1;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+	return PCLK2;
+}
+
+uint32_t OWSIM_timCounter(TIM_HandleTypeDef *htim)
+{
+	//No task switch: the slots are timed with the interrupts disabled
+	run_until(clockNs + 1000);
+	htim->Instance->CNT = (uint32_t)(clockNs / 1000) & 0xFFFFU;
+	return htim->Instance->CNT;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim)
+{
+	htim->Instance->CR1 |= 1U;
+	return HAL_OK;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if (PinState == GPIO_PIN_RESET) {
+		GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+	} else {
+		GPIOx->ODR |= GPIO_Pin;
+	}
+	Pin_t *p = pin_of(GPIOx, GPIO_Pin);
+	if (p == NULL) return;
+	if (PinState == GPIO_PIN_RESET && !p->low) {
+		pin_fall(p, clockNs);
+	} else if (PinState == GPIO_PIN_SET && p->low) {
+		pin_rise(p, clockNs);
+	}
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	Pin_t *p = pin_of(GPIOx, GPIO_Pin);
+	if (p == NULL) return (GPIOx->ODR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	uint8_t held = clockNs >= p->heldFrom && clockNs < p->heldUntil;
+	return p->low || held ? GPIO_PIN_RESET : GPIO_PIN_SET;
+}
+
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	UNUSED(huart);
+}
+
+__attribute__((weak)) void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	UNUSED(huart);
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	uint32_t pclk = huart->Instance == USART1 ? PCLK2 : PCLK1;
+	huart->Instance->BRR = UART_BRR_SAMPLING16(pclk, huart->Init.BaudRate);
+	huart->Instance->CR1 |= USART_CR1_UE;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	p->txPending = 0;
+	p->rxPending = 0;
+	p->rxBuf = NULL;
+	p->rdrFull = 0;
+	huart->Instance->CR1 = 0;
+	huart->gState = HAL_UART_STATE_RESET;
+	huart->RxState = HAL_UART_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	SIM_PREEMPT();
+	UNUSED(Timeout);
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	if (huart->gState != HAL_UART_STATE_READY) return HAL_BUSY;
+	port_send(p, pData, Size);
+	run_until(p->busyUntil);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	SIM_PREEMPT();
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	if (huart->RxState != HAL_UART_STATE_READY) return HAL_BUSY;
+	for (uint16_t i = 0; i < Size; i++) {
+		if (!p->rdrFull) {
+			if (Timeout != HAL_MAX_DELAY) {
+				run_until(clockNs + (uint64_t)Timeout * 1000000);
+			}
+			return HAL_TIMEOUT;
+		}
+		run_until(p->rdrAt);
+		pData[i] = p->rdr;
+		p->rdrFull = 0;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	SIM_PREEMPT();
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	if (huart->gState != HAL_UART_STATE_READY) return HAL_BUSY;
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	port_send(p, pData, Size);
+	p->txPending = 1;
+	p->txDoneAt = p->busyUntil;
+	return HAL_OK;
+}
+
+static HAL_StatusTypeDef port_arm(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint8_t dma)
+{
+	SIM_PREEMPT();
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	if (huart->RxState != HAL_UART_STATE_READY) return HAL_BUSY;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	p->rxBuf = pData;
+	p->rxSize = Size;
+	p->rxCount = 0;
+	p->rxDma = dma;
+	if (dma) p->chrx.CNDTR = Size;
+	//A byte waiting in DR is taken at once, as the interrupt or DMA request is already there
+	if (p->rdrFull) {
+		p->rdrFull = 0;
+		port_received(p, p->rdr, clockNs);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	return port_arm(huart, pData, Size, 0);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	HAL_StatusTypeDef status = HAL_UART_Transmit_IT(huart, pData, Size);
+	if (status == HAL_OK && huart->hdmatx) huart->hdmatx->Instance->CNDTR = 0;
+	return status;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if (huart->hdmarx == NULL) return HAL_ERROR;
+	return port_arm(huart, pData, Size, 1);
+}
+
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart)
+{
+	SIM_PREEMPT();
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	p->txPending = 0;
+	p->rxPending = 0;
+	p->rxBuf = NULL;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart)
+{
+	SIM_PREEMPT();
+	Port_t *p = port_of(huart);
+	if (p == NULL) return HAL_ERROR;
+	p->rxPending = 0;
+	p->rxBuf = NULL;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
@@ -0,0 +1,267 @@
+#ifndef ONE_WIRE_SIM_h
+#define ONE_WIRE_SIM_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireSim.h
+ * @brief          : Simulated 1-Wire bus with virtual devices for host builds
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * The simulator takes the place of the UART, the diode and the wire.
+ * Every byte sent by a UART attached to a bus becomes one low pulse on the
+ * open-drain line: the start bit plus the trailing zero bits of the byte.
+ * What the pulse means is decided by the baud rate, as a real device would do
+ * by its length:
+ *   below 20000 baud          - standard speed reset, 0xF0 at 9600 is 520us
+ *   20000 to 100000 baud      - overdrive reset
+ *   100000 to 500000 baud     - standard speed slots, 0xFF is write 1 or read
+ *   500000 baud and above     - overdrive slots
+ * The devices answer with the presence pulse or by pulling the line low in
+ * a read slot, the UART receives the line as it is (wired AND).
+ *
+ * There is no real time. The clock is virtual and counted in microseconds,
+ * each UART byte takes 10 bit times of its bus. IT and DMA transfers finish
+ * when the clock reaches their end, then HAL_UART_TxCpltCallback and
+ * HAL_UART_RxCpltCallback are called like from the interrupt.
+ * HAL_GetTick moves the clock by 1us per call as the CPU would do while
+ * polling, HAL_Delay moves it by the delay.
+ *
+ * Buses run in parallel: each has its own busy time, so traffic on USART1
+ * does not delay USART2.
+ *
+ * A UART may talk to a DS2480B bridge instead of the line (@ref OWSIM_attachDs2480).
+ * A bus may be driven without a UART as well: by a GPIO pin (@ref OWSIM_attachPin),
+ * its pulses timed by the virtual timers of stm32f1xx_hal.h, or slot by slot
+ * (@ref OWSIM_busSlot) as the transport of OneWireSimTransport.h does.
+ *
+ * Usage:
+\code
+OWSIM_Bus_t bus;
+OWSIM_Device_t sensors[2];
+
+OWSIM_initBus(&bus);
+OWSIM_initDS18B20(&sensors[0], 0x000001, 0x0191); //25.0625
+OWSIM_initDS18B20(&sensors[1], 0x000002, 0xFF5E); //-10.125
+OWSIM_addDevice(&bus, &sensors[0]);
+OWSIM_addDevice(&bus, &sensors[1]);
+OWSIM_attach(&huart3, USART3, &bus);
+
+DS18B20_init(&ds18b20, &huart3, DS18B20_12BITS);
+\endcode
+ */
+
+#include "stm32f1xx_hal.h"
+
+#ifndef OWSIM_MAX_DEVICES
+#define OWSIM_MAX_DEVICES 256
+#endif
+
+///Conversion time of a virtual DS18B20 at 12 bits, halved for every bit less
+#define OWSIM_DS18B20_CONV_US 600000
+
+///Pins of @ref OWSIM_attachPin
+#define OWSIM_PIN_COUNT 4
+
+///Times of @ref OWSIM_busReset and @ref OWSIM_busSlot, the ones of Maxim AN126
+#define OWSIM_RESET_US    960
+#define OWSIM_OD_RESET_US 120
+#define OWSIM_SLOT_US     70
+#define OWSIM_OD_SLOT_US  10
+
+/**
+ * @brief  Virtual device on the simulated bus
+ * @note   The members before the comment "private" may be changed at any time
+ */
+typedef struct {
+	uint8_t rom[8];            /*!< Family, serial, CRC */
+	uint8_t connected;         /*!< 0 - the device is unplugged */
+	uint8_t overdrive;         /*!< Supports overdrive ROM commands */
+	uint8_t parasite;          /*!< Powered from the data line */
+	int16_t temperature;       /*!< DS18B20: raw value that the next conversion gives */
+	uint32_t convTimeUs;       /*!< DS18B20: conversion time at 12 bits */
+	uint8_t scratchpad[9];     /*!< DS18B20: scratchpad, byte 4 sets the resolution, CRC is recalculated */
+	uint8_t eeprom[3];         /*!< DS18B20: TH, TL and configuration */
+	uint32_t conversions;      /*!< DS18B20: amount of conversions done */
+	/* private */
+	uint8_t state;
+	uint8_t od;
+	uint8_t cmd;
+	uint8_t buf[9];
+	uint8_t pos;
+	uint8_t len;
+	uint8_t phase;
+	uint8_t alarm;
+	uint8_t converting;
+	uint8_t spoiled;
+	uint64_t busyUntil;
+} OWSIM_Device_t;
+
+/**
+ * @brief  Counters of a bus. They are never reset by the simulator
+ */
+typedef struct {
+	uint32_t resets;           /*!< Reset pulses */
+	uint32_t presences;        /*!< Reset pulses answered by a device */
+	uint32_t slots;            /*!< Read and write bit slots */
+	uint32_t uartBytes;        /*!< All the bytes sent by the UART */
+	uint32_t halCalls;         /*!< HAL_UART_* calls on the UART of the bus */
+	uint64_t busyNs;           /*!< Time the bus was busy with the traffic, ns */
+} OWSIM_Stats_t;
+
+/**
+ * @brief  Simulated bus
+ * @note   A parasite device gets the power for its conversion from strongPullup, which
+ *         must be set within 10us after Convert T. Without it the resistor can power
+ *         only one converting device, and any traffic during the conversion spoils it.
+ */
+typedef struct {
+	OWSIM_Device_t *devices[OWSIM_MAX_DEVICES];
+	uint16_t count;
+	uint8_t strongPullup;      /*!< Set by the user to power parasite devices */
+	OWSIM_Stats_t stats;
+	/* private */
+	uint8_t powerCheck;
+	uint64_t powerAt;
+} OWSIM_Bus_t;
+
+/**
+ * @brief Clears the bus, no devices on it
+ */
+void OWSIM_initBus(OWSIM_Bus_t *bus);
+
+/**
+ * @brief Puts a device on the bus
+ * @retval 0 - no room for the device
+ */
+uint8_t OWSIM_addDevice(OWSIM_Bus_t *bus, OWSIM_Device_t *dev);
+
+/**
+ * @brief Makes a device with the given family and serial number, CRC is calculated
+ * It answers only to the ROM commands.
+ */
+void OWSIM_initDevice(OWSIM_Device_t *dev, uint8_t family, uint64_t serial);
+
+/**
+ * @brief Makes a virtual DS18B20 (family 0x28) with power-up scratchpad, 12 bits,
+ * @ref OWSIM_DS18B20_CONV_US conversion time and external power.
+ * @param serial: 48 bit serial number
+ * @param temperature: raw value of the temperature in steps of 0.0625
+ */
+void OWSIM_initDS18B20(OWSIM_Device_t *dev, uint64_t serial, int16_t temperature);
+
+/**
+ * @brief Connects a UART handle to the bus, every UART instance has its own bus.
+ * The handle is initialized as HAL_UART_Init would do it.
+ * @param bus: NULL for a UART with nothing on the line, its bytes are only counted
+ */
+void OWSIM_attach(UART_HandleTypeDef *huart, USART_TypeDef *instance, OWSIM_Bus_t *bus);
+
+/**
+ * @brief Connects a UART handle to a DS2480B bridge on the bus (OneWireDs2480.h).
+ * The bridge does what its datasheet says for the commands the transport uses:
+ * the timing byte, the configuration (the baud rate changes at once, its own answer
+ * is already at the new rate), reset, single bit, the data mode with 0xE3 sent twice,
+ * the search accelerator. A byte at another baud rate than the bridge's is lost, unless
+ * it holds the line low for a whole frame of the bridge: that is a break, the bridge
+ * goes back to 9600 baud and waits for the timing byte. The answers go out after the
+ * slots of their byte, at the baud rate of the bridge. On the bus the resets and slots
+ * take the times of @ref OWSIM_busReset and @ref OWSIM_busSlot, flexible speed included.
+ * A search triplet nobody answers (1, 1) writes 1 and reports a discrepancy.
+ * @param bus: must not be NULL
+ */
+void OWSIM_attachDs2480(UART_HandleTypeDef *huart, USART_TypeDef *instance, OWSIM_Bus_t *bus);
+
+/**
+ * @brief Connects a GPIO pin to the bus as an open-drain line with its pull-up, for the
+ * slot engines which drive the line by themselves (OneWireGpio.h). The length of every
+ * low pulse decides what it is, as a real device does: 480us and more is a reset,
+ * 48us and more an overdrive reset if some device is in overdrive, less than 15us
+ * (5us in overdrive) a read or write 1 slot, the rest write 0. The presence pulse and
+ * the devices answering a read slot hold the line low for a while after the release:
+ * 15...135us and 30us, 2...18us and 6us in overdrive.
+ * The bus is busy from a falling edge to the next one, but not longer than the pulse
+ * takes by Maxim AN126: the reset and 480us (50us), @ref OWSIM_SLOT_US for a slot.
+ * @retval 0 - no room for the pin, there are @ref OWSIM_PIN_COUNT
+ */
+uint8_t OWSIM_attachPin(GPIO_TypeDef *port, uint16_t pin, OWSIM_Bus_t *bus);
+
+/**
+ * @brief Reset straight from the master, for the simulated transports which don't
+ * go through a UART or a pin. The clock goes by @ref OWSIM_RESET_US or @ref OWSIM_OD_RESET_US.
+ * @param od: 1 - overdrive reset, only the devices in overdrive answer it
+ * @retval 1 - some device answered
+ */
+uint8_t OWSIM_busReset(OWSIM_Bus_t *bus, uint8_t od);
+
+/**
+ * @brief One bit slot straight from the master, the clock goes by @ref OWSIM_SLOT_US
+ * or @ref OWSIM_OD_SLOT_US.
+ * @param masterBit: 1 - read or write 1, 0 - write 0
+ * @param od: 1 - overdrive slot
+ * @retval the line: 0 if the master or a device pulled it low
+ */
+uint8_t OWSIM_busSlot(OWSIM_Bus_t *bus, uint8_t masterBit, uint8_t od);
+
+/**
+ * @brief Links DMA channels to the UART handle as __HAL_LINKDMA does in CubeMX code
+ */
+void OWSIM_enableDMA(UART_HandleTypeDef *huart);
+
+/**
+ * @brief Called for each byte a UART sends. Use it to catch the bytes of a UART
+ * which is not connected to a bus.
+ */
+typedef void (*OWSIM_Sink_t)(USART_TypeDef *instance, uint8_t byte, void *ctx);
+void OWSIM_setSink(USART_TypeDef *instance, OWSIM_Sink_t sink, void *ctx);
+
+/**
+ * @brief Virtual time in microseconds
+ */
+uint64_t OWSIM_now(void);
+
+/**
+ * @brief Moves the virtual time forward. Transfers which end meanwhile call their callbacks.
+ */
+void OWSIM_advance(uint64_t us);
+
+/**
+ * @brief Resets the virtual clock and the state of the UARTs.
+ */
+void OWSIM_reset(void);
+
+/**
+ * @brief Calculates Dallas CRC8, independent of the library one
+ */
+uint8_t OWSIM_crc8(const uint8_t *data, uint8_t len);
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_SIM_h */
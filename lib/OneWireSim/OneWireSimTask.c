@@ -0,0 +1,166 @@
+#include "OneWireSimTask.h"
+
+#ifdef OWSIM_TASKS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "OneWireSim.h"
+
+/* The running task has the ticket being served, the others wait for theirs in turn */
+static pthread_mutex_t cpu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t turn = PTHREAD_COND_INITIALIZER;
+static unsigned long nextTicket;
+static unsigned long serving;
+static __thread OWSIM_Task_t *self;
+static OWSIM_Task_t *tasks;
+
+/* Gives the CPU to the next task and/or waits for it. Both at once, so the task
+ * yielding is queued behind all the others */
+static void cpuSwitch(uint8_t give, uint8_t take)
+{
+	pthread_mutex_lock(&cpu);
+	unsigned long ticket = take ? nextTicket++ : 0;
+	if (give) {
+		serving++;
+		pthread_cond_broadcast(&turn);
+	}
+	while (take && ticket != serving) pthread_cond_wait(&turn, &cpu);
+	pthread_mutex_unlock(&cpu);
+}
+
+static void *taskRun(void *arg)
+{
+	OWSIM_Task_t *task = (OWSIM_Task_t*)arg;
+	self = task;
+	cpuSwitch(0, 1);
+	task->fn(task->arg);
+	task->done = 1;
+	cpuSwitch(1, 0);
+	return NULL;
+}
+
+void OWSIM_taskStart(OWSIM_Task_t *task, OWSIM_TaskFunction_t fn, void *arg)
+{
+	task->fn = fn;
+	task->arg = arg;
+	task->waiting = 0;
+	task->done = 0;
+	task->mutex = NULL;
+	//Only the main thread adds the tasks, the running one may walk the list meanwhile
+	task->next = __atomic_load_n(&tasks, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&tasks, task, __ATOMIC_RELEASE);
+	if (pthread_create(&task->thread, NULL, taskRun, task) != 0) {
+		fprintf(stderr, "OWSIM_taskStart: no thread\n");
+		exit(2);
+	}
+}
+
+void OWSIM_taskJoin(OWSIM_Task_t *task)
+{
+	pthread_join(task->thread, NULL);
+}
+
+/* The task can run: it doesn't wait, its time has come or the mutex it waits for is free */
+static uint8_t taskReady(OWSIM_Task_t *t, uint64_t now)
+{
+	if (t->done) return 0;
+	return !t->waiting || now >= t->wakeUs || (t->mutex && !t->mutex->taken);
+}
+
+static uint8_t othersReady(uint64_t now)
+{
+	for (OWSIM_Task_t *t = __atomic_load_n(&tasks, __ATOMIC_ACQUIRE); t; t = t->next) {
+		if (t != self && taskReady(t, now)) return 1;
+	}
+	return 0;
+}
+
+void OWSIM_yield(void)
+{
+	//Only the tasks which can run get the CPU, so a waiting task costs nothing
+	if (self == NULL || !othersReady(OWSIM_now())) return;
+	cpuSwitch(1, 1);
+}
+
+/* Waits till wakeUs or till the mutex is free, the others run meanwhile */
+static void taskWait(OWSIM_Mutex_t *mutex, uint64_t wakeUs)
+{
+	self->mutex = mutex;
+	self->wakeUs = wakeUs;
+	self->waiting = 1;
+	for (;;) {
+		uint64_t now = OWSIM_now();
+		if (taskReady(self, now)) break;
+		if (othersReady(now)) {
+			cpuSwitch(1, 1);
+			continue;
+		}
+		//Everybody waits: the clock goes to the first one to wake up
+		uint64_t first = UINT64_MAX;
+		for (OWSIM_Task_t *t = __atomic_load_n(&tasks, __ATOMIC_ACQUIRE); t; t = t->next) {
+			if (!t->done && t->wakeUs < first) first = t->wakeUs;
+		}
+		if (first == UINT64_MAX) {
+			fprintf(stderr, "OWSIM: all the tasks wait for a mutex\n");
+			abort();
+		}
+		OWSIM_advance(first - now);
+	}
+	self->waiting = 0;
+	self->mutex = NULL;
+}
+
+uint8_t OWSIM_taskSleep(uint64_t wakeUs)
+{
+	if (self == NULL) return 0;
+	taskWait(NULL, wakeUs);
+	return 1;
+}
+
+void OWSIM_mutexInit(OWSIM_Mutex_t *mutex)
+{
+	mutex->taken = 0;
+	mutex->locks = 0;
+	mutex->contended = 0;
+	mutex->refused = 0;
+	mutex->maxWaitMs = 0;
+}
+
+uint8_t OWSIM_mutexLock(void *ctx, uint32_t waitMs)
+{
+	OWSIM_Mutex_t *m = (OWSIM_Mutex_t*)ctx;
+
+	if (m->taken) {
+		if (pthread_equal(m->owner, pthread_self())) {
+			fprintf(stderr, "OWSIM_mutexLock: the task has the mutex already\n");
+			abort();
+		}
+		m->contended++;
+		uint64_t start = OWSIM_now();
+		if (waitMs != 0 && self != NULL) {
+			taskWait(m, waitMs == HAL_MAX_DELAY ? UINT64_MAX : start + (uint64_t)waitMs * 1000);
+		}
+		if (m->taken) {
+			m->refused++;
+			return 0;
+		}
+		uint32_t waited = (uint32_t)((OWSIM_now() - start) / 1000);
+		if (waited > m->maxWaitMs) m->maxWaitMs = waited;
+	}
+	m->taken = 1;
+	m->owner = pthread_self();
+	m->locks++;
+	return 1;
+}
+
+void OWSIM_mutexUnlock(void *ctx)
+{
+	OWSIM_Mutex_t *m = (OWSIM_Mutex_t*)ctx;
+	if (!m->taken || !pthread_equal(m->owner, pthread_self())) {
+		fprintf(stderr, "OWSIM_mutexUnlock: the task doesn't have the mutex\n");
+		abort();
+	}
+	m->taken = 0;
+}
+
+#endif /* OWSIM_TASKS */
@@ -0,0 +1,142 @@
+#ifndef ONE_WIRE_SIM_TASK_h
+#define ONE_WIRE_SIM_TASK_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireSimTask.h
+ * @brief          : RTOS tasks on the simulator, made of pthreads
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * Build with -DOWSIM_TASKS -pthread, without OWSIM_TASKS this file is empty.
+ *
+ * Every task is a pthread, but they run one at a time as the tasks of an RTOS
+ * on one core do. Every HAL call of a task (HAL_GetTick, HAL_Delay, HAL_UART_*)
+ * switches to the next task which can run, in turn. So a transaction of one
+ * task is cut by the others at every bit slot, unless the bus is locked.
+ * The callbacks of the UARTs are never cut, they are the interrupts.
+ *
+ * HAL_Delay of a task doesn't run the clock for all: the task sleeps while the
+ * others work. A task waiting for the mutex sleeps too, till the mutex is free
+ * or its wait is over. When every task sleeps, the clock jumps to the first
+ * one to wake up.
+ *
+ * OWSIM_mutexLock and OWSIM_mutexUnlock are the hooks of OW_setLock: the mutex
+ * of the RTOS. Like a mutex of FreeRTOS it doesn't switch the tasks when it is
+ * given back: the task which keeps taking it without a HAL call between keeps
+ * it. Taking the mutex twice by one task is a bug, it stops the program.
+ *
+ * Usage:
+\code
+OWSIM_Mutex_t mutex;
+OWSIM_Task_t sweep, config;
+
+OWSIM_mutexInit(&mutex);
+DS18B20_setLock(&ds18b20, OWSIM_mutexLock, OWSIM_mutexUnlock, &mutex);
+DS18B20_init(&ds18b20, &huart3, DS18B20_12BITS);
+OWSIM_taskStart(&sweep, sweepTask, NULL);
+OWSIM_taskStart(&config, configTask, NULL);
+OWSIM_taskJoin(&sweep);
+OWSIM_taskJoin(&config);
+\endcode
+ */
+
+#ifdef OWSIM_TASKS
+
+#include <pthread.h>
+#include "stm32f1xx_hal.h"
+
+/**
+ * @brief  Mutex of the simulated RTOS
+ */
+typedef struct {
+	volatile uint8_t taken;
+	pthread_t owner;
+	uint32_t locks;            /*!< Times it was taken */
+	uint32_t contended;        /*!< Times a task found it taken */
+	uint32_t refused;          /*!< Times a task gave up: try-lock or the wait passed */
+	uint32_t maxWaitMs;        /*!< The longest wait of a task which got it, virtual time */
+} OWSIM_Mutex_t;
+
+typedef void (*OWSIM_TaskFunction_t)(void *arg);
+
+typedef struct OWSIM_Task {
+	pthread_t thread;
+	OWSIM_TaskFunction_t fn;
+	void *arg;
+	/* private */
+	volatile uint8_t waiting;
+	volatile uint8_t done;
+	uint64_t wakeUs;           /*!< The end of the wait, virtual us */
+	OWSIM_Mutex_t *mutex;      /*!< The wait ends when it is free */
+	struct OWSIM_Task *next;
+} OWSIM_Task_t;
+
+/**
+ * @brief Starts the task, it runs when the running one calls the HAL or ends
+ */
+void OWSIM_taskStart(OWSIM_Task_t *task, OWSIM_TaskFunction_t fn, void *arg);
+
+/**
+ * @brief Waits for the end of the task. Called by the main thread, which is not a task
+ */
+void OWSIM_taskJoin(OWSIM_Task_t *task);
+
+/**
+ * @brief Lets the next task which can run have the CPU. The simulator calls it, a task could too
+ */
+void OWSIM_yield(void);
+
+/**
+ * @brief HAL_Delay of a task: it sleeps till wakeUs of @ref OWSIM_now and the others run.
+ * When all the tasks sleep, the clock jumps to the earliest wake time.
+ * @retval 0 - not a task, HAL_Delay runs the clock itself
+ */
+uint8_t OWSIM_taskSleep(uint64_t wakeUs);
+
+void OWSIM_mutexInit(OWSIM_Mutex_t *mutex);
+
+/**
+ * @brief Hook of OW_setLock
+ * @param ctx: the OWSIM_Mutex_t
+ * @param waitMs: 0 - don't wait, HAL_MAX_DELAY - forever, or virtual ms
+ */
+uint8_t OWSIM_mutexLock(void *ctx, uint32_t waitMs);
+
+/**
+ * @brief Hook of OW_setLock
+ */
+void OWSIM_mutexUnlock(void *ctx);
+
+#endif /* OWSIM_TASKS */
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_SIM_TASK_h */
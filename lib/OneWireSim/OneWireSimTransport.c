@@ -0,0 +1,51 @@
+#include "OneWireSimTransport.h"
+
+static uint8_t sim_reset(OneWire_t *ow, uint8_t speed)
+{
+	ow->status = HAL_OK;
+	return OWSIM_busReset((OWSIM_Bus_t*)ow->transportCtx, speed == OW_SPEED_OVERDRIVE);
+}
+
+static void sim_touch(OneWire_t *ow, uint8_t *slots, uint16_t len)
+{
+	OWSIM_Bus_t *bus = (OWSIM_Bus_t*)ow->transportCtx;
+	for (uint16_t i = 0; i < len; i++) {
+		slots[i] = OWSIM_busSlot(bus, slots[i] == WIRE_1, ow->speed) ? WIRE_1 : WIRE_0;
+	}
+	ow->status = HAL_OK;
+}
+
+static void sim_touchBytes(OneWire_t *ow, uint8_t *bytes, uint8_t len)
+{
+	OWSIM_Bus_t *bus = (OWSIM_Bus_t*)ow->transportCtx;
+	for (uint8_t i = 0; i < len; i++) {
+		uint8_t r = 0;
+		for (uint8_t j = 0; j < 8; j++) {
+			if (OWSIM_busSlot(bus, (bytes[i] >> j) & 1, ow->speed)) r |= 1 << j;
+		}
+		bytes[i] = r;
+	}
+	ow->status = HAL_OK;
+}
+
+static uint8_t sim_triplet(OneWire_t *ow, uint8_t direction)
+{
+	OWSIM_Bus_t *bus = (OWSIM_Bus_t*)ow->transportCtx;
+	ow->status = HAL_OK;
+	uint8_t id = OWSIM_busSlot(bus, 1, ow->speed);
+	uint8_t cmp = OWSIM_busSlot(bus, 1, ow->speed);
+	if (id && cmp) return OW_TRIPLET_NONE;
+	if (id != cmp) direction = id;
+	OWSIM_busSlot(bus, direction, ow->speed);
+	return id | (cmp << 1) | (direction ? OW_TRIPLET_DIR : 0);
+}
+
+const OW_Transport_t OWSIM_transport = {
+	.reset = sim_reset,
+	.touch = sim_touch,
+	.touchBytes = sim_touchBytes,
+	.triplet = sim_triplet,
+	.bulkSlots = OW_BULK_BYTES * 8,
+	.resetNs = { OWSIM_RESET_US * 1000, OWSIM_OD_RESET_US * 1000 },
+	.slotNs = { OWSIM_SLOT_US * 1000, OWSIM_OD_SLOT_US * 1000 },
+};
@@ -0,0 +1,65 @@
+#ifndef ONE_WIRE_SIM_TRANSPORT_h
+#define ONE_WIRE_SIM_TRANSPORT_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : OneWireSimTransport.h
+ * @brief          : Slot engine of OneWire.h straight on a simulated bus
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * A transport (OW_Transport_t) without any hardware under it: every reset and
+ * slot goes to the bus by OWSIM_busReset and OWSIM_busSlot, at the times of
+ * Maxim AN126. It has all the optional functions, so the protocol code of
+ * OneWire.h runs its fastest paths, as it would on a bridge which moves whole
+ * bytes. Use it to test the code above the slots, the UART and the GPIO pin
+ * of OneWireSim.h test the engines themselves.
+ *
+ * Usage:
+\code
+OWSIM_initBus(&bus);
+OWSIM_addDevice(&bus, &sensor);
+
+DS18B20_setTransport(&ds18b20, &OWSIM_transport, &bus);
+DS18B20_init(&ds18b20, NULL, DS18B20_12BITS);
+\endcode
+ */
+
+#include "OneWireSim.h"
+#include "OneWire.h"
+
+/**
+ * @brief  Give it to OW_setTransport with the OWSIM_Bus_t
+ */
+extern const OW_Transport_t OWSIM_transport;
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_SIM_TRANSPORT_h */
@@ -0,0 +1,237 @@
+#ifndef ONE_WIRE_SIM_HAL_h
+#define ONE_WIRE_SIM_HAL_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ ******************************************************************************
+ * @file           : stm32f1xx_hal.h
+ * @brief          : Host replacement of the STM32F1 HAL used by OneWire library
+ ******************************************************************************
+ * @attention
+ * Copyright 2021 Konstantin Toporov
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom
+ * the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE
+ * OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ ********************* Description *************************
+ * Only the part of the HAL that the library uses is here. Put this directory
+ * before the CubeMX includes (or instead of them) to build the library on a PC.
+ * UARTs and GPIO pins are connected to the simulated buses of OneWireSim.h,
+ * the time is virtual and advances with the traffic, see OneWireSim.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HAL_DMA_MODULE_ENABLED
+
+typedef enum {
+	HAL_OK       = 0x00U,
+	HAL_ERROR    = 0x01U,
+	HAL_BUSY     = 0x02U,
+	HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+typedef enum {
+	HAL_UART_STATE_RESET      = 0x00U,
+	HAL_UART_STATE_READY      = 0x20U,
+	HAL_UART_STATE_BUSY       = 0x24U,
+	HAL_UART_STATE_BUSY_TX    = 0x21U,
+	HAL_UART_STATE_BUSY_RX    = 0x22U
+} HAL_UART_StateTypeDef;
+
+#define HAL_UART_ERROR_NONE 0x00000000U
+#define HAL_UART_ERROR_ORE  0x00000008U
+
+typedef struct {
+	volatile uint32_t SR;
+	volatile uint32_t DR;
+	volatile uint32_t BRR;
+	volatile uint32_t CR1;
+	volatile uint32_t CR2;
+	volatile uint32_t CR3;
+	volatile uint32_t GTPR;
+} USART_TypeDef;
+
+typedef struct {
+	volatile uint32_t CCR;
+	volatile uint32_t CNDTR;
+	volatile uint32_t CPAR;
+	volatile uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+	DMA_Channel_TypeDef *Instance;
+	void *Parent;
+} DMA_HandleTypeDef;
+
+typedef struct {
+	uint32_t BaudRate;
+	uint32_t WordLength;
+	uint32_t StopBits;
+	uint32_t Parity;
+	uint32_t Mode;
+	uint32_t HwFlowCtl;
+	uint32_t OverSampling;
+} UART_InitTypeDef;
+
+typedef struct __UART_HandleTypeDef {
+	USART_TypeDef *Instance;
+	UART_InitTypeDef Init;
+	uint8_t *pTxBuffPtr;
+	uint16_t TxXferSize;
+	volatile uint16_t TxXferCount;
+	uint8_t *pRxBuffPtr;
+	uint16_t RxXferSize;
+	volatile uint16_t RxXferCount;
+	DMA_HandleTypeDef *hdmatx;
+	DMA_HandleTypeDef *hdmarx;
+	volatile HAL_UART_StateTypeDef gState;
+	volatile HAL_UART_StateTypeDef RxState;
+	volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define OWSIM_UART_COUNT 3
+extern USART_TypeDef OWSIM_usart[OWSIM_UART_COUNT];
+
+#define USART1 (&OWSIM_usart[0])
+#define USART2 (&OWSIM_usart[1])
+#define USART3 (&OWSIM_usart[2])
+
+#define USART_CR1_UE 0x2000U
+
+#define UART_WORDLENGTH_8B     0x00000000U
+#define UART_STOPBITS_1        0x00000000U
+#define UART_PARITY_NONE       0x00000000U
+#define UART_MODE_TX_RX        0x0000000CU
+#define UART_HWCONTROL_NONE    0x00000000U
+#define UART_OVERSAMPLING_16   0x00000000U
+
+#define UART_BRR_SAMPLING16(_PCLK_, _BAUD_) ((uint32_t)(((_PCLK_) + (_BAUD_) / 2U) / (_BAUD_)))
+
+#define __HAL_UART_ENABLE(__HANDLE__)  ((__HANDLE__)->Instance->CR1 |= USART_CR1_UE)
+#define __HAL_UART_DISABLE(__HANDLE__) ((__HANDLE__)->Instance->CR1 &= ~USART_CR1_UE)
+#define __HAL_UART_CLEAR_OREFLAG(__HANDLE__) OWSIM_clearOverrun(__HANDLE__)
+#define __HAL_UART_FLUSH_DRREGISTER(__HANDLE__) OWSIM_clearOverrun(__HANDLE__)
+#define __HAL_DMA_GET_COUNTER(__HANDLE__) ((__HANDLE__)->Instance->CNDTR)
+
+typedef struct {
+	volatile uint32_t CRL;
+	volatile uint32_t CRH;
+	volatile uint32_t IDR;
+	volatile uint32_t ODR;
+	volatile uint32_t BSRR;
+	volatile uint32_t BRR;
+	volatile uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0U,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_0  ((uint16_t)0x0001)
+#define GPIO_PIN_1  ((uint16_t)0x0002)
+#define GPIO_PIN_2  ((uint16_t)0x0004)
+#define GPIO_PIN_3  ((uint16_t)0x0008)
+#define GPIO_PIN_4  ((uint16_t)0x0010)
+#define GPIO_PIN_5  ((uint16_t)0x0020)
+#define GPIO_PIN_6  ((uint16_t)0x0040)
+#define GPIO_PIN_7  ((uint16_t)0x0080)
+#define GPIO_PIN_8  ((uint16_t)0x0100)
+#define GPIO_PIN_9  ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define OWSIM_GPIO_COUNT 3
+extern GPIO_TypeDef OWSIM_gpio[OWSIM_GPIO_COUNT];
+
+#define GPIOA (&OWSIM_gpio[0])
+#define GPIOB (&OWSIM_gpio[1])
+#define GPIOC (&OWSIM_gpio[2])
+
+typedef struct {
+	volatile uint32_t CR1;
+	volatile uint32_t CNT;
+	volatile uint32_t PSC;
+	volatile uint32_t ARR;
+} TIM_TypeDef;
+
+typedef struct {
+	TIM_TypeDef *Instance;
+} TIM_HandleTypeDef;
+
+#define OWSIM_TIM_COUNT 3
+extern TIM_TypeDef OWSIM_tim[OWSIM_TIM_COUNT];
+
+#define TIM2 (&OWSIM_tim[0])
+#define TIM3 (&OWSIM_tim[1])
+#define TIM4 (&OWSIM_tim[2])
+
+/* Every timer counts the virtual microseconds, a read takes 1us as a polling loop does */
+#define __HAL_TIM_GET_COUNTER(__HANDLE__) OWSIM_timCounter(__HANDLE__)
+
+#define __disable_irq() ((void)0)
+#define __enable_irq()  ((void)0)
+#define __get_PRIMASK() 0U
+#define __set_PRIMASK(X) ((void)(X))
+#define __DMB()         __sync_synchronize()
+
+#define UNUSED(X) (void)X
+
+void OWSIM_clearOverrun(UART_HandleTypeDef *huart);
+uint32_t OWSIM_timCounter(TIM_HandleTypeDef *htim);
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef *htim);
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_SIM_HAL_h */
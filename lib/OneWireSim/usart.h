@@ -0,0 +1,24 @@
+#ifndef ONE_WIRE_SIM_USART_h
+#define ONE_WIRE_SIM_USART_h
+
+/* C++ detection */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Host replacement of the CubeMX generated usart.h
+ * The handles are defined in OneWireSim.c
+ */
+#include "stm32f1xx_hal.h"
+
+extern UART_HandleTypeDef huart1;
+extern UART_HandleTypeDef huart2;
+extern UART_HandleTypeDef huart3;
+
+/* C++ detection */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* of ONE_WIRE_SIM_USART_h */
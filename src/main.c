@@ -25,10 +25,9 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-#include <stdio.h>
-#include <string.h>
 #include "OneWire.h"
 #include "Ds18B20.h"
+#include "Ds18B20Telemetry.h"
 
 /* USER CODE END Includes */
 
@@ -49,8 +48,10 @@
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
-char msg[64] = {0};
 Ds18B20_t ds18b20;
+DS18B20_RING_DEFINE(readings, MAX_DS18B20_SENSORS + 1);
+DS18B20_Reading_t batch[MAX_DS18B20_SENSORS];
+DS18B20_Telemetry_t telemetry;
 
 /* USER CODE END PV */
 
@@ -62,6 +63,10 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  DS18B20_telemetryTxCpltCallback(&telemetry, huart);
+}
 /* USER CODE END 0 */
 
 /**
@@ -97,14 +102,12 @@ int main(void)
   MX_TIM1_Init();
   /* USER CODE BEGIN 2 */
   DS18B20_init(&ds18b20, &huart3, DS18B20_12BITS);
+  DS18B20_setRing(&ds18b20, &readings);
+  DS18B20_telemetryInit(&telemetry, &huart1);
 
+  //huart1 carries the telemetry frames only, see the main loop for no sensors
   if (DS18B20_getSensorsAvailable(&ds18b20)) {
     DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
-    char msg1[] = "Temp started\n";
-    HAL_UART_Transmit(&huart1, (uint8_t*)msg1, strlen(msg1), HAL_MAX_DELAY);
-  } else {
-    char msg2[] = "no sensors found\n";
-    HAL_UART_Transmit(&huart1, (uint8_t*)msg2, strlen(msg2), HAL_MAX_DELAY);
   }
 
   /* USER CODE END 2 */
@@ -121,15 +124,19 @@ int main(void)
     if (sensors) {
       if (DS18B20_isTempReady(&ds18b20, 0)) {
         for (uint8_t s=0;s<sensors;s++) {
-            int16_t tempRaw = DS18B20_getTempRaw(&ds18b20, s);
-            sprintf(msg, "sensor #%d, temp raw = %d\n", s, tempRaw);
-            HAL_UART_Transmit(&huart1, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+            DS18B20_getTempRaw(&ds18b20, s);
+        }
+        //One frame for the cycle, it goes out by DMA during the next conversion
+        uint16_t n = DS18B20_ringDrain(&readings, batch, MAX_DS18B20_SENSORS);
+        for (uint16_t i=0;i<n;i++) {
+            DS18B20_telemetryAdd(&telemetry, &ds18b20, &batch[i]);
         }
+        DS18B20_telemetrySend(&telemetry);
         DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL); 
       }
     } else {
-      char msg3[] = "no sensors\n";
-      HAL_UART_Transmit(&huart1, (uint8_t*)msg3, strlen(msg3), HAL_MAX_DELAY);
+      //A frame of no readings: the device runs, but there are no sensors
+      DS18B20_telemetryHeartbeat(&telemetry);
     }
     HAL_Delay(250);
   }
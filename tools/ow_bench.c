@@ -0,0 +1,1080 @@
+/**
+ ******************************************************************************
+ * @file           : ow_bench.c
+ * @brief          : Bus-time benchmark of OneWire and DS18B20 operations
+ ******************************************************************************
+ * Runs every operation on the simulated bus (lib/OneWireSim) with 1 to 120
+ * sensors, with and without DMA, and prints what it costs in CSV. The OneWire
+ * and DS18B20 operations run on the other slot engines too: mode gpio is
+ * OneWireGpio.h on a simulated pin, sim the transport of OneWireSimTransport.h,
+ * ds2480 OneWireDs2480.h on a simulated DS2480B bridge.
+ *   op,mode,sensors,resets,slots,uart_bytes,hal_calls,bus_us,wall_us
+ * bus_us is the time the line was busy, wall_us is the virtual time the caller
+ * waited for the operation.
+ *
+ * With -b the results are compared to a baseline written before by -o.
+ * Any metric above the baseline by more than the tolerance (-t, percent) is
+ * a regression and the exit code is 1.
+ *
+ * -c adds the CPU cost of CRC8 on the host (bitwise loop against the table)
+ * to stderr, it is not compared to the baseline.
+ * -f prints the CPU cost of a 50 sensor report by sprintf and by DS18B20_format,
+ * the formatter is always checked against printf.
+ * -s prints the samples per second of the DS18B20 scheduler to stderr.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -O2 -Ilib/OneWireSim -Ilib/OneWire \
+ *       tools/ow_bench.c lib/OneWireSim/[A-Z]*.c lib/OneWire/[A-Z]*.c -o ow_bench
+ *   ./ow_bench -b tools/ow_bench_baseline.csv
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "OneWireSim.h"
+#include "OneWire.h"
+#include "Ds18B20.h"
+#include "Ds18B20Group.h"
+#include "OneWireGpio.h"
+#include "OneWireSimTransport.h"
+#include "OneWireDs2480.h"
+#include "usart.h"
+
+#define BENCH_MAX_SENSORS 120
+#define BENCH_MAX_RESULTS 1024
+//Buses of the group bench on USART3, USART1 and USART2
+#define BENCH_BUSES 3
+
+typedef struct {
+	char op[32];
+	char mode[8];
+	unsigned sensors;
+	unsigned long long v[6]; //resets, slots, uart_bytes, hal_calls, bus_us, wall_us
+} Result_t;
+
+static const char *metrics[] = { "resets", "slots", "uart_bytes", "hal_calls", "bus_us", "wall_us" };
+#define METRICS 6
+//wall_us includes polling and is not checked
+#define CHECKED_METRICS 5
+
+static const unsigned counts[] = { 1, 2, 5, 10, 20, 50, 100, 120 };
+
+/* The slot engines: the UART bit by bit and by DMA, a GPIO pin, the transport of the simulator, the bridge */
+#define MODE_BIT    0
+#define MODE_DMA    1
+#define MODE_GPIO   2
+#define MODE_SIM    3
+#define MODE_DS2480 4
+static const char *modes[] = { "bit", "dma", "gpio", "sim", "ds2480" };
+
+static OWSIM_Bus_t buses[BENCH_BUSES];
+static OWSIM_Device_t devices[BENCH_MAX_SENSORS * BENCH_BUSES];
+static Ds18B20_t ds18b20;
+DS18B20_POOL_DEFINE(pool, BENCH_MAX_SENSORS);
+static Ds18B20_t groupBus[BENCH_BUSES - 1];
+DS18B20_POOL_DEFINE(pool1, BENCH_MAX_SENSORS);
+DS18B20_POOL_DEFINE(pool2, BENCH_MAX_SENSORS);
+static int16_t temps[BENCH_BUSES][BENCH_MAX_SENSORS];
+static Ds18B20Group_t group;
+DS18B20_RING_DEFINE(ring, BENCH_MAX_SENSORS + 1);
+static DS18B20_Reading_t readings[BENCH_MAX_SENSORS];
+#define bus buses[0]
+static OneWire_t ow;
+static TIM_HandleTypeDef htim2 = { TIM2 };
+static OW_Gpio_t pin = { GPIOB, GPIO_PIN_0, &htim2 };
+static OW_Ds2480_t bridge;
+
+static Result_t results[BENCH_MAX_RESULTS];
+static unsigned resultsCount;
+
+static OWSIM_Stats_t before;
+static uint64_t startUs;
+
+/* sensors DS18B20 and as many other devices (switches 0x3A and EEPROMs 0x2D) if mixed */
+static void setupBus(unsigned sensors, int dma, int mixed)
+{
+	uint64_t seed = 0x2545F4914F6CDD1DULL;
+
+	OWSIM_reset();
+	for (unsigned b = 0; b < BENCH_BUSES; b++) OWSIM_initBus(&buses[b]);
+	for (unsigned i = 0; i < sensors; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		OWSIM_initDS18B20(&devices[i], (seed >> 16) & 0xFFFFFFFFFFFFULL, 0x0190 + i);
+		OWSIM_addDevice(&bus, &devices[i]);
+	}
+	for (unsigned i = sensors; mixed && i < sensors * 2; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		OWSIM_initDevice(&devices[i], (i & 1) ? 0x3A : 0x2D, (seed >> 16) & 0xFFFFFFFFFFFFULL);
+		OWSIM_addDevice(&bus, &devices[i]);
+	}
+	if (dma == MODE_GPIO) {
+		OWSIM_attachPin(GPIOB, GPIO_PIN_0, &bus);
+		HAL_TIM_Base_Start(&htim2);
+		OW_setTransport(&ow, &OW_gpioTransport, &pin);
+		DS18B20_setTransport(&ds18b20, &OW_gpioTransport, &pin);
+	} else if (dma == MODE_SIM) {
+		OW_setTransport(&ow, &OWSIM_transport, &bus);
+		DS18B20_setTransport(&ds18b20, &OWSIM_transport, &bus);
+	} else if (dma == MODE_DS2480) {
+		OWSIM_attachDs2480(&huart3, USART3, &bus);
+		OW_initDs2480(&bridge, &huart3);
+		OW_setTransport(&ow, &OW_ds2480Transport, &bridge);
+		DS18B20_setTransport(&ds18b20, &OW_ds2480Transport, &bridge);
+	} else {
+		OWSIM_attach(&huart3, USART3, &bus);
+		if (dma) OWSIM_enableDMA(&huart3);
+	}
+}
+
+/* The UART of the bus, NULL for the transports set by setupBus */
+static UART_HandleTypeDef *busUart(int mode)
+{
+	return mode == MODE_BIT || mode == MODE_DMA ? &huart3 : NULL;
+}
+
+/* All the buses together */
+static OWSIM_Stats_t totalStats(void)
+{
+	OWSIM_Stats_t t;
+	memset(&t, 0, sizeof(t));
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		t.resets += buses[b].stats.resets;
+		t.slots += buses[b].stats.slots;
+		t.uartBytes += buses[b].stats.uartBytes;
+		t.halCalls += buses[b].stats.halCalls;
+		t.busyNs += buses[b].stats.busyNs;
+	}
+	return t;
+}
+
+static void begin(void)
+{
+	before = totalStats();
+	startUs = OWSIM_now();
+}
+
+static void end(const char *op, int mode, unsigned sensors)
+{
+	Result_t *r = &results[resultsCount++];
+	snprintf(r->op, sizeof(r->op), "%s", op);
+	snprintf(r->mode, sizeof(r->mode), "%s", modes[mode]);
+	r->sensors = sensors;
+	OWSIM_Stats_t now = totalStats();
+	r->v[0] = now.resets - before.resets;
+	r->v[1] = now.slots - before.slots;
+	r->v[2] = now.uartBytes - before.uartBytes;
+	r->v[3] = now.halCalls - before.halCalls;
+	r->v[4] = (now.busyNs - before.busyNs) / 1000;
+	r->v[5] = OWSIM_now() - startUs;
+}
+
+static void benchOneWire(unsigned sensors, int dma)
+{
+	uint8_t rom[8];
+
+	setupBus(sensors, dma, 0);
+	OW_init(&ow, busUart(dma));
+
+	begin();
+	OW_reset(&ow);
+	end("OW_reset", dma, sensors);
+
+	OW_reset(&ow);
+	begin();
+	OW_select(&ow, devices[0].rom);
+	end("OW_select", dma, sensors);
+
+	begin();
+	uint8_t found = OW_first(&ow);
+	while (found) {
+		OW_getFullROM(&ow, rom);
+		found = OW_next(&ow);
+	}
+	end("OW_enumerate", dma, sensors);
+
+	//Select and read the scratchpad of the first sensor at both speeds
+	uint8_t data[9];
+	begin();
+	OW_reset(&ow);
+	OW_select(&ow, devices[0].rom);
+	OW_sendByte(&ow, OW_CMD_RSCRATCHPAD);
+	OW_receiveBytes(&ow, data, sizeof(data));
+	end("OW_readScratchpad", dma, sensors);
+
+	devices[0].overdrive = 1;
+	begin();
+	OW_reset(&ow);
+	OW_overdriveSelect(&ow, devices[0].rom);
+	OW_sendByte(&ow, OW_CMD_RSCRATCHPAD);
+	OW_receiveBytes(&ow, data, sizeof(data));
+	end("OW_readScratchpad_od", dma, sensors);
+	if (OW_CRC8(data, sizeof(data)) != 0 || data[4] != 0x7F) {
+		fprintf(stderr, "overdrive read of the scratchpad failed\n");
+		exit(2);
+	}
+	OW_reset(&ow);
+	devices[0].overdrive = 0;
+
+	//The counters of the library see the same traffic as the simulator
+	OW_Stats_t st;
+	OW_getStats(&ow, &st, 0);
+	uint64_t simMs = bus.stats.busyNs / 1000000;
+	if (st.resets != bus.stats.resets || st.noPresence != bus.stats.resets - bus.stats.presences ||
+		st.slots != bus.stats.slots || st.timeouts || st.errors ||
+		st.busyMs + 1 + simMs / 50 < simMs || st.busyMs > simMs + 1 + simMs / 50) {
+		fprintf(stderr, "OW_getStats: %u resets, %u slots, %u ms, the bus: %u resets, %u slots, %llu ms\n",
+			(unsigned)st.resets, (unsigned)st.slots, (unsigned)st.busyMs,
+			(unsigned)bus.stats.resets, (unsigned)bus.stats.slots, (unsigned long long)simMs);
+		exit(2);
+	}
+}
+
+/* Checks the value against the device with the ROM of the sensor */
+static void check(Ds18B20_t *ds, OWSIM_Device_t *devs, unsigned sensors, unsigned s, int16_t t)
+{
+	uint8_t rom[8];
+	unsigned d = 0;
+	DS18B20_getROM(ds, s, rom);
+	while (d < sensors && memcmp(devs[d].rom, rom, 8)) d++;
+	if (d == sensors || t != devs[d].temperature) {
+		fprintf(stderr, "DS18B20_getTempRaw failed on sensor %u: %d\n", s, t);
+		exit(2);
+	}
+}
+
+/* Starts publishing to the empty ring */
+static void ringStart(Ds18B20_t *ds)
+{
+	while (DS18B20_ringDrain(&ring, readings, BENCH_MAX_SENSORS));
+	DS18B20_setRing(ds, &ring);
+}
+
+/* Every sensor was read once, the ring and the latest values have it */
+static void ringCheck(Ds18B20_t *ds, OWSIM_Device_t *devs, unsigned sensors)
+{
+	uint16_t n = DS18B20_ringDrain(&ring, readings, BENCH_MAX_SENSORS);
+	DS18B20_setRing(ds, NULL);
+	if (n != sensors || ring.dropped) {
+		fprintf(stderr, "DS18B20_ringDrain gave %u readings of %u\n", n, sensors);
+		exit(2);
+	}
+	for (unsigned i = 0; i < n; i++) {
+		int16_t latest;
+		uint32_t age;
+		if (readings[i].status != DS18B20_READING_OK || !DS18B20_getLatest(ds, readings[i].sensor, &latest, &age) ||
+			latest != readings[i].raw || age > OWSIM_now() / 1000) {
+			fprintf(stderr, "reading %u of sensor %u is wrong\n", i, readings[i].sensor);
+			exit(2);
+		}
+		check(ds, devs, sensors, readings[i].sensor, readings[i].raw);
+	}
+}
+
+/* Reads all the sensors and checks the values */
+static void sweep(unsigned sensors)
+{
+	for (unsigned s = 0; s < sensors; s++) {
+		check(&ds18b20, devices, sensors, s, DS18B20_getTempRaw(&ds18b20, s));
+	}
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	DS18B20_groupTxCpltCallback(&group, huart);
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	DS18B20_groupRxCpltCallback(&group, huart);
+}
+
+/* sensors on each of 3 buses: blocking bus after bus against the group */
+static void benchGroup(unsigned sensors, int dma)
+{
+	static UART_HandleTypeDef *const huarts[BENCH_BUSES] = { &huart3, &huart1, &huart2 };
+	static USART_TypeDef *const instances[BENCH_BUSES] = { USART3, USART1, USART2 };
+	Ds18B20_t *ds[BENCH_BUSES] = { &ds18b20, &groupBus[0], &groupBus[1] };
+	const DS18B20_Pool_t *pools[BENCH_BUSES] = { &pool, &pool1, &pool2 };
+
+	setupBus(sensors, dma, 0);
+	for (unsigned b = 1; b < BENCH_BUSES; b++) {
+		for (unsigned i = 0; i < sensors; i++) {
+			OWSIM_Device_t *d = &devices[b * BENCH_MAX_SENSORS + i];
+			*d = devices[i];
+			OWSIM_addDevice(&buses[b], d);
+		}
+		OWSIM_attach(huarts[b], instances[b], &buses[b]);
+		if (dma) OWSIM_enableDMA(huarts[b]);
+	}
+	DS18B20_groupInit(&group);
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		DS18B20_initWithPool(ds[b], huarts[b], DS18B20_12BITS, pools[b]);
+	}
+
+	begin();
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		DS18B20_startMeasure(ds[b], DS18B20_MEASUREALL);
+	}
+	while (!DS18B20_isTempReady(ds[BENCH_BUSES - 1], 0)) {
+		HAL_Delay(1);
+	}
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		for (unsigned s = 0; s < sensors; s++) {
+			temps[b][s] = DS18B20_getTempRaw(ds[b], s);
+		}
+	}
+	end("DS18B20_serialReadAll_3bus", dma, sensors);
+
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		DS18B20_groupAdd(&group, ds[b], temps[b]);
+		for (unsigned s = 0; s < sensors; s++) temps[b][s] = 0;
+	}
+	ringStart(&ds18b20);
+	begin();
+	DS18B20_groupReadAll(&group);
+	end("DS18B20_groupReadAll_3bus", dma, sensors);
+	ringCheck(&ds18b20, devices, sensors);
+	for (unsigned b = 0; b < BENCH_BUSES; b++) {
+		for (unsigned s = 0; s < sensors; s++) {
+			check(ds[b], &devices[b * BENCH_MAX_SENSORS], sensors, s, temps[b][s]);
+		}
+	}
+	//The blocking benches don't use the interrupts
+	DS18B20_groupInit(&group);
+}
+
+static int schedReport;
+static unsigned schedSamples;
+
+static void schedDone(Ds18B20_t *ds, uint8_t sensor, int16_t t)
+{
+	check(ds, devices, ds->sensors_found, sensor, t);
+	schedSamples++;
+}
+
+static unsigned schedCalls;
+
+static void schedCount(Ds18B20_t *ds, uint8_t sensor, int16_t t)
+{
+	(void)ds;
+	(void)sensor;
+	(void)t;
+	schedCalls++;
+}
+
+/* Scheduler with 1, 2 and 4 groups reading every sensor 3 times */
+static void benchScheduler(unsigned sensors, int dma)
+{
+	static const uint8_t groups[] = { 1, 2, 4 };
+
+	for (unsigned i = 0; i < sizeof(groups); i++) {
+		char op[32];
+		DS18B20_SchedulerStats_t stats;
+
+		setupBus(sensors, dma, 0);
+		DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+		schedSamples = 0;
+
+		begin();
+		DS18B20_schedulerStart(&ds18b20, groups[i], schedDone);
+		while (schedSamples < sensors * 3) {
+			if (!DS18B20_schedulerPoll(&ds18b20)) HAL_Delay(1);
+		}
+		DS18B20_getSchedulerStats(&ds18b20, &stats);
+		DS18B20_schedulerStop(&ds18b20);
+		snprintf(op, sizeof(op), "DS18B20_scheduler_g%u", groups[i]);
+		end(op, dma, sensors);
+
+		if (schedReport) {
+			fprintf(stderr, "%s,%s,%u,%u.%03u\n", op, dma ? "dma" : "bit", sensors,
+				(unsigned)(stats.rate / 1000), (unsigned)(stats.rate % 1000));
+		}
+	}
+
+	//An unplugged sensor is counted as a failure, not as a sample of the rate
+	setupBus(sensors, dma, 0);
+	DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+	devices[0].connected = 0;
+	schedCalls = 0;
+	DS18B20_schedulerStart(&ds18b20, 1, schedCount);
+	while (schedCalls < sensors * 3) {
+		if (!DS18B20_schedulerPoll(&ds18b20)) HAL_Delay(1);
+	}
+	DS18B20_SchedulerStats_t stats;
+	DS18B20_getSchedulerStats(&ds18b20, &stats);
+	DS18B20_schedulerStop(&ds18b20);
+	if (stats.failures != 3 || stats.samples != schedCalls - 3) {
+		fprintf(stderr, "DS18B20_getSchedulerStats: %u samples, %u failures of %u reads\n",
+			(unsigned)stats.samples, (unsigned)stats.failures, schedCalls);
+		exit(2);
+	}
+}
+
+/* The same amount of DS18B20 and other devices */
+static void benchMixed(unsigned sensors, int dma)
+{
+	uint8_t rom[8];
+	unsigned found = 0;
+
+	setupBus(sensors, dma, 1);
+	OW_init(&ow, &huart3);
+
+	begin();
+	uint8_t status = OW_first(&ow);
+	while (status) {
+		OW_getFullROM(&ow, rom);
+		status = OW_next(&ow);
+	}
+	end("OW_enumerate_mixed", dma, sensors);
+
+	begin();
+	status = OW_targetFamily(&ow, DS18B20_FAMILY);
+	while (status) {
+		if (OW_getROM(&ow, 0) == DS18B20_FAMILY) found++;
+		status = OW_nextInFamily(&ow);
+	}
+	end("OW_targetFamily_mixed", dma, sensors);
+	if (found != sensors) {
+		fprintf(stderr, "OW_targetFamily found %u of %u sensors\n", found, sensors);
+		exit(2);
+	}
+
+	begin();
+	DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+	end("DS18B20_init_mixed", dma, sensors);
+	if (DS18B20_getSensorsAvailable(&ds18b20) != sensors) {
+		fprintf(stderr, "DS18B20_init found %u of %u sensors on mixed bus\n",
+			DS18B20_getSensorsAvailable(&ds18b20), sensors);
+		exit(2);
+	}
+}
+
+static void benchDs18B20(unsigned sensors, int dma)
+{
+	setupBus(sensors, dma, 0);
+
+	begin();
+	DS18B20_initWithPool(&ds18b20, busUart(dma), DS18B20_12BITS, &pool);
+	end("DS18B20_init", dma, sensors);
+
+	if (DS18B20_getSensorsAvailable(&ds18b20) != sensors) {
+		fprintf(stderr, "DS18B20_init found %u of %u sensors\n",
+			DS18B20_getSensorsAvailable(&ds18b20), sensors);
+		exit(2);
+	}
+
+	begin();
+	DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+	end("DS18B20_startMeasure", dma, sensors);
+
+	while (!DS18B20_isTempReady(&ds18b20, 0)) {
+		HAL_Delay(1);
+	}
+
+	ringStart(&ds18b20);
+	begin();
+	sweep(sensors);
+	end("DS18B20_getTempRaw_sweep", dma, sensors);
+	ringCheck(&ds18b20, devices, sensors);
+
+	for (unsigned s = 0; s < sensors; s++) {
+		DS18B20_SensorStats_t st;
+		DS18B20_getStats(&ds18b20, s, &st, 1);
+		if (st.reads != 1 || st.crcErrors || st.failures) {
+			fprintf(stderr, "DS18B20_getStats of sensor %u: %u reads, %u CRC errors, %u failures\n",
+				s, st.reads, st.crcErrors, st.failures);
+			exit(2);
+		}
+	}
+
+	//Latency of the conversion: the timer against the read slots every 5 ms
+	DS18B20_setReadyMode(&ds18b20, DS18B20_READY_POLL, 5);
+	begin();
+	DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+	while (!DS18B20_isTempReady(&ds18b20, 0)) {
+		HAL_Delay(1);
+	}
+	end("DS18B20_waitReady_poll", dma, sensors);
+	DS18B20_setReadyMode(&ds18b20, DS18B20_READY_TIMER, 0);
+	begin();
+	DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+	while (!DS18B20_isTempReady(&ds18b20, 0)) {
+		HAL_Delay(1);
+	}
+	end("DS18B20_waitReady_timer", dma, sensors);
+
+	DS18B20_setReadMode(&ds18b20, DS18B20_READ_TEMP_ONLY, 0, 0);
+	begin();
+	sweep(sensors);
+	end("DS18B20_getTempRaw_temponly", dma, sensors);
+
+	//The first sweep of hybrid mode reads all in full
+	DS18B20_setReadMode(&ds18b20, DS18B20_READ_HYBRID, 8, 16);
+	sweep(sensors);
+	begin();
+	sweep(sensors);
+	end("DS18B20_getTempRaw_hybrid", dma, sensors);
+
+	//The sensors are at 25...32 degrees, those at 30 and above alarm
+	DS18B20_setReadMode(&ds18b20, DS18B20_READ_FULL, 0, 0);
+	DS18B20_setAlarm(&ds18b20, DS18B20_MEASUREALL, 30, -10);
+	DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+	while (!DS18B20_isTempReady(&ds18b20, 0)) {
+		HAL_Delay(1);
+	}
+	unsigned expected = 0;
+	for (unsigned d = 0; d < sensors; d++) {
+		if ((devices[d].temperature >> 4) >= 30) expected++;
+	}
+
+	uint8_t alarmed[BENCH_MAX_SENSORS];
+	int16_t temps[BENCH_MAX_SENSORS];
+	begin();
+	uint8_t n = DS18B20_readAlarmed(&ds18b20, alarmed, temps, BENCH_MAX_SENSORS);
+	end("DS18B20_readAlarmed", dma, sensors);
+	if (n != expected) {
+		fprintf(stderr, "DS18B20_readAlarmed found %u of %u sensors\n", n, expected);
+		exit(2);
+	}
+	for (unsigned i = 0; i < n; i++) {
+		if ((temps[i] >> 4) < 30) {
+			fprintf(stderr, "DS18B20_readAlarmed: sensor %u is not in alarm: %d\n", alarmed[i], temps[i]);
+			exit(2);
+		}
+	}
+
+	//A 9 bit sensor is not held to the time of the 12 bit ones
+	DS18B20_setResolution(&ds18b20, 0, DS18B20_9BITS);
+	begin();
+	DS18B20_startMeasure(&ds18b20, 0);
+	while (!DS18B20_isTempReady(&ds18b20, 0)) {
+		HAL_Delay(1);
+	}
+	end("DS18B20_waitReady_9bit", dma, sensors);
+	int16_t t = DS18B20_getTempRaw(&ds18b20, 0);
+	if (t <= DS18B20_TEMP_NOT_READ || (t & 7)) {
+		fprintf(stderr, "DS18B20 9 bits: wrong temperature %d\n", t);
+		exit(2);
+	}
+
+	//The read slot after the 9 bit sensor says nothing about the 12 bit one started before it
+	if (sensors > 1) {
+		uint8_t rom[8];
+		unsigned d = 0;
+		DS18B20_getROM(&ds18b20, 1, rom);
+		while (memcmp(devices[d].rom, rom, 8)) d++;
+		devices[d].temperature += 16;
+		DS18B20_setReadyMode(&ds18b20, DS18B20_READY_POLL, 5);
+		DS18B20_startMeasure(&ds18b20, 1);
+		DS18B20_startMeasure(&ds18b20, 0);
+		while (!DS18B20_isTempReady(&ds18b20, 1)) {
+			HAL_Delay(1);
+		}
+		check(&ds18b20, devices, sensors, 1, DS18B20_getTempRaw(&ds18b20, 1));
+		DS18B20_setReadyMode(&ds18b20, DS18B20_READY_TIMER, 0);
+	}
+
+	//Back to the configuration of the init, kept in the EEPROM over the power cycle
+	DS18B20_setResolution(&ds18b20, DS18B20_MEASUREALL, DS18B20_12BITS);
+	DS18B20_setAlarm(&ds18b20, DS18B20_MEASUREALL, DS18B20_ALARM_HIGH_OFF, DS18B20_ALARM_LOW_OFF);
+	begin();
+	DS18B20_saveConfig(&ds18b20, DS18B20_MEASUREALL);
+	end("DS18B20_saveConfig", dma, sensors);
+	for (unsigned d = 0; d < sensors; d++) {
+		memcpy(&devices[d].scratchpad[2], devices[d].eeprom, 3);
+	}
+
+	begin();
+	DS18B20_initWithPool(&ds18b20, busUart(dma), DS18B20_12BITS, &pool);
+	end("DS18B20_init_warm", dma, sensors);
+	uint8_t precision;
+	int8_t high, low;
+	if (!DS18B20_getConfig(&ds18b20, sensors - 1, &high, &low, &precision) ||
+	    high != DS18B20_ALARM_HIGH_OFF || low != DS18B20_ALARM_LOW_OFF || precision != DS18B20_12BITS) {
+		fprintf(stderr, "DS18B20_init_warm: the configuration is not kept\n");
+		exit(2);
+	}
+}
+
+static void strongPullup(Ds18B20_t *ds, uint8_t on)
+{
+	(void)ds;
+	bus.strongPullup = on;
+}
+
+/* Every other sensor powered from the line: convert and read all, without and with the strong pull-up.
+ * The last one reads right after the start, the read starts the rest of the parasite sensors
+ * and waits for them, so the external powered ones are done too */
+static void benchParasite(unsigned sensors, int dma)
+{
+	static const char *const ops[] = { "DS18B20_parasite_cycle", "DS18B20_parasite_pullup", "DS18B20_parasite_scheduler",
+	                                   "DS18B20_parasite_read_at_once" };
+
+	for (unsigned i = 0; i < 4; i++) {
+		//With one parasite sensor or none nothing waits for the conversion before the read
+		if (i == 3 && sensors / 2 < 2) break;
+		setupBus(sensors, dma, 0);
+		for (unsigned d = 1; d < sensors; d += 2) devices[d].parasite = 1;
+		DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+
+		unsigned parasites = 0;
+		for (unsigned s = 0; s < sensors; s++) parasites += DS18B20_isParasite(&ds18b20, s);
+		if (parasites != sensors / 2) {
+			fprintf(stderr, "DS18B20_isParasite found %u of %u sensors\n", parasites, sensors / 2);
+			exit(2);
+		}
+		if (i == 1) DS18B20_setStrongPullup(&ds18b20, strongPullup);
+
+		//A spoiled conversion gives 85 degrees, the sweep checks every value
+		begin();
+		if (i < 2 || i == 3) {
+			uint32_t started = HAL_GetTick();
+			DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+			//No more than one conversion of a parasite sensor left from init
+			if (HAL_GetTick() - started > 760) {
+				fprintf(stderr, "%s: DS18B20_startMeasure blocked for %u ms\n", ops[i],
+					(unsigned)(HAL_GetTick() - started));
+				exit(2);
+			}
+			while (i < 2 && !DS18B20_isTempReady(&ds18b20, DS18B20_MEASUREALL)) {
+				HAL_Delay(1);
+			}
+			sweep(sensors);
+		} else {
+			schedSamples = 0;
+			DS18B20_schedulerStart(&ds18b20, 4, schedDone);
+			while (schedSamples < sensors) {
+				if (!DS18B20_schedulerPoll(&ds18b20)) HAL_Delay(1);
+			}
+			DS18B20_schedulerStop(&ds18b20);
+		}
+		end(ops[i], dma, sensors);
+	}
+	bus.strongPullup = 0;
+}
+
+/* Converts and reads all the sensors but the dead one, returns what the dead one gave */
+static int16_t deadCycle(unsigned sensors, unsigned dead)
+{
+	int16_t deadT = DS18B20_TEMP_NOT_READ;
+	DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+	while (!DS18B20_isTempReady(&ds18b20, DS18B20_MEASUREALL)) {
+		HAL_Delay(1);
+	}
+	for (unsigned s = 0; s < sensors; s++) {
+		int16_t t = DS18B20_getTempRaw(&ds18b20, s);
+		if (s == dead) {
+			deadT = t;
+		} else {
+			check(&ds18b20, devices, sensors, s, t);
+		}
+	}
+	return deadT;
+}
+
+/* 8 cycles with an unplugged sensor, then it is plugged back and must rejoin.
+ * The last two read the temperature only, where the line left high is 0xFFFF */
+static void benchRetry(unsigned sensors, int dma)
+{
+	static const char *const ops[] = { "DS18B20_dead_sensor", "DS18B20_dead_quarantine", "DS18B20_dead_temponly",
+	                                   "DS18B20_dead_quarantine_temp" };
+	static const uint8_t quarantine[] = { 0, 1, 0, 1 };
+	uint8_t rom[8];
+
+	for (unsigned i = 0; i < 4; i++) {
+		setupBus(sensors, dma, 0);
+		DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+		if (quarantine[i]) DS18B20_setRetry(&ds18b20, 2, 1, 2, 8);
+		if (i >= 2) DS18B20_setReadMode(&ds18b20, DS18B20_READ_TEMP_ONLY, 0, 0);
+
+		unsigned dead = 0;
+		DS18B20_getROM(&ds18b20, dead, rom);
+		while (memcmp(rom, devices[0].rom, 8)) DS18B20_getROM(&ds18b20, ++dead, rom);
+		devices[0].connected = 0;
+
+		begin();
+		for (unsigned c = 0; c < 8; c++) {
+			if (deadCycle(sensors, dead) > DS18B20_TEMP_NOT_READ) {
+				fprintf(stderr, "%s: the unplugged sensor was read\n", ops[i]);
+				exit(2);
+			}
+		}
+		end(ops[i], dma, sensors);
+		if (DS18B20_isQuarantined(&ds18b20, dead) != quarantine[i]) {
+			fprintf(stderr, "%s: quarantine is %u\n", ops[i], DS18B20_isQuarantined(&ds18b20, dead));
+			exit(2);
+		}
+		//Nothing of the unplugged sensor is kept as its temperature
+		int16_t latest;
+		if (DS18B20_getLatest(&ds18b20, dead, &latest, NULL)) {
+			fprintf(stderr, "%s: the latest temperature of the unplugged sensor is %d\n", ops[i], latest);
+			exit(2);
+		}
+
+		devices[0].connected = 1;
+		unsigned c = 0;
+		while (deadCycle(sensors, dead) != devices[0].temperature) {
+			if (++c > 9) {
+				fprintf(stderr, "%s: the sensor did not rejoin\n", ops[i]);
+				exit(2);
+			}
+		}
+	}
+}
+
+/* 8 cycles with a sensor at -0.0625 degrees: its 0xFFFF is a reading, not a missing sensor.
+ * The last one has the quarantine on, which must not take the sensor */
+static void benchIce(unsigned sensors, int dma)
+{
+	static const char *const ops[] = { "DS18B20_ice_temponly", "DS18B20_ice_hybrid", "DS18B20_ice_quarantine" };
+	static const uint8_t modes[] = { DS18B20_READ_TEMP_ONLY, DS18B20_READ_HYBRID, DS18B20_READ_TEMP_ONLY };
+
+	for (unsigned i = 0; i < 3; i++) {
+		setupBus(sensors, dma, 0);
+		devices[0].temperature = -1;
+		DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+		DS18B20_setReadMode(&ds18b20, modes[i], 8, 16);
+		if (i == 2) DS18B20_setRetry(&ds18b20, 2, 1, 2, 8);
+
+		begin();
+		for (unsigned c = 0; c < 8; c++) {
+			deadCycle(sensors, sensors);
+		}
+		end(ops[i], dma, sensors);
+
+		for (unsigned s = 0; s < sensors; s++) {
+			DS18B20_SensorStats_t st;
+			DS18B20_getStats(&ds18b20, s, &st, 1);
+			if (st.failures) {
+				fprintf(stderr, "%s: %u failures of sensor %u\n", ops[i], st.failures, s);
+				exit(2);
+			}
+			if (DS18B20_isQuarantined(&ds18b20, s)) {
+				fprintf(stderr, "%s: sensor %u is in quarantine\n", ops[i], s);
+				exit(2);
+			}
+		}
+	}
+}
+
+/* ROM table of DS18B20_initWithStore in a file, as the flash does on the target */
+static uint8_t fileRead(void *ctx, uint16_t offset, uint8_t *data, uint16_t len)
+{
+	FILE *f = (FILE*)ctx;
+	return fseek(f, offset, SEEK_SET) == 0 && fread(data, 1, len, f) == len;
+}
+
+static uint8_t fileWrite(void *ctx, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+	FILE *f = (FILE*)ctx;
+	return fseek(f, offset, SEEK_SET) == 0 && fwrite(data, 1, len, f) == len && fflush(f) == 0;
+}
+
+static void benchStore(unsigned sensors, int dma)
+{
+	FILE *f = tmpfile();
+	if (f == NULL) {
+		fprintf(stderr, "can't create the ROM table file\n");
+		exit(2);
+	}
+	DS18B20_Store_t store = { fileRead, fileWrite, f };
+	setupBus(sensors, dma, 0);
+
+	//No table yet: the search, then the table is saved
+	begin();
+	uint8_t known = DS18B20_initWithStore(&ds18b20, &huart3, DS18B20_12BITS, &pool, &store);
+	end("DS18B20_init_store_cold", dma, sensors);
+	if (known || DS18B20_getSensorsAvailable(&ds18b20) != sensors) {
+		fprintf(stderr, "DS18B20_init_store_cold: %u of %u sensors, known %u\n",
+			DS18B20_getSensorsAvailable(&ds18b20), sensors, known);
+		exit(2);
+	}
+	uint8_t last[8], rom[8];
+	DS18B20_getROM(&ds18b20, sensors - 1, last);
+
+	//Every sensor answers by its ROM, no search
+	begin();
+	known = DS18B20_initWithStore(&ds18b20, &huart3, DS18B20_12BITS, &pool, &store);
+	end("DS18B20_init_store_warm", dma, sensors);
+	if (!known || DS18B20_getSensorsAvailable(&ds18b20) != sensors) {
+		fprintf(stderr, "DS18B20_init_store_warm: %u of %u sensors, known %u\n",
+			DS18B20_getSensorsAvailable(&ds18b20), sensors, known);
+		exit(2);
+	}
+
+	//The first sensor is gone and a new one comes: the search, the others keep their indices
+	devices[0].connected = 0;
+	unsigned added = sensors < BENCH_MAX_SENSORS;
+	if (added) {
+		OWSIM_initDS18B20(&devices[sensors], 0xABCDEF, 0x0190);
+		OWSIM_addDevice(&bus, &devices[sensors]);
+	}
+	begin();
+	known = DS18B20_initWithStore(&ds18b20, &huart3, DS18B20_12BITS, &pool, &store);
+	end("DS18B20_init_store_changed", dma, sensors);
+	DS18B20_getROM(&ds18b20, sensors - 1, rom);
+	if (known || DS18B20_getSensorsAvailable(&ds18b20) != sensors + added || memcmp(rom, last, 8)) {
+		fprintf(stderr, "DS18B20_init_store_changed: %u sensors, the indices are not kept\n",
+			DS18B20_getSensorsAvailable(&ds18b20));
+		exit(2);
+	}
+	if (added) {
+		DS18B20_getROM(&ds18b20, sensors, rom);
+		if (memcmp(rom, devices[sensors].rom, 8)) {
+			fprintf(stderr, "DS18B20_init_store_changed: the new sensor is not the last\n");
+			exit(2);
+		}
+	}
+	fclose(f);
+}
+
+/* The loop OW_CRC8 used before the table */
+static uint8_t crc8Bitwise(uint8_t crc, uint8_t inbyte)
+{
+	for (uint8_t i = 8; i; i--) {
+		uint8_t mix = (crc ^ inbyte) & 0x01;
+		crc >>= 1;
+		if (mix) crc ^= 0x8C;
+		inbyte >>= 1;
+	}
+	return crc;
+}
+
+static double nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void benchCrc(void)
+{
+	static uint8_t data[4096];
+	const unsigned rounds = 2000;
+	volatile uint8_t sink = 0;
+
+	for (unsigned i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 131 + 7);
+
+	double t0 = nowNs();
+	for (unsigned r = 0; r < rounds; r++) {
+		uint8_t crc = 0;
+		for (unsigned i = 0; i < sizeof(data); i++) crc = crc8Bitwise(crc, data[i]);
+		sink ^= crc;
+	}
+	double t1 = nowNs();
+	for (unsigned r = 0; r < rounds; r++) {
+		uint8_t crc = 0;
+		for (unsigned i = 0; i < sizeof(data); i++) crc = OW_CRC8_update(crc, data[i]);
+		sink ^= crc;
+	}
+	double t2 = nowNs();
+	for (unsigned r = 0; r < rounds; r++) {
+		sink ^= (uint8_t)OW_CRC16(data, sizeof(data), 0);
+	}
+	double t3 = nowNs();
+
+	double bytes = (double)rounds * sizeof(data);
+	fprintf(stderr, "crc,impl,ns_per_byte\n");
+	fprintf(stderr, "crc8,bitwise,%.3f\n", (t1 - t0) / bytes);
+	fprintf(stderr, "crc8,table,%.3f\n", (t2 - t1) / bytes);
+	fprintf(stderr, "crc16,nibble_parity,%.3f\n", (t3 - t2) / bytes);
+	fprintf(stderr, "crc8 speedup %.1fx\n", (t1 - t0) / (t2 - t1));
+	(void)sink;
+}
+
+/* The fixed point conversions and the formatter against printf, then a report of 50 sensors both ways */
+static void benchFormat(int timing)
+{
+	char buf[DS18B20_FORMAT_SIZE], ref[32];
+
+	for (int32_t raw = -880; raw <= 2000; raw++) {
+		int16_t t = (int16_t)raw;
+		DS18B20_format(buf, t, 4);
+		snprintf(ref, sizeof(ref), "%.4f", raw * 0.0625);
+		double half = raw < 0 ? -0.5 : 0.5;
+		if (strcmp(buf, ref) || DS18B20_toMilli(t) != (int32_t)(raw * 62.5 + half) ||
+			DS18B20_toCenti(t) != (int32_t)(raw * 6.25 + half) ||
+			DS18B20_fromMilli(DS18B20_toMilli(t)) != t) {
+			fprintf(stderr, "raw %d: %s, printf %s\n", raw, buf, ref);
+			exit(2);
+		}
+		DS18B20_formatDec(ref, DS18B20_toCenti(t), 2);
+		DS18B20_format(buf, t, 2);
+		if (strcmp(buf, ref)) {
+			fprintf(stderr, "raw %d: %s, centi %s\n", raw, buf, ref);
+			exit(2);
+		}
+	}
+	DS18B20_formatDec(buf, INT32_MIN, 0);
+	if (strcmp(buf, "-2147483648")) {
+		fprintf(stderr, "DS18B20_formatDec(INT32_MIN) gave %s\n", buf);
+		exit(2);
+	}
+	if (!timing) return;
+
+	static char report[50 * 32];
+	const unsigned rounds = 2000;
+	volatile char sink = 0;
+
+	double t0 = nowNs();
+	for (unsigned r = 0; r < rounds; r++) {
+		char *p = report;
+		for (unsigned s = 0; s < 50; s++) {
+			p += sprintf(p, "sensor #%u, temp = %.2f\n", s, DS18B20_convertToDouble((int16_t)(r + s * 37)));
+		}
+		sink ^= report[r % sizeof(report)];
+	}
+	double t1 = nowNs();
+	for (unsigned r = 0; r < rounds; r++) {
+		char *p = report;
+		for (unsigned s = 0; s < 50; s++) {
+			memcpy(p, "sensor #", 8);
+			p += 8;
+			p += DS18B20_formatDec(p, s, 0);
+			memcpy(p, ", temp = ", 9);
+			p += 9;
+			p += DS18B20_format(p, (int16_t)(r + s * 37), 2);
+			*p++ = '\n';
+		}
+		sink ^= report[r % sizeof(report)];
+	}
+	double t2 = nowNs();
+
+	fprintf(stderr, "format,impl,ns_per_report\n");
+	fprintf(stderr, "report50,sprintf_double,%.0f\n", (t1 - t0) / rounds);
+	fprintf(stderr, "report50,fixed_point,%.0f\n", (t2 - t1) / rounds);
+	fprintf(stderr, "format speedup %.1fx\n", (t1 - t0) / (t2 - t1));
+	(void)sink;
+}
+
+static void printResults(FILE *f)
+{
+	fprintf(f, "op,mode,sensors");
+	for (unsigned m = 0; m < METRICS; m++) fprintf(f, ",%s", metrics[m]);
+	fprintf(f, "\n");
+	for (unsigned i = 0; i < resultsCount; i++) {
+		Result_t *r = &results[i];
+		fprintf(f, "%s,%s,%u", r->op, r->mode, r->sensors);
+		for (unsigned m = 0; m < METRICS; m++) fprintf(f, ",%llu", r->v[m]);
+		fprintf(f, "\n");
+	}
+}
+
+static Result_t *findResult(const char *op, const char *mode, unsigned sensors)
+{
+	for (unsigned i = 0; i < resultsCount; i++) {
+		Result_t *r = &results[i];
+		if (r->sensors == sensors && !strcmp(r->op, op) && !strcmp(r->mode, mode)) return r;
+	}
+	return NULL;
+}
+
+/* Returns the amount of regressions */
+static unsigned compare(const char *path, double tolerance)
+{
+	char line[256];
+	unsigned regressions = 0;
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "can't open baseline %s\n", path);
+		exit(2);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		Result_t old;
+		memset(&old, 0, sizeof(old));
+		if (sscanf(line, "%31[^,],%7[^,],%u,%llu,%llu,%llu,%llu,%llu,%llu", old.op, old.mode, &old.sensors,
+				&old.v[0], &old.v[1], &old.v[2], &old.v[3], &old.v[4], &old.v[5]) != 3 + METRICS) {
+			continue; //header
+		}
+		Result_t *r = findResult(old.op, old.mode, old.sensors);
+		if (r == NULL) {
+			fprintf(stderr, "MISSING %s %s %u\n", old.op, old.mode, old.sensors);
+			regressions++;
+			continue;
+		}
+		for (unsigned m = 0; m < CHECKED_METRICS; m++) {
+			if ((double)r->v[m] > (double)old.v[m] * (1.0 + tolerance / 100.0)) {
+				fprintf(stderr, "REGRESSION %s %s %u %s: %llu -> %llu\n",
+					r->op, r->mode, r->sensors, metrics[m], old.v[m], r->v[m]);
+				regressions++;
+			}
+		}
+	}
+	fclose(f);
+	return regressions;
+}
+
+int main(int argc, char **argv)
+{
+	const char *baseline = NULL;
+	const char *output = NULL;
+	double tolerance = 1.0;
+	int crc = 0;
+	int format = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+			baseline = argv[++i];
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+			tolerance = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-c")) {
+			crc = 1;
+		} else if (!strcmp(argv[i], "-f")) {
+			format = 1;
+		} else if (!strcmp(argv[i], "-s")) {
+			schedReport = 1;
+		} else {
+			fprintf(stderr, "usage: %s [-o results.csv] [-b baseline.csv] [-t tolerance%%] [-c] [-f] [-s]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (schedReport) fprintf(stderr, "scheduler,mode,sensors,samples_per_s\n");
+	for (int dma = MODE_BIT; dma <= MODE_DMA; dma++) {
+		for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+			benchOneWire(counts[c], dma);
+			benchDs18B20(counts[c], dma);
+			benchMixed(counts[c], dma);
+			benchGroup(counts[c], dma);
+			benchScheduler(counts[c], dma);
+			benchStore(counts[c], dma);
+			benchParasite(counts[c], dma);
+			benchRetry(counts[c], dma);
+			benchIce(counts[c], dma);
+		}
+	}
+
+	//The other slot engines under the same protocol code, the UART asynchronous engine aside
+	for (int mode = MODE_GPIO; mode <= MODE_DS2480; mode++) {
+		for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+			benchOneWire(counts[c], mode);
+			benchDs18B20(counts[c], mode);
+		}
+	}
+
+	printResults(stdout);
+	if (crc) benchCrc();
+	benchFormat(format);
+	if (output) {
+		FILE *f = fopen(output, "w");
+		if (f == NULL) {
+			fprintf(stderr, "can't write %s\n", output);
+			return 2;
+		}
+		printResults(f);
+		fclose(f);
+	}
+
+	if (baseline) {
+		unsigned regressions = compare(baseline, tolerance);
+		if (regressions) {
+			fprintf(stderr, "%u regressions against %s\n", regressions, baseline);
+			return 1;
+		}
+		fprintf(stderr, "no regressions against %s\n", baseline);
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ ******************************************************************************
+ * @file           : ow_contention.c
+ * @brief          : Several tasks on one simulated bus, with and without the lock
+ ******************************************************************************
+ * Three tasks of OneWireSimTask.h share 20 simulated DS18B20 on USART3, they
+ * switch at every HAL call as on a single core RTOS which preempts them:
+ *   sweep  - measures all the sensors and reads them one by one, checks every value
+ *   config - sets the alarm thresholds of the sensors again and again, checks
+ *            them in the scratchpads of the simulated sensors
+ *   poll   - reads the sensors by DS18B20_tryGetTempRaw, counts how often the bus
+ *            was busy, checks the values it got
+ * The bus is locked by the mutex of the simulator, -n runs without it to show
+ * what the lock prevents. The wrong values, failed calls, the waits for the
+ * mutex and the virtual time go to stdout. The exit code is 2 if anything
+ * went wrong with the lock, -n always exits with 0.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -O2 -DOWSIM_TASKS -pthread -Ilib/OneWireSim -Ilib/OneWire \
+ *       tools/ow_contention.c lib/OneWireSim/[A-Z]*.c lib/OneWire/[A-Z]*.c -o ow_contention
+ *   ./ow_contention [sweeps]
+ *   ./ow_contention -n [sweeps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "OneWireSim.h"
+#include "OneWireSimTask.h"
+#include "OneWire.h"
+#include "Ds18B20.h"
+#include "usart.h"
+
+#ifndef OWSIM_TASKS
+#error "Build with -DOWSIM_TASKS -pthread"
+#endif
+
+#define SENSORS 20
+
+static OWSIM_Bus_t bus;
+static OWSIM_Device_t devices[SENSORS];
+static OWSIM_Device_t *bySensor[SENSORS];
+static Ds18B20_t ds18b20;
+DS18B20_POOL_DEFINE(pool, SENSORS);
+static OWSIM_Mutex_t mutex;
+
+static unsigned sweeps = 20;
+static volatile int sweeping;
+static volatile int measured;
+
+static unsigned long sweepReads, sweepWrong;
+static unsigned long configCalls, configFailed, configWrong;
+static unsigned long pollCalls, pollBusy, pollWrong;
+
+static void sweepTask(void *arg)
+{
+	UNUSED(arg);
+	for (unsigned n = 0; n < sweeps; n++) {
+		DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+		while (!DS18B20_isTempReady(&ds18b20, DS18B20_MEASUREALL)) HAL_Delay(5);
+		measured = 1;
+		for (uint8_t s = 0; s < SENSORS; s++) {
+			int16_t t = DS18B20_getTempRaw(&ds18b20, s);
+			sweepReads++;
+			if (t != bySensor[s]->temperature) sweepWrong++;
+		}
+	}
+	sweeping = 0;
+}
+
+static void configTask(void *arg)
+{
+	UNUSED(arg);
+	uint8_t s = 0;
+	int8_t high = 30;
+	while (sweeping) {
+		int8_t low = -high;
+		configCalls++;
+		if (!DS18B20_setAlarm(&ds18b20, s, high, low)) {
+			configFailed++;
+		} else if ((int8_t)bySensor[s]->scratchpad[2] != high || (int8_t)bySensor[s]->scratchpad[3] != low) {
+			configWrong++;
+		}
+		s = (s + 1) % SENSORS;
+		high = high == 90 ? 30 : high + 1;
+		HAL_Delay(2);
+	}
+}
+
+static void pollTask(void *arg)
+{
+	UNUSED(arg);
+	uint8_t s = 0;
+	//Before the first conversion the sensors have 85 degrees
+	while (!measured) HAL_Delay(1);
+	while (sweeping) {
+		int16_t t = DS18B20_tryGetTempRaw(&ds18b20, s);
+		pollCalls++;
+		if (t == DS18B20_TEMP_BUSY) {
+			pollBusy++;
+		} else if (t != bySensor[s]->temperature) {
+			pollWrong++;
+		}
+		s = (s + 1) % SENSORS;
+		HAL_Delay(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int locked = 1;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n")) {
+			locked = 0;
+		} else {
+			sweeps = (unsigned)atoi(argv[i]);
+			if (sweeps == 0) {
+				fprintf(stderr, "usage: %s [-n] [sweeps]\n", argv[0]);
+				return 1;
+			}
+		}
+	}
+
+	uint64_t seed = 0x2545F4914F6CDD1DULL;
+	OWSIM_reset();
+	OWSIM_initBus(&bus);
+	for (unsigned i = 0; i < SENSORS; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		OWSIM_initDS18B20(&devices[i], (seed >> 16) & 0xFFFFFFFFFFFFULL, (int16_t)(0x0100 + i * 53));
+		OWSIM_addDevice(&bus, &devices[i]);
+	}
+	OWSIM_attach(&huart3, USART3, &bus);
+	OWSIM_enableDMA(&huart3);
+
+	OWSIM_mutexInit(&mutex);
+	if (locked) DS18B20_setLock(&ds18b20, OWSIM_mutexLock, OWSIM_mutexUnlock, &mutex);
+	DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+	if (DS18B20_getSensorsAvailable(&ds18b20) != SENSORS) {
+		fprintf(stderr, "sensors found: %u, expected %u\n", DS18B20_getSensorsAvailable(&ds18b20), SENSORS);
+		return 2;
+	}
+	//The search gives the sensors in the order of their ROMs
+	for (uint8_t s = 0; s < SENSORS; s++) {
+		uint8_t rom[8];
+		DS18B20_getROM(&ds18b20, s, rom);
+		for (unsigned i = 0; i < SENSORS; i++) {
+			if (!memcmp(devices[i].rom, rom, 8)) bySensor[s] = &devices[i];
+		}
+	}
+
+	OWSIM_Task_t sweep, config, poll;
+	sweeping = 1;
+	OWSIM_taskStart(&sweep, sweepTask, NULL);
+	OWSIM_taskStart(&config, configTask, NULL);
+	OWSIM_taskStart(&poll, pollTask, NULL);
+	OWSIM_taskJoin(&sweep);
+	OWSIM_taskJoin(&config);
+	OWSIM_taskJoin(&poll);
+
+	printf("%s, %u sweeps of %u sensors, %.1f s of virtual time\n", locked ? "locked" : "not locked",
+	       sweeps, SENSORS, OWSIM_now() / 1e6);
+	printf("sweep:  %lu reads, %lu wrong\n", sweepReads, sweepWrong);
+	printf("config: %lu calls, %lu failed, %lu wrong\n", configCalls, configFailed, configWrong);
+	printf("poll:   %lu calls, %lu busy, %lu wrong\n", pollCalls, pollBusy, pollWrong);
+	if (locked) {
+		printf("mutex:  %lu locks, %lu contended, %lu refused, longest wait %lu ms\n",
+		       (unsigned long)mutex.locks, (unsigned long)mutex.contended,
+		       (unsigned long)mutex.refused, (unsigned long)mutex.maxWaitMs);
+	}
+
+	if (!locked) return 0;
+	return sweepWrong || configFailed || configWrong || pollWrong || pollCalls == pollBusy ? 2 : 0;
+}
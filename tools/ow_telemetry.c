@@ -0,0 +1,305 @@
+/**
+ ******************************************************************************
+ * @file           : ow_telemetry.c
+ * @brief          : Decoder of the DS18B20 telemetry frames on a PC
+ ******************************************************************************
+ * Reads the byte stream of Ds18B20Telemetry.h from a file, a serial port or
+ * stdin and prints every reading in CSV:
+ *   seq,sensor,id,raw,status,tick
+ * At the end the frames, broken frames (COBS, length or CRC), lost frames
+ * (gaps of the sequence numbers), readings and bytes go to stderr.
+ *
+ * -t runs the self test instead: 50 simulated sensors are read for the given
+ * amount of cycles (100 by default) and each cycle is sent as one frame by
+ * DMA at 115200 baud while the next cycle is read, a heartbeat frame of no
+ * readings ends the stream. The stream is decoded and checked against the
+ * sensors, then decoded again with broken frames in it.
+ * The bytes and the line time per cycle against the text report of src/main.c
+ * and the decoding speed go to stderr. The exit code is 2 if a check failed.
+ * With -o the stream of the test is written to a file to try the decoder on.
+ *
+ * Build and run from the root of the repository:
+ *   gcc -O2 -Ilib/OneWireSim -Ilib/OneWire \
+ *       tools/ow_telemetry.c lib/OneWireSim/[A-Z]*.c lib/OneWire/[A-Z]*.c -o ow_telemetry
+ *   ./ow_telemetry -t -o frames.bin && ./ow_telemetry frames.bin
+ *   stty -F /dev/ttyUSB0 115200 raw && ./ow_telemetry /dev/ttyUSB0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "OneWireSim.h"
+#include "OneWire.h"
+#include "Ds18B20.h"
+#include "Ds18B20Telemetry.h"
+#include "usart.h"
+
+#define TEST_SENSORS 50
+#define TEST_MAX_CYCLES 10000
+
+typedef struct {
+	uint8_t buf[DS18B20_TLM_FRAME_MAX];
+	uint16_t len;
+	int overflow;
+	int print;
+	unsigned long frames, broken, lost, readings, bytes;
+	int hasSeq;
+	uint16_t seq;
+	DS18B20_TelemetryHeader_t header;
+	DS18B20_TelemetryReading_t r[255];
+	int16_t count;
+} Decoder_t;
+
+static void decoderInit(Decoder_t *d, int print)
+{
+	memset(d, 0, sizeof(*d));
+	d->print = print;
+}
+
+/* Returns 1 when a frame ended, d->count is -1 for a broken one */
+static int decoderFeed(Decoder_t *d, uint8_t b)
+{
+	d->bytes++;
+	if (b) {
+		if (d->len < sizeof(d->buf)) {
+			d->buf[d->len++] = b;
+		} else {
+			d->overflow = 1;
+		}
+		return 0;
+	}
+	//0 right after 0 is not a frame
+	if (d->len == 0 && !d->overflow) return 0;
+
+	d->count = d->overflow ? -1 : DS18B20_telemetryDecode(d->buf, d->len, &d->header, d->r, 255);
+	d->len = 0;
+	d->overflow = 0;
+	if (d->count < 0) {
+		d->broken++;
+		return 1;
+	}
+
+	d->frames++;
+	d->readings += d->count;
+	if (d->hasSeq && d->header.seq != (uint16_t)(d->seq + 1)) d->lost += (uint16_t)(d->header.seq - d->seq - 1);
+	d->hasSeq = 1;
+	d->seq = d->header.seq;
+	if (d->print) {
+		for (int16_t i = 0; i < d->count; i++) {
+			printf("%u,%u,0x%04X,%d,%u,%u\n", d->header.seq, d->r[i].sensor, d->r[i].id, d->r[i].raw,
+				d->r[i].status, d->r[i].tick);
+		}
+	}
+	return 1;
+}
+
+static void decoderReport(Decoder_t *d)
+{
+	fprintf(stderr, "frames %lu, broken %lu, lost %lu, readings %lu, bytes %lu\n",
+		d->frames, d->broken, d->lost, d->readings, d->bytes);
+}
+
+static double nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static OWSIM_Bus_t bus;
+static OWSIM_Device_t devices[TEST_SENSORS];
+static Ds18B20_t ds18b20;
+DS18B20_POOL_DEFINE(pool, TEST_SENSORS);
+DS18B20_RING_DEFINE(ring, TEST_SENSORS + 1);
+static DS18B20_Telemetry_t telemetry;
+static uint8_t stream[TEST_MAX_CYCLES * DS18B20_TLM_FRAME_MAX];
+static size_t streamLen;
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	DS18B20_telemetryTxCpltCallback(&telemetry, huart);
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+	OW_rxCpltCallback(&ds18b20.ow, huart);
+}
+
+static void capture(USART_TypeDef *instance, uint8_t byte, void *ctx)
+{
+	(void)instance;
+	(void)ctx;
+	if (streamLen < sizeof(stream)) stream[streamLen++] = byte;
+}
+
+/* Bytes of the text line src/main.c sends for a reading */
+static unsigned textBytes(uint8_t sensor, int16_t raw)
+{
+	char buf[DS18B20_FORMAT_SIZE];
+	return 8 + DS18B20_formatDec(buf, sensor, 0) + 9 + DS18B20_format(buf, raw, 2) + 1;
+}
+
+static int fail(const char *what, unsigned long a, unsigned long b)
+{
+	fprintf(stderr, "%s: %lu, expected %lu\n", what, a, b);
+	return 2;
+}
+
+static int selfTest(unsigned cycles, const char *output)
+{
+	uint64_t seed = 0x2545F4914F6CDD1DULL;
+	DS18B20_Reading_t batch[TEST_SENSORS];
+	unsigned long text = 0, late = 0;
+
+	OWSIM_reset();
+	OWSIM_initBus(&bus);
+	for (unsigned i = 0; i < TEST_SENSORS; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		OWSIM_initDS18B20(&devices[i], (seed >> 16) & 0xFFFFFFFFFFFFULL, (int16_t)(0xFF5E + i * 37));
+		OWSIM_addDevice(&bus, &devices[i]);
+	}
+	OWSIM_attach(&huart3, USART3, &bus);
+	OWSIM_enableDMA(&huart3);
+	OWSIM_attach(&huart1, USART1, NULL);
+	OWSIM_enableDMA(&huart1);
+	OWSIM_setSink(USART1, capture, NULL);
+
+	DS18B20_initWithPool(&ds18b20, &huart3, DS18B20_12BITS, &pool);
+	if (DS18B20_getSensorsAvailable(&ds18b20) != TEST_SENSORS) {
+		return fail("sensors found", DS18B20_getSensorsAvailable(&ds18b20), TEST_SENSORS);
+	}
+	DS18B20_telemetryInit(&telemetry, &huart1);
+	DS18B20_setRing(&ds18b20, &ring);
+
+	//The frame of a cycle goes out while the next cycle is read
+	for (unsigned c = 0; c < cycles; c++) {
+		DS18B20_startMeasure(&ds18b20, DS18B20_MEASUREALL);
+		while (!DS18B20_isTempReady(&ds18b20, DS18B20_MEASUREALL)) OWSIM_advance(1000);
+		for (uint8_t s = 0; s < TEST_SENSORS; s++) DS18B20_getTempRaw(&ds18b20, s);
+		uint16_t n = DS18B20_ringDrain(&ring, batch, TEST_SENSORS);
+		for (uint16_t i = 0; i < n; i++) {
+			DS18B20_telemetryAdd(&telemetry, &ds18b20, &batch[i]);
+			text += textBytes(batch[i].sensor, batch[i].raw);
+		}
+		if (DS18B20_telemetryIsBusy(&telemetry)) late++;
+		while (!DS18B20_telemetrySend(&telemetry)) OWSIM_advance(100);
+	}
+	//What src/main.c sends without sensors
+	while (!DS18B20_telemetryHeartbeat(&telemetry)) OWSIM_advance(100);
+	while (DS18B20_telemetryIsBusy(&telemetry)) OWSIM_advance(100);
+
+	//Every reading is in the stream
+	Decoder_t d;
+	decoderInit(&d, 0);
+	unsigned long good = 0, empty = 0;
+	for (size_t i = 0; i < streamLen; i++) {
+		if (!decoderFeed(&d, stream[i]) || d.count < 0) continue;
+		if (d.header.seq != (uint16_t)(d.frames - 1)) return fail("seq", d.header.seq, d.frames - 1);
+		if (d.count == 0) empty++;
+		for (int16_t k = 0; k < d.count; k++) {
+			DS18B20_TelemetryReading_t *r = &d.r[k];
+			OWSIM_Device_t *dev = &devices[0];
+			uint8_t rom[8];
+			//The search gives the sensors in the order of their ROMs
+			DS18B20_getROM(&ds18b20, r->sensor, rom);
+			for (unsigned j = 0; j < TEST_SENSORS; j++) {
+				if (!memcmp(devices[j].rom, rom, 8)) dev = &devices[j];
+			}
+			if (r->status != DS18B20_READING_OK || r->raw != dev->temperature || r->id != OW_CRC16(dev->rom, 8, 0)) {
+				return fail("reading of sensor", r->sensor, k);
+			}
+			good++;
+		}
+	}
+	if (d.frames != cycles + 1 || d.broken || d.lost) return fail("frames", d.frames, cycles + 1);
+	if (empty != 1 || d.count != 0) return fail("heartbeat frames", empty, 1);
+	if (good != (unsigned long)cycles * TEST_SENSORS) return fail("readings", good, (unsigned long)cycles * TEST_SENSORS);
+	if (output) {
+		FILE *f = fopen(output, "wb");
+		if (f == NULL || fwrite(stream, 1, streamLen, f) != streamLen) {
+			fprintf(stderr, "can't write %s\n", output);
+			return 2;
+		}
+		fclose(f);
+	}
+
+	//A broken byte in every 7th frame, the others are still decoded
+	static uint8_t broken[sizeof(stream)];
+	memcpy(broken, stream, streamLen);
+	unsigned frame = 0, spoiled = 0;
+	size_t start = 0;
+	for (size_t i = 0; i < streamLen; i++) {
+		if (stream[i]) continue;
+		if (frame++ % 7 == 3) {
+			size_t k = start + (i - start) / 2;
+			broken[k] = broken[k] == 0x40 ? 0x41 : broken[k] ^ 0x40;
+			spoiled++;
+		}
+		start = i + 1;
+	}
+	decoderInit(&d, 0);
+	for (size_t i = 0; i < streamLen; i++) decoderFeed(&d, broken[i]);
+	if (d.broken != spoiled || d.frames != cycles + 1 - spoiled) return fail("broken frames", d.broken, spoiled);
+
+	double t0 = nowNs();
+	const unsigned rounds = 20;
+	for (unsigned r = 0; r < rounds; r++) {
+		memcpy(broken, stream, streamLen);
+		decoderInit(&d, 0);
+		for (size_t i = 0; i < streamLen; i++) decoderFeed(&d, broken[i]);
+	}
+	double t1 = nowNs();
+
+	double bitUs = 10 * 1e6 / huart1.Init.BaudRate;
+	fprintf(stderr, "telemetry,bytes_per_cycle,line_ms_per_cycle\n");
+	fprintf(stderr, "text,%lu,%.1f\n", text / cycles, text * bitUs / cycles / 1000);
+	fprintf(stderr, "frame,%lu,%.1f\n", streamLen / cycles, streamLen * bitUs / cycles / 1000);
+	fprintf(stderr, "frames still sending at the end of a cycle: %lu of %u\n", late, cycles);
+	fprintf(stderr, "decoded %.1f MB/s, %.0f frames/s\n", rounds * streamLen / ((t1 - t0) / 1e9) / 1e6,
+		rounds * (double)cycles / ((t1 - t0) / 1e9));
+	fprintf(stderr, "ok: %u frames, %lu readings, %u broken frames caught\n", cycles, good, spoiled);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = NULL;
+	const char *output = NULL;
+	int test = 0;
+	unsigned cycles = 100;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t")) {
+			test = 1;
+			if (i + 1 < argc && argv[i + 1][0] != '-') cycles = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			output = argv[++i];
+		} else if (argv[i][0] != '-' && path == NULL) {
+			path = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [file] | -t [cycles] [-o stream.bin]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (test) {
+		if (cycles == 0 || cycles > TEST_MAX_CYCLES) cycles = 100;
+		return selfTest(cycles, output);
+	}
+
+	FILE *f = path ? fopen(path, "rb") : stdin;
+	if (f == NULL) {
+		fprintf(stderr, "can't read %s\n", path);
+		return 2;
+	}
+	Decoder_t d;
+	decoderInit(&d, 1);
+	printf("seq,sensor,id,raw,status,tick\n");
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		if (decoderFeed(&d, (uint8_t)c)) fflush(stdout);
+	}
+	decoderReport(&d);
+	if (f != stdin) fclose(f);
+	return 0;
+}